@@ -36,6 +36,7 @@
 #include "jsemit.h"
 #include "jsfun.h"
 #include "jsgc.h"
+#include "jsinterp.h"
 #include "jslock.h"
 #include "jsobj.h"
 #include "jsparse.h"
@@ -119,6 +120,7 @@ static JSDJContext *_jsdjc;
 #endif /* JSDEBUGGER */
 
 static int reportWarnings;
+static char *coverageFile;
 
 typedef enum JSShellErrNum {
 #define MSG_DEF(name, number, count, exception, format) \
@@ -236,7 +238,7 @@ static int
 usage(void)
 {
     fprintf(gErrFile, "%s\n", JS_GetImplementationVersion());
-    fprintf(gErrFile, "usage: js [-w] [-v version] [-f scriptfile] [scriptfile] [scriptarg...]\n");
+    fprintf(gErrFile, "usage: js [-w] [-l] [-c lcovfile] [-v version] [-f scriptfile] [scriptfile] [scriptarg...]\n");
     return 2;
 }
 
@@ -265,6 +267,20 @@ ProcessArgs(JSContext *cx, JSObject *obj, char **argv, int argc)
 		reportWarnings++;
 		break;
 
+	    case 'l':
+		JS_SetOptions(cx, JS_GetOptions(cx) | JSOPTION_LAZY_FUNCTIONS);
+		break;
+
+	    case 'c':
+		if (i+1 == argc) {
+		    return usage();
+		}
+		if (!JS_SetCoverage(cx, JS_TRUE))
+		    return 1;
+		coverageFile = argv[i+1];
+		i++;
+		break;
+
 	    case 'f':
 		if (i+1 == argc) {
 		    return usage();
@@ -463,7 +479,7 @@ GetTrapArgs(JSContext *cx, uintN argc, jsval *argv, JSScript **scriptp,
 	intarg = 0;
 	if (JS_TypeOfValue(cx, argv[0]) == JSTYPE_FUNCTION) {
 	    fun = JS_ValueToFunction(cx, argv[0]);
-	    if (!fun)
+	    if (!fun || !FUN_COMPILE_LAZY(cx, fun))
 		return JS_FALSE;
 	    *scriptp = fun->script;
 	    intarg++;
@@ -568,6 +584,98 @@ PCToLine(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     return JS_TRUE;
 }
 
+static JSBool
+Profile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    uint32 usec;
+
+    usec = 0;
+    if (argc != 0 && !JS_ValueToECMAUint32(cx, argv[0], &usec))
+	return JS_FALSE;
+    return JS_StartProfiling(cx, usec);
+}
+
+static JSBool
+Unprofile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JS_StopProfiling(cx);
+    return JS_TRUE;
+}
+
+typedef JSBool (*DumpOp)(JSContext *cx, FILE *fp);
+
+/*
+ * Run dump on gOutFile, or on the file named by argv[0] if there is one.
+ * The shell command's name prefixes any error message.
+ */
+static JSBool
+DumpToFile(JSContext *cx, uintN argc, jsval *argv, const char *cmd,
+	   DumpOp dump)
+{
+    JSString *str;
+    const char *name;
+    FILE *file;
+    JSBool ok;
+
+    if (argc == 0)
+	return dump(cx, gOutFile);
+    str = JS_ValueToString(cx, argv[0]);
+    if (!str)
+	return JS_FALSE;
+    name = JS_GetStringBytes(str);
+    file = fopen(name, "w");
+    if (!file) {
+	fprintf(gErrFile, "%s: can't open %s: %s\n",
+		cmd, name, strerror(errno));
+	return JS_FALSE;
+    }
+    ok = dump(cx, file);
+    fclose(file);
+    return ok;
+}
+
+static JSBool
+DumpProfile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    return DumpToFile(cx, argc, argv, "dumpprof", JS_DumpProfile);
+}
+
+static JSBool
+CallProfile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JSBool enable;
+
+    enable = JS_TRUE;
+    if (argc != 0 && !JS_ValueToBoolean(cx, argv[0], &enable))
+	return JS_FALSE;
+    return JS_SetCallProfiling(cx, enable);
+}
+
+static JSBool
+DumpCallProfile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
+		jsval *rval)
+{
+    return DumpToFile(cx, argc, argv, "dumpcalls", JS_DumpCallProfile);
+}
+
+static JSBool
+HeapProfile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    uint32 rate;
+
+    rate = 1;
+    if (argc != 0 && !JS_ValueToECMAUint32(cx, argv[0], &rate))
+	return JS_FALSE;
+    return JS_SetHeapProfiling(cx, rate);
+}
+
+static JSBool
+DumpHeapProfile(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
+		jsval *rval)
+{
+    return DumpToFile(cx, argc, argv, "dumpheap", JS_DumpHeapProfile);
+}
+
 #ifdef DEBUG
 
 static void
@@ -638,7 +746,7 @@ Notes(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 
     for (i = 0; i < argc; i++) {
 	fun = JS_ValueToFunction(cx, argv[i]);
-	if (!fun)
+	if (!fun || !FUN_COMPILE_LAZY(cx, fun))
 	    return JS_FALSE;
 
 	SrcNotes(cx, fun);
@@ -679,7 +787,7 @@ Disassemble(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     }
     for (i = 0; i < argc; i++) {
 	fun = JS_ValueToFunction(cx, argv[i]);
-	if (!fun)
+	if (!fun || !FUN_COMPILE_LAZY(cx, fun))
 	    return JS_FALSE;
 
 	js_Disassemble(cx, fun->script, lines, stdout);
@@ -702,7 +810,7 @@ DisassWithSrc(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval
 
     for (i = 0; i < argc; i++) {
 	fun = JS_ValueToFunction(cx, argv[i]);
-	if (!fun)
+	if (!fun || !FUN_COMPILE_LAZY(cx, fun))
 	    return JS_FALSE;
 
 	if (!fun->script || !fun->script->filename) {
@@ -992,6 +1100,13 @@ static JSFunctionSpec shell_functions[] = {
     {"untrap",          Untrap,         2},
     {"line2pc",         LineToPC,       0},
     {"pc2line",         PCToLine,       0},
+    {"profile",         Profile,        1},
+    {"unprofile",       Unprofile,      0},
+    {"dumpprof",        DumpProfile,    1},
+    {"callprof",        CallProfile,    1},
+    {"dumpcalls",       DumpCallProfile,1},
+    {"heapprof",        HeapProfile,    1},
+    {"dumpheap",        DumpHeapProfile,1},
 #ifdef DEBUG
     {"dis",             Disassemble,    1},
     {"dissrc",          DisassWithSrc,  1},
@@ -1022,6 +1137,13 @@ static char *shell_help_messages[] = {
     "untrap [fun] [pc]      Remove a trap",
     "line2pc [fun] line     Map line number to PC",
     "pc2line [fun] [pc]     Map PC to line number",
+    "profile [usec]         Sample the JS stack every usec of CPU time",
+    "unprofile              Stop sampling the JS stack",
+    "dumpprof [file]        Write profile samples as folded stacks",
+    "callprof [toggle]      Turn counting and timing of calls on or off",
+    "dumpcalls [file]       Write call counts and times by function",
+    "heapprof [rate]        Sample 1 in rate GC allocations, 0 to stop",
+    "dumpheap [file]        Write live heap by allocation site and class",
 #ifdef DEBUG
     "dis [fun]              Disassemble functions into bytecodes",
     "dissrc [fun]           Disassemble functions with source lines",
@@ -1593,6 +1715,19 @@ main(int argc, char **argv)
 
     result = ProcessArgs(cx, glob, argv, argc);
 
+    if (coverageFile) {
+	FILE *file = fopen(coverageFile, "w");
+	if (!file) {
+	    fprintf(gErrFile, "js: can't open %s: %s\n",
+		    coverageFile, strerror(errno));
+	    result = 1;
+	} else {
+	    if (!JS_DumpCoverage(cx, file))
+		result = 1;
+	    fclose(file);
+	}
+    }
+
 #ifdef JSDEBUGGER
     if (_jsdc)
 	JSD_DebuggerOff(_jsdc);
@@ -1602,6 +1737,10 @@ main(int argc, char **argv)
     fclose(gTestResultFile);
 #endif
 
+#ifdef JS_OPMETER
+    js_DumpOpMeters(stdout, 40);
+#endif
+
     JS_DestroyContext(cx);
     JS_DestroyRuntime(rt);
     JS_ShutDown();
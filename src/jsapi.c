@@ -36,6 +36,7 @@
 #include "jscntxt.h"
 #include "jsconfig.h"
 #include "jsdate.h"
+#include "jsdbgapi.h"
 #include "jsemit.h"
 #include "jsexn.h"
 #include "jsfun.h"
@@ -416,13 +417,14 @@ JS_NewRuntime(uint32 maxbytes)
     rt->requestDone = JS_NEW_CONDVAR(rt->gcLock);
     if (!rt->requestDone)
 	goto bad;
+    rt->lazyDone = JS_NEW_CONDVAR(rt->gcLock);
+    if (!rt->lazyDone)
+	goto bad;
     js_SetupLocks(10);		/* this is asymmetric with JS_ShutDown. */
     js_NewLock(&rt->rtLock);
 #endif
     rt->propertyCache.empty = JS_TRUE;
     JS_INIT_CLIST(&rt->contextList);
-    JS_INIT_CLIST(&rt->trapList);
-    JS_INIT_CLIST(&rt->watchPointList);
     return rt;
 
 bad:
@@ -433,7 +435,13 @@ bad:
 JS_PUBLIC_API(void)
 JS_DestroyRuntime(JSRuntime *rt)
 {
+    js_FinishDebugState(rt);
     js_FinishGC(rt);
+    js_FinishNumberStrings(rt);
+    js_FlushEnumCache(rt);
+#if JS_HAS_FILE_OBJECT
+    js_StopFileThreads();
+#endif
 #ifdef JS_THREADSAFE
     if (rt->gcLock)
 	JS_DESTROY_LOCK(rt->gcLock);
@@ -441,6 +449,8 @@ JS_DestroyRuntime(JSRuntime *rt)
 	JS_DESTROY_CONDVAR(rt->gcDone);
     if (rt->requestDone)
 	JS_DESTROY_CONDVAR(rt->requestDone);
+    if (rt->lazyDone)
+	JS_DESTROY_CONDVAR(rt->lazyDone);
     js_DestroyLock(&rt->rtLock);
 #endif
     free(rt);
@@ -632,6 +642,23 @@ JS_SetVersion(JSContext *cx, JSVersion version)
     return oldVersion;
 }
 
+JS_PUBLIC_API(uint32)
+JS_GetOptions(JSContext *cx)
+{
+    return cx->options;
+}
+
+JS_PUBLIC_API(uint32)
+JS_SetOptions(JSContext *cx, uint32 options)
+{
+    uint32 oldOptions;
+
+    CHECK_REQUEST(cx);
+    oldOptions = cx->options;
+    cx->options = options;
+    return oldOptions;
+}
+
 JS_PUBLIC_API(const char *)
 JS_GetImplementationVersion(void)
 {
@@ -1975,16 +2002,9 @@ JS_CompileScript(JSContext *cx, JSObject *obj,
 		 const char *bytes, size_t length,
 		 const char *filename, uintN lineno)
 {
-    jschar *chars;
-    JSScript *script;
-
     CHECK_REQUEST(cx);
-    chars = js_InflateString(cx, bytes, length);
-    if (!chars)
-	return NULL;
-    script = JS_CompileUCScript(cx, obj, chars, length, filename, lineno);
-    JS_free(cx, chars);
-    return script;
+    return JS_CompileScriptForPrincipals(cx, obj, NULL, bytes, length,
+					 filename, lineno);
 }
 
 JS_PUBLIC_API(JSScript *)
@@ -1993,17 +2013,51 @@ JS_CompileScriptForPrincipals(JSContext *cx, JSObject *obj,
 			      const char *bytes, size_t length,
 			      const char *filename, uintN lineno)
 {
-    jschar *chars;
-    JSScript *script;
+    void *mark;
+    JSTokenStream *ts;
 
     CHECK_REQUEST(cx);
-    chars = js_InflateString(cx, bytes, length);
-    if (!chars)
+    mark = JS_ARENA_MARK(&cx->tempPool);
+    ts = js_NewByteTokenStream(cx, bytes, length, NULL, NULL, JS_FALSE,
+			       filename, lineno, principals);
+    if (!ts)
 	return NULL;
-    script = JS_CompileUCScriptForPrincipals(cx, obj, principals,
-					     chars, length, filename, lineno);
-    JS_free(cx, chars);
-    return script;
+    return CompileTokenStream(cx, obj, ts, mark);
+}
+
+JS_PUBLIC_API(JSScript *)
+JS_CompileUTF8Script(JSContext *cx, JSObject *obj,
+		     const char *bytes, size_t length,
+		     const char *filename, uintN lineno)
+{
+    void *mark;
+    JSTokenStream *ts;
+
+    CHECK_REQUEST(cx);
+    mark = JS_ARENA_MARK(&cx->tempPool);
+    ts = js_NewByteTokenStream(cx, bytes, length, NULL, NULL, JS_TRUE,
+			       filename, lineno, NULL);
+    if (!ts)
+	return NULL;
+    return CompileTokenStream(cx, obj, ts, mark);
+}
+
+JS_PUBLIC_API(JSScript *)
+JS_CompileScriptFromReader(JSContext *cx, JSObject *obj,
+			   JSPrincipals *principals,
+			   JSSourceReader reader, void *closure, JSBool utf8,
+			   const char *filename, uintN lineno)
+{
+    void *mark;
+    JSTokenStream *ts;
+
+    CHECK_REQUEST(cx);
+    mark = JS_ARENA_MARK(&cx->tempPool);
+    ts = js_NewByteTokenStream(cx, NULL, 0, reader, closure, utf8,
+			       filename, lineno, principals);
+    if (!ts)
+	return NULL;
+    return CompileTokenStream(cx, obj, ts, mark);
 }
 
 JS_PUBLIC_API(JSScript *)
@@ -2072,23 +2126,69 @@ JS_DestroyScript(JSContext *cx, JSScript *script)
     js_DestroyScript(cx, script);
 }
 
+static JSFunction *
+CompileFunctionTokenStream(JSContext *cx, JSObject *obj, JSTokenStream *ts,
+			   void *tempMark, const char *name,
+			   uintN nargs, const char **argnames)
+{
+    JSFunction *fun;
+    JSAtom *funAtom, *argAtom;
+    uintN i;
+    JSScopeProperty *sprop;
+    jsval junk;
+
+    funAtom = js_Atomize(cx, name, strlen(name), 0);
+    if (!funAtom) {
+	fun = NULL;
+	goto out;
+    }
+    fun = js_DefineFunction(cx, obj, funAtom, NULL, nargs, 0);
+    if (!fun)
+	goto out;
+    if (nargs) {
+	for (i = 0; i < nargs; i++) {
+	    argAtom = js_Atomize(cx, argnames[i], strlen(argnames[i]), 0);
+	    if (!argAtom)
+		break;
+	    if (!js_DefineProperty(cx, fun->object, (jsid)argAtom,
+				   JSVAL_VOID, js_GetArgument, js_SetArgument,
+				   JSPROP_ENUMERATE|JSPROP_PERMANENT,
+				   (JSProperty **)&sprop)) {
+		break;
+	    }
+	    JS_ASSERT(sprop);
+	    sprop->id = INT_TO_JSVAL(i);
+	    OBJ_DROP_PROPERTY(cx, fun->object, (JSProperty *)sprop);
+	}
+	if (i < nargs) {
+	    (void) OBJ_DELETE_PROPERTY(cx, obj, (jsid)funAtom, &junk);
+	    fun = NULL;
+	    goto out;
+	}
+    }
+    if (!js_CompileFunctionBody(cx, ts, fun)) {
+	(void) OBJ_DELETE_PROPERTY(cx, obj, (jsid)funAtom, &junk);
+	fun = NULL;
+    }
+out:
+    if (!js_CloseTokenStream(cx, ts) && fun) {
+	(void) OBJ_DELETE_PROPERTY(cx, obj, (jsid)funAtom, &junk);
+	fun = NULL;
+    }
+    JS_ARENA_RELEASE(&cx->tempPool, tempMark);
+    return fun;
+}
+
 JS_PUBLIC_API(JSFunction *)
 JS_CompileFunction(JSContext *cx, JSObject *obj, const char *name,
 		   uintN nargs, const char **argnames,
 		   const char *bytes, size_t length,
 		   const char *filename, uintN lineno)
 {
-    jschar *chars;
-    JSFunction *fun;
-
     CHECK_REQUEST(cx);
-    chars = js_InflateString(cx, bytes, length);
-    if (!chars)
-	return NULL;
-    fun = JS_CompileUCFunction(cx, obj, name, nargs, argnames, chars, length,
-			       filename, lineno);
-    JS_free(cx, chars);
-    return fun;
+    return JS_CompileFunctionForPrincipals(cx, obj, NULL, name,
+					   nargs, argnames, bytes, length,
+					   filename, lineno);
 }
 
 JS_PUBLIC_API(JSFunction *)
@@ -2098,18 +2198,19 @@ JS_CompileFunctionForPrincipals(JSContext *cx, JSObject *obj,
 				const char *bytes, size_t length,
 				const char *filename, uintN lineno)
 {
-    jschar *chars;
-    JSFunction *fun;
+    void *mark;
+    JSTokenStream *ts;
 
     CHECK_REQUEST(cx);
-    chars = js_InflateString(cx, bytes, length);
-    if (!chars)
+    mark = JS_ARENA_MARK(&cx->tempPool);
+    ts = js_NewByteTokenStream(cx, bytes, length, NULL, NULL, JS_FALSE,
+			       filename, lineno, principals);
+    if (!ts) {
+	JS_ARENA_RELEASE(&cx->tempPool, mark);
 	return NULL;
-    fun = JS_CompileUCFunctionForPrincipals(cx, obj, principals, name,
-					    nargs, argnames, chars, length,
-					    filename, lineno);
-    JS_free(cx, chars);
-    return fun;
+    }
+    return CompileFunctionTokenStream(cx, obj, ts, mark, name,
+				      nargs, argnames);
 }
 
 JS_PUBLIC_API(JSFunction *)
@@ -2134,58 +2235,16 @@ JS_CompileUCFunctionForPrincipals(JSContext *cx, JSObject *obj,
 {
     void *mark;
     JSTokenStream *ts;
-    JSFunction *fun;
-    JSAtom *funAtom, *argAtom;
-    uintN i;
-    JSScopeProperty *sprop;
-    jsval junk;
 
     CHECK_REQUEST(cx);
     mark = JS_ARENA_MARK(&cx->tempPool);
     ts = js_NewTokenStream(cx, chars, length, filename, lineno, principals);
     if (!ts) {
-	fun = NULL;
-	funAtom = NULL;
-	goto out;
-    }
-    funAtom = js_Atomize(cx, name, strlen(name), 0);
-    if (!funAtom) {
-	fun = NULL;
-	goto out;
-    }
-    fun = js_DefineFunction(cx, obj, funAtom, NULL, nargs, 0);
-    if (!fun)
-	goto out;
-    if (nargs) {
-	for (i = 0; i < nargs; i++) {
-	    argAtom = js_Atomize(cx, argnames[i], strlen(argnames[i]), 0);
-	    if (!argAtom)
-		break;
-	    if (!js_DefineProperty(cx, fun->object, (jsid)argAtom,
-				   JSVAL_VOID, js_GetArgument, js_SetArgument,
-				   JSPROP_ENUMERATE|JSPROP_PERMANENT,
-				   (JSProperty **)&sprop)) {
-		break;
-	    }
-	    JS_ASSERT(sprop);
-	    sprop->id = INT_TO_JSVAL(i);
-	    OBJ_DROP_PROPERTY(cx, fun->object, (JSProperty *)sprop);
-	}
-	if (i < nargs) {
-	    (void) OBJ_DELETE_PROPERTY(cx, obj, (jsid)funAtom, &junk);
-	    fun = NULL;
-	    goto out;
-	}
-    }
-    if (!js_CompileFunctionBody(cx, ts, fun)) {
-	(void) OBJ_DELETE_PROPERTY(cx, obj, (jsid)funAtom, &junk);
-	fun = NULL;
+	JS_ARENA_RELEASE(&cx->tempPool, mark);
+	return NULL;
     }
-out:
-    if (ts)
-	js_CloseTokenStream(cx, ts);
-    JS_ARENA_RELEASE(&cx->tempPool, mark);
-    return fun;
+    return CompileFunctionTokenStream(cx, obj, ts, mark, name,
+				      nargs, argnames);
 }
 
 JS_PUBLIC_API(JSString *)
@@ -2262,16 +2321,9 @@ JS_EvaluateScript(JSContext *cx, JSObject *obj,
 		  const char *filename, uintN lineno,
 		  jsval *rval)
 {
-    jschar *chars;
-    JSBool ok;
-
     CHECK_REQUEST(cx);
-    chars = js_InflateString(cx, bytes, length);
-    if (!chars)
-	return JS_FALSE;
-    ok = JS_EvaluateUCScript(cx, obj, chars, length, filename, lineno, rval);
-    JS_free(cx, chars);
-    return ok;
+    return JS_EvaluateScriptForPrincipals(cx, obj, NULL, bytes, length,
+					  filename, lineno, rval);
 }
 
 JS_PUBLIC_API(JSBool)
@@ -2281,16 +2333,20 @@ JS_EvaluateScriptForPrincipals(JSContext *cx, JSObject *obj,
 			       const char *filename, uintN lineno,
 			       jsval *rval)
 {
-    jschar *chars;
+    JSScript *script;
     JSBool ok;
 
     CHECK_REQUEST(cx);
-    chars = js_InflateString(cx, bytes, length);
-    if (!chars)
+    script = JS_CompileScriptForPrincipals(cx, obj, principals, bytes, length,
+					   filename, lineno);
+    if (!script)
 	return JS_FALSE;
-    ok = JS_EvaluateUCScriptForPrincipals(cx, obj, principals, chars, length,
-					  filename, lineno, rval);
-    JS_free(cx, chars);
+    ok = js_Execute(cx, obj, script, NULL, NULL, JS_FALSE, rval);
+#if JS_HAS_EXCEPTIONS
+    if (!ok)
+        js_ReportUncaughtException(cx);
+#endif
+    JS_DestroyScript(cx, script);
     return ok;
 }
 
@@ -287,6 +287,19 @@ JS_GetVersion(JSContext *cx);
 extern JS_PUBLIC_API(JSVersion)
 JS_SetVersion(JSContext *cx, JSVersion version);
 
+/*
+ * Compiler options for cx.  With JSOPTION_LAZY_FUNCTIONS, the body of each
+ * function not nested in another function is only syntax-checked when its
+ * script is compiled, and is compiled to bytecode when first called.
+ */
+#define JSOPTION_LAZY_FUNCTIONS JS_BIT(0)
+
+extern JS_PUBLIC_API(uint32)
+JS_GetOptions(JSContext *cx);
+
+extern JS_PUBLIC_API(uint32)
+JS_SetOptions(JSContext *cx, uint32 options);
+
 extern JS_PUBLIC_API(const char *)
 JS_GetImplementationVersion(void);
 
@@ -760,6 +773,26 @@ JS_CompileScriptForPrincipals(JSContext *cx, JSObject *obj,
 			      const char *bytes, size_t length,
 			      const char *filename, uintN lineno);
 
+/*
+ * Compile UTF-8 source, decoding it as it is scanned rather than inflating
+ * a jschar copy of all of it first.
+ */
+extern JS_PUBLIC_API(JSScript *)
+JS_CompileUTF8Script(JSContext *cx, JSObject *obj,
+		     const char *bytes, size_t length,
+		     const char *filename, uintN lineno);
+
+/*
+ * Compile source read in chunks from reader (see JSSourceReader), decoded
+ * as UTF-8 if utf8 is true, else as Latin-1.  Only one chunk of the source
+ * need be in memory at a time.
+ */
+extern JS_PUBLIC_API(JSScript *)
+JS_CompileScriptFromReader(JSContext *cx, JSObject *obj,
+			   JSPrincipals *principals,
+			   JSSourceReader reader, void *closure, JSBool utf8,
+			   const char *filename, uintN lineno);
+
 extern JS_PUBLIC_API(JSScript *)
 JS_CompileUCScript(JSContext *cx, JSObject *obj,
 		   const jschar *chars, size_t length,
@@ -187,8 +187,9 @@ JS_ArenaRelease(JSArenaPool *pool, char *mark)
 {
     JSArena *a;
 
+    /* A mark taken just before a new arena was started equals a->avail. */
     for (a = pool->first.next; a; a = a->next) {
-	if (JS_UPTRDIFF(mark, a) < JS_UPTRDIFF(a->avail, a)) {
+	if (JS_UPTRDIFF(mark, a) <= JS_UPTRDIFF(a->avail, a)) {
 	    a->avail = (jsuword)JS_ARENA_ALIGN(pool, mark);
 	    FreeArenaList(pool, a, JS_TRUE);
 	    return;
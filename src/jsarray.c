@@ -314,17 +314,17 @@ array_join_sub(JSContext *cx, JSObject *obj, JSString *sep, JSBool literalize,
     JSBool ok;
     jsval v;
     jsuint length, index;
-    jschar *chars, *ochars;
-    size_t nchars, growth, seplen;
-    const jschar *sepstr;
+    jschar *chars;
+    size_t nchars;
+    JSStringBuffer sb;
     JSString *str;
     JSHashEntry *he;
 
     ok = js_GetLengthProperty(cx, obj, &length);
     if (!ok)
 	return JS_FALSE;
-    ok = JS_TRUE;
 
+    js_InitStringBuffer(&sb);
     if (literalize) {
 	he = js_EnterSharpObject(cx, obj, NULL, &chars);
 	if (!he)
@@ -340,96 +340,59 @@ array_join_sub(JSContext *cx, JSObject *obj, JSString *sep, JSBool literalize,
 #endif
 	    goto make_string;
 	}
-
-	/*
-	 * Allocate 1 + 3 + 1 for "[", the worst-case closing ", ]", and the
-	 * terminating 0.
-	 */
-	growth = (1 + 3 + 1) * sizeof(jschar);
-	if (!chars) {
-	    nchars = 0;
-	    chars = malloc(growth);
-	    if (!chars)
-		goto done;
-	} else {
+	if (chars) {
+	    /* Start with the "#n=" sharp variable definition. */
 	    MAKE_SHARP(he);
-	    nchars = js_strlen(chars);
-	    chars = realloc((ochars = chars), nchars * sizeof(jschar) + growth);
-	    if (!chars) {
-		free(ochars);
-		goto done;
-	    }
+	    sb.base = chars;
+	    sb.limit = sb.ptr = chars + js_strlen(chars);
 	}
-	chars[nchars++] = '[';
+	ok = js_AppendChar(cx, &sb, '[');
     } else {
 	if (length == 0) {
 	    *rval = JS_GetEmptyStringValue(cx);
 	    return ok;
 	}
-	chars = NULL;
-	nchars = 0;
     }
-    sepstr = NULL;
-    seplen = sep->length;
 
     v = JSVAL_NULL;
-    for (index = 0; index < length; index++) {
+    for (index = 0; ok && index < length; index++) {
 	ok = JS_GetElement(cx, obj, index, &v);
 	if (!ok)
-	    goto done;
-
-	if (JSVAL_IS_VOID(v) || JSVAL_IS_NULL(v)) {
-	    str = cx->runtime->emptyString;
-	} else {
-	    str = (literalize ? js_ValueToSource : js_ValueToString)(cx, v);
-	    if (!str) {
-		ok = JS_FALSE;
-		goto done;
-	    }
+	    break;
+	if (index != 0) {
+	    ok = js_AppendChars(cx, &sb, sep->chars, sep->length);
+	    if (!ok)
+		break;
 	}
+	if (JSVAL_IS_VOID(v) || JSVAL_IS_NULL(v))
+	    continue;
 
-	/* Allocate 3 + 1 at end for ", ", closing bracket, and zero. */
-	growth = (nchars + (sepstr ? seplen : 0) +
-		  str->length +
-		  3 + 1) * sizeof(jschar);
-	if (!chars) {
-	    chars = malloc(growth);
-	    if (!chars)
-		goto done;
+	/* Numbers and booleans are appended without making a string. */
+	if (literalize && (JSVAL_IS_STRING(v) || !JSVAL_IS_PRIMITIVE(v))) {
+	    str = js_ValueToSource(cx, v);
+	    ok = str && js_AppendChars(cx, &sb, str->chars, str->length);
 	} else {
-	    chars = realloc((ochars = chars), growth);
-	    if (!chars) {
-		free(ochars);
-		goto done;
-	    }
-	}
-
-	if (sepstr) {
-	    js_strncpy(&chars[nchars], sepstr, seplen);
-	    nchars += seplen;
+	    ok = js_AppendValue(cx, &sb, v);
 	}
-	sepstr = sep->chars;
-
-	js_strncpy(&chars[nchars], str->chars, str->length);
-	nchars += str->length;
     }
 
-  done:
     if (literalize) {
-	if (chars) {
-	    if (JSVAL_IS_VOID(v)) {
-		chars[nchars++] = ',';
-		chars[nchars++] = ' ';
-	    }
-	    chars[nchars++] = ']';
-	}
+	if (ok && JSVAL_IS_VOID(v))
+	    ok = js_AppendCString(cx, &sb, ", ");
+	if (ok)
+	    ok = js_AppendChar(cx, &sb, ']');
 	js_LeaveSharpObject(cx, NULL);
     }
+    if (ok) {
+	str = js_NewStringFromBuffer(cx, &sb);
+	ok = (str != NULL);
+    }
     if (!ok) {
-	if (chars)
-	    free(chars);
-	return ok;
+	js_FinishStringBuffer(&sb);
+	return JS_FALSE;
     }
+    *rval = STRING_TO_JSVAL(str);
+    return JS_TRUE;
 
   make_string:
     if (!chars) {
@@ -624,6 +587,162 @@ js_qsort(void *vec, size_t nel, size_t elsize, JSComparator cmp, void *arg)
     return JS_TRUE;
 }
 
+/*
+ * Stable merge sort for array_sort.  Ascending runs, and strictly descending
+ * runs reversed in place, are found first; runs shorter than MERGESORT_MIN_RUN
+ * are extended with binary insertion sort.  Adjacent runs are then merged
+ * pairwise through tmp, which must have room for nel elements.  A merge whose
+ * runs are already in order costs one comparison, so sorted and nearly sorted
+ * input is handled in close to nel comparisons.
+ */
+#define MERGESORT_MIN_RUN       16
+#define ELEM(vec, i)            ((char *)(vec) + (i) * elsize)
+
+static void
+mergesort_reverse(char *lo, char *hi, size_t elsize, char *swap)
+{
+    while (lo < hi) {
+	memcpy(swap, lo, elsize);
+	memcpy(lo, hi, elsize);
+	memcpy(hi, swap, elsize);
+	lo += elsize;
+	hi -= elsize;
+    }
+}
+
+/* Insert vec[start, hi) into the already sorted vec[lo, start). */
+static void
+mergesort_insert(char *vec, size_t lo, size_t start, size_t hi, size_t elsize,
+		 JSComparator cmp, void *arg, char *pivot)
+{
+    size_t i, l, r, m;
+
+    for (i = start; i < hi; i++) {
+	memcpy(pivot, ELEM(vec, i), elsize);
+	l = lo;
+	r = i;
+	while (l < r) {
+	    m = l + (r - l) / 2;
+	    if ((*cmp)(pivot, ELEM(vec, m), arg) < 0)
+		r = m;
+	    else
+		l = m + 1;
+	}
+	memmove(ELEM(vec, l + 1), ELEM(vec, l), (i - l) * elsize);
+	memcpy(ELEM(vec, l), pivot, elsize);
+    }
+}
+
+/* Merge the sorted runs vec[lo, mid) and vec[mid, hi). */
+static void
+mergesort_merge(char *vec, size_t lo, size_t mid, size_t hi, size_t elsize,
+		JSComparator cmp, void *arg, char *tmp)
+{
+    size_t l, r, m;
+    char *a, *aend, *b, *bend, *dst;
+
+    if ((*cmp)(ELEM(vec, mid - 1), ELEM(vec, mid), arg) <= 0)
+	return;
+
+    /* Left elements not greater than vec[mid] are already in place. */
+    l = lo;
+    r = mid - 1;
+    while (l < r) {
+	m = l + (r - l) / 2;
+	if ((*cmp)(ELEM(vec, mid), ELEM(vec, m), arg) < 0)
+	    r = m;
+	else
+	    l = m + 1;
+    }
+    lo = l;
+
+    /* So are right elements not less than the last left element. */
+    l = mid + 1;
+    r = hi;
+    while (l < r) {
+	m = l + (r - l) / 2;
+	if ((*cmp)(ELEM(vec, m), ELEM(vec, mid - 1), arg) < 0)
+	    l = m + 1;
+	else
+	    r = m;
+    }
+    hi = l;
+
+    memcpy(tmp, ELEM(vec, lo), (mid - lo) * elsize);
+    a = tmp;
+    aend = tmp + (mid - lo) * elsize;
+    b = ELEM(vec, mid);
+    bend = ELEM(vec, hi);
+    dst = ELEM(vec, lo);
+    while (a < aend && b < bend) {
+	if ((*cmp)(b, a, arg) < 0) {
+	    memcpy(dst, b, elsize);
+	    b += elsize;
+	} else {
+	    memcpy(dst, a, elsize);
+	    a += elsize;
+	}
+	dst += elsize;
+    }
+    if (a < aend)
+	memcpy(dst, a, (size_t)(aend - a));
+}
+
+JSBool
+js_MergeSort(void *vec, size_t nel, size_t elsize, JSComparator cmp, void *arg,
+	     void *tmp)
+{
+    size_t *runs, nruns, lo, hi, end, i, j;
+
+    if (nel < 2)
+	return JS_TRUE;
+    runs = malloc((nel / MERGESORT_MIN_RUN + 2) * sizeof *runs);
+    if (!runs)
+	return JS_FALSE;
+
+    nruns = 0;
+    runs[0] = 0;
+    for (lo = 0; lo < nel; lo = hi) {
+	hi = lo + 1;
+	if (hi < nel) {
+	    if ((*cmp)(ELEM(vec, hi), ELEM(vec, lo), arg) < 0) {
+		do {
+		    hi++;
+		} while (hi < nel &&
+			 (*cmp)(ELEM(vec, hi), ELEM(vec, hi - 1), arg) < 0);
+		mergesort_reverse(ELEM(vec, lo), ELEM(vec, hi - 1), elsize,
+				  tmp);
+	    } else {
+		do {
+		    hi++;
+		} while (hi < nel &&
+			 (*cmp)(ELEM(vec, hi), ELEM(vec, hi - 1), arg) >= 0);
+	    }
+	}
+	end = JS_MIN(lo + MERGESORT_MIN_RUN, nel);
+	if (hi < end) {
+	    mergesort_insert(vec, lo, hi, end, elsize, cmp, arg, tmp);
+	    hi = end;
+	}
+	runs[++nruns] = hi;
+    }
+
+    while (nruns > 1) {
+	for (i = j = 0; i + 2 <= nruns; i += 2) {
+	    mergesort_merge(vec, runs[i], runs[i+1], runs[i+2], elsize,
+			    cmp, arg, tmp);
+	    runs[++j] = runs[i+2];
+	}
+	if (i < nruns)
+	    runs[++j] = runs[nruns];
+	nruns = j;
+    }
+    free(runs);
+    return JS_TRUE;
+}
+
+#undef ELEM
+
 typedef struct CompareArgs {
     JSContext  *context;
     jsval      fval;
@@ -640,58 +759,115 @@ sort_compare(const void *a, const void *b, void *arg)
     jsval fval, argv[2], rval;
     JSBool ok;
 
-    fval = ca->fval;
-    if (fval == JSVAL_NULL) {
-	JSString *astr, *bstr;
+    /* Once the comparator has failed, don't call it again. */
+    if (!ca->status)
+	return 0;
 
-	if (av == bv) {
+    fval = ca->fval;
+    argv[0] = av;
+    argv[1] = bv;
+    ok = js_CallFunctionValue(cx,
+			      OBJ_GET_PARENT(cx, JSVAL_TO_OBJECT(fval)),
+			      fval, 2, argv, &rval);
+    if (ok) {
+	ok = js_ValueToNumber(cx, rval, &cmp);
+	/* Clamp cmp to -1, 0, 1. */
+	if (JSDOUBLE_IS_NaN(cmp)) {
+	    /* XXX report some kind of error here?  ECMA talks about
+	     * 'consistent compare functions' that don't return NaN, but is
+	     * silent about what the result should be.  So we currently
+	     * ignore it.
+	     */
 	    cmp = 0;
-	} else if (av == JSVAL_VOID || bv == JSVAL_VOID) {
-	    /* Put undefined properties at the end. */
-	    cmp = (av == JSVAL_VOID) ? 1 : -1;
-	} else if ((astr = js_ValueToString(cx, av)) != NULL &&
-		   (bstr = js_ValueToString(cx, bv)) != NULL) {
-	    cmp = js_CompareStrings(astr, bstr);
-	} else {
-	    ca->status = JS_FALSE;
+	} else if (cmp != 0) {
+	    cmp = cmp > 0 ? 1 : -1;
 	}
     } else {
-	argv[0] = av;
-	argv[1] = bv;
-	ok = js_CallFunctionValue(cx,
-				  OBJ_GET_PARENT(cx, JSVAL_TO_OBJECT(fval)),
-				  fval, 2, argv, &rval);
-	if (ok) {
-	    ok = js_ValueToNumber(cx, rval, &cmp);
-	    /* Clamp cmp to -1, 0, 1. */
-	    if (JSDOUBLE_IS_NaN(cmp)) {
-		/* XXX report some kind of error here?  ECMA talks about
-		 * 'consistent compare functions' that don't return NaN, but is
-		 * silent about what the result should be.  So we currently
-		 * ignore it.
-		 */
-		cmp = 0;
-	    } else if (cmp != 0) {
-		cmp = cmp > 0 ? 1 : -1;
-	    }
-	} else {
-	    ca->status = ok;
-	}
+	ca->status = ok;
     }
     return (int)cmp;
 }
 
-/* XXXmccabe do the sort helper functions need to take int?  (Or can we claim
- * that 2^32 * 32 is too large to worry about?)  Something dumps when I change
- * to unsigned int; is qsort using -1 as a fencepost?
+/*
+ * Default comparison of string (or undefined) elements.  Undefined sorts
+ * after everything else.
+ */
+static int
+sort_compare_strings(const void *a, const void *b, void *arg)
+{
+    jsval av = *(const jsval *)a, bv = *(const jsval *)b;
+
+    if (av == bv)
+	return 0;
+    if (av == JSVAL_VOID || bv == JSVAL_VOID) {
+	/* Put undefined properties at the end. */
+	return (av == JSVAL_VOID) ? 1 : -1;
+    }
+    return js_CompareStrings(JSVAL_TO_STRING(av), JSVAL_TO_STRING(bv));
+}
+
+/* Elements are (value, string key) pairs; compare by key. */
+static int
+sort_compare_keys(const void *a, const void *b, void *arg)
+{
+    return sort_compare_strings((const jsval *)a + 1, (const jsval *)b + 1,
+				arg);
+}
+
+static const jsuint powersOf10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+/*
+ * Default comparison of int elements: order them as their decimal strings
+ * would be ordered, without making the strings.  The shorter digit string
+ * is compared with the same-length prefix of the longer one.
  */
+static int
+sort_compare_ints(const void *a, const void *b, void *arg)
+{
+    jsint ai = JSVAL_TO_INT(*(const jsval *)a);
+    jsint bi = JSVAL_TO_INT(*(const jsval *)b);
+    jsuint au, bu;
+    uintN ad, bd;
+
+    if (ai == bi)
+	return 0;
+
+    /* '-' sorts before any digit. */
+    if ((ai < 0) != (bi < 0))
+	return (ai < 0) ? -1 : 1;
+    au = (ai < 0) ? (jsuint)-ai : (jsuint)ai;
+    bu = (bi < 0) ? (jsuint)-bi : (jsuint)bi;
+
+    for (ad = 1; ad < 10 && au >= powersOf10[ad]; ad++)
+	continue;
+    for (bd = 1; bd < 10 && bu >= powersOf10[bd]; bd++)
+	continue;
+    if (ad > bd) {
+	au /= powersOf10[ad - bd];
+	return (au < bu) ? -1 : 1;
+    }
+    if (ad < bd) {
+	bu /= powersOf10[bd - ad];
+	return (au <= bu) ? -1 : 1;
+    }
+    return (au < bu) ? -1 : 1;
+}
+
 static JSBool
 array_sort(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
-    jsval fval;
+    jsval fval, v;
     CompareArgs ca;
+    JSComparator cmp;
     jsuint len, i;
-    jsval *vec;
+    uintN width, nslots;
+    jsval *vec, *oldsp;
+    JSStackFrame *fp;
+    JSString *str;
+    JSBool allints, allstrings;
+    void *mark;
     jsid id;
 
     if (argc > 0) {
@@ -707,10 +883,30 @@ array_sort(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 
     if (!js_GetLengthProperty(cx, obj, &len))
 	return JS_FALSE;
-    vec = JS_malloc(cx, (size_t) len * sizeof(jsval));
+
+    /*
+     * Sort in stack space above fp->sp so that the GC sees the elements, the
+     * string keys made for them, and the merge buffer while toString methods
+     * or the comparator run.  Without a comparator, elements that are not
+     * all ints or all strings are paired with their string keys, so each is
+     * converted once rather than at every comparison; that needs twice the
+     * room, and the merge buffer needs as much again.
+     */
+    width = (fval == JSVAL_NULL) ? 2 : 1;
+    if (len > ((uint32)-1 / (2 * width)) / sizeof(jsval)) {
+	JS_ReportOutOfMemory(cx);
+	return JS_FALSE;
+    }
+    nslots = (uintN)len * 2 * width;
+    vec = js_AllocStack(cx, nslots, &mark);
     if (!vec)
 	return JS_FALSE;
+    memset(vec, 0, nslots * sizeof(jsval));
+    fp = cx->fp;
+    oldsp = fp->sp;
+    fp->sp = vec + nslots;
 
+    allints = allstrings = JS_TRUE;
     for (i = 0; i < len; i++) {
 	ca.status = IndexToId(cx, i, &id);
 	if (!ca.status)
@@ -718,24 +914,63 @@ array_sort(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 	ca.status = OBJ_GET_PROPERTY(cx, obj, id, &vec[i]);
 	if (!ca.status)
 	    goto out;
+	v = vec[i];
+	if (!JSVAL_IS_INT(v))
+	    allints = JS_FALSE;
+	if (!JSVAL_IS_STRING(v) && v != JSVAL_VOID)
+	    allstrings = JS_FALSE;
+    }
+
+    width = 1;
+    if (fval != JSVAL_NULL) {
+	cmp = sort_compare;
+    } else if (allints) {
+	cmp = sort_compare_ints;
+    } else if (allstrings) {
+	cmp = sort_compare_strings;
+    } else {
+	/* Spread the values out into (value, key) pairs, last one first. */
+	width = 2;
+	cmp = sort_compare_keys;
+	for (i = len; i-- != 0; ) {
+	    vec[2 * i] = vec[i];
+	    vec[2 * i + 1] = JSVAL_NULL;
+	}
+	for (i = 0; i < len; i++) {
+	    v = vec[2 * i];
+	    if (v != JSVAL_VOID) {
+		str = js_ValueToString(cx, v);
+		if (!str) {
+		    ca.status = JS_FALSE;
+		    goto out;
+		}
+		v = STRING_TO_JSVAL(str);
+	    }
+	    vec[2 * i + 1] = v;
+	}
     }
 
     ca.context = cx;
     ca.fval = fval;
     ca.status = JS_TRUE;
-    if (!js_qsort(vec, (size_t) len, sizeof(jsval), sort_compare, &ca)) {
+    if (!js_MergeSort(vec, (size_t) len, width * sizeof(jsval), cmp, &ca,
+		      vec + len * width)) {
 	JS_ReportOutOfMemory(cx);
 	ca.status = JS_FALSE;
     }
 
     if (ca.status) {
+	if (width == 2) {
+	    for (i = 0; i < len; i++)
+		vec[i] = vec[2 * i];
+	}
 	ca.status = InitArrayObject(cx, obj, len, vec);
 	if (ca.status)
 	    *rval = OBJECT_TO_JSVAL(obj);
     }
 out:
-    if (vec)
-	JS_free(cx, vec);
+    fp->sp = oldsp;
+    js_FreeStack(cx, mark);
     return ca.status;
 }
 
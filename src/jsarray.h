@@ -51,6 +51,14 @@ typedef int (*JSComparator)(const void *a, const void *b, void *arg);
 extern JSBool
 js_qsort(void *vec, size_t nel, size_t elsize, JSComparator cmp, void *arg);
 
+/*
+ * Stable merge sort; tmp must have room for nel elements.  Returns false only
+ * if memory for the run table cannot be allocated.
+ */
+extern JSBool
+js_MergeSort(void *vec, size_t nel, size_t elsize, JSComparator cmp, void *arg,
+	     void *tmp);
+
 JS_END_EXTERN_C
 
 #endif /* jsarray_h___ */
@@ -40,6 +40,10 @@
 #include "jsscan.h"
 #include "jsscript.h"
 
+#if JS_HAS_FILE_OBJECT
+#include "jsfile.h"
+#endif
+
 JSContext *
 js_NewContext(JSRuntime *rt, size_t stacksize)
 {
@@ -123,9 +127,15 @@ js_DestroyContext(JSContext *cx)
 	JS_ClearAllWatchPoints(cx);
     }
 
+#if JS_HAS_FILE_OBJECT
+    /* Drop cx's undelivered async file jobs, which root their callbacks. */
+    js_CancelFileJobs(cx);
+#endif
+
     /* Remove more GC roots in regExpStatics, then collect garbage. */
 #if JS_HAS_REGEXPS
     js_FreeRegExpStatics(cx, &cx->regExpStatics);
+    js_FlushRegExpCache(cx);
 #endif
     js_ForceGC(cx);
 
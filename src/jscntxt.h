@@ -28,6 +28,7 @@
 #include "jsconfig.h"
 #include "jsgc.h"
 #include "jsinterp.h"
+#include "jsnum.h"
 #include "jsobj.h"
 #include "jsprvtd.h"
 #include "jspubtd.h"
@@ -48,6 +49,7 @@ struct JSRuntime {
     uint32              gcNumber;
     JSBool              gcPoke;
     JSGCCallback        gcCallback;
+    JSHeapProfile       *heapProfile;
 #ifdef JS_GCMETER
     JSGCStats           gcStats;
 #endif
@@ -71,6 +73,13 @@ struct JSRuntime {
     /* Empty string held for use by this runtime's contexts. */
     JSString            *emptyString;
 
+    /* Weak links to strings for small integers, see jsnum.h. */
+    JSString            **intStrings[NUMBER_STRING_CHUNKS];
+
+    /* Last scope shape handed out, and ids enumerated by shape, see jsobj.h. */
+    jsword              shapeGen;       /* jsword for js_CompareAndSwap */
+    JSNativeEnumerator  *enumCache[ENUM_CACHE_SIZE];
+
     /* List of active contexts sharing this runtime. */
     JSCList             contextList;
 
@@ -96,9 +105,21 @@ struct JSRuntime {
     JSDebugErrorHook    debugErrorHook;
     void                *debugErrorHookData;
 
+    /* Sampling profiler state, see jsdbgapi.c. */
+    JSProfiler          *profiler;
+
+    /* Call counts and times by function, see jsinterp.c. */
+    JSBool              callProfiling;
+    JSCallProfile       *callProfile;
+
+    /* Coverage counts by source line, see jsdbgapi.c. */
+    JSBool              coverageEnabled;
+    JSCoverage          *coverage;
+
     /* More debugging state, see jsdbgapi.c. */
-    JSCList             trapList;
-    JSCList             watchPointList;
+    JSHashTable         *trapTable;
+    JSHashTable         *scriptTrapTable;
+    JSHashTable         *watchPointTable;
 
     /* Weak links to properties, indexed by quickened get/set opcodes. */
     /* XXX must come after JSCLists or MSVC alignment bug bites empty lists */
@@ -111,6 +132,9 @@ struct JSRuntime {
     PRCondVar           *requestDone;
     uint32              requestCount;
 
+    /* Notified when a thread finishes compiling a lazy function's body. */
+    PRCondVar           *lazyDone;
+
     /* Lock and owning thread pointer for JS_LOCK_RUNTIME. */
     JSThinLock          rtLock;
 #endif
@@ -127,6 +151,9 @@ struct JSContext {
     jsbytecode          jsop_eq;
     jsbytecode          jsop_ne;
 
+    /* Compile-time option flags, see JSOPTION_* in jsapi.h. */
+    uint32              options;
+
     /* Data shared by threads in an address space. */
     JSRuntime           *runtime;
 
@@ -144,9 +171,18 @@ struct JSContext {
     /* Most recently created things by type, members of the GC's root set. */
     JSGCThing           *newborn[GCX_NTYPES];
 
+    /* Weak links to recently converted number strings, see jsnum.h. */
+    JSDtoStrCacheEntry  dtoStrCache[DTOSTR_CACHE_SIZE];
+
     /* Regular expression class statics (XXX not shared globally). */
     JSRegExpStatics     regExpStatics;
 
+    /* Regexps compiled from pattern strings, see js_NewCachedRegExpOpt. */
+    JSRegExp            *regExpCache[JSREGEXP_CACHE_SIZE];
+
+    /* Where JSOP_GNAME and friends last found their names, see jsinterp.h. */
+    JSGNameCacheEntry   gnameCache[GNAME_CACHE_SIZE];
+
     /* State for object and array toSource conversion. */
     JSSharpObjectMap    sharpObjectMap;
 
@@ -166,6 +202,11 @@ struct JSContext {
     /* GC and thread-safe state. */
     JSStackFrame        *dormantFrameChain; /* dormant stack frame to scan */
     uint32              gcDisabled;         /* XXX for pre-ECMAv2 switch */
+    uint32              gcAllocCount;       /* things allocated, wrapping */
+
+    /* Callee totals of the innermost profiled call, see jsinterp.c. */
+    jsdouble            calleeTime;
+    uint32              calleeAllocs;
 #ifdef JS_THREADSAFE
     jsword              thread;
     jsrefcount          requestDepth;
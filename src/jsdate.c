@@ -27,6 +27,9 @@
 #include "jsprf.h"
 #include "prmjtime.h"
 #include "jsutil.h" /* Added by JSIFY */
+#ifdef JS_THREADSAFE
+#include "prlock.h"
+#endif
 #include "jsapi.h"
 #include "jsconfig.h"
 #include "jscntxt.h"
@@ -303,29 +306,155 @@ WeekDay(jsdouble t)
 static jsdouble LocalTZA;
 
 static jsdouble
-DaylightSavingTA(jsdouble t)
+ComputeDSTOffset(jsdouble seconds)
 {
     volatile int64 PR_t;
+    int64 s2us;
     int64 ms2us;
     int64 offset;
     jsdouble result;
 
-    /* abort if NaN */
-    if (JSDOUBLE_IS_NaN(t))
-	return t;
-
-    /* put our t in an LL, and map it to usec for prtime */
-    JSLL_D2L(PR_t, t);
-    JSLL_I2L(ms2us, PRMJ_USEC_PER_MSEC);
-    JSLL_MUL(PR_t, PR_t, ms2us);
+    /* put our seconds in an LL, and map it to usec for prtime */
+    JSLL_D2L(PR_t, seconds);
+    JSLL_I2L(s2us, PRMJ_USEC_PER_SEC);
+    JSLL_MUL(PR_t, PR_t, s2us);
 
     offset = PRMJ_DSTOffset(PR_t);
 
+    JSLL_I2L(ms2us, PRMJ_USEC_PER_MSEC);
     JSLL_DIV(offset, offset, ms2us);
     JSLL_L2D(result, offset);
     return result;
 }
 
+/*
+ * PRMJ_DSTOffset calls localtime, which is slow and takes libc's timezone
+ * lock, so remember the offset found for a range of seconds and grow the
+ * range while probes at its ends agree.  Zones don't change their offset
+ * twice within DST_RANGE_EXPANSION, so a probe that far past either end that
+ * finds the same offset means there was no change in between.  Times are
+ * clamped the way PRMJ_DSTOffset clamps them, and a second range is kept so
+ * that alternating between two dates far apart doesn't thrash.
+ */
+#define DST_RANGE_EXPANSION     (30 * SecondsPerDay)
+#define DST_MIN_SECONDS         SecondsPerDay
+#define DST_MAX_SECONDS         2145859200.0    /* PRMJ_MAX_UNIX_TIMET */
+
+typedef struct DSTRange {
+    jsdouble    start;          /* first second of the range */
+    jsdouble    end;            /* last second, inclusive */
+    jsdouble    offset;         /* DST offset in ms throughout */
+} DSTRange;
+
+#define DST_RANGE_NEAR(r, s)    ((r)->start <= (r)->end &&                  \
+                                 (s) >= (r)->start - DST_RANGE_EXPANSION && \
+                                 (s) <= (r)->end + DST_RANGE_EXPANSION)
+
+static DSTRange dstRange = {1, 0, 0};   /* empty until first use */
+static DSTRange dstOldRange = {1, 0, 0};
+
+#ifdef JS_THREADSAFE
+static PRLock *dstLock;
+#endif
+
+static jsdouble
+LookupDSTOffset(jsdouble seconds)
+{
+    DSTRange *r, old;
+    jsdouble probe, probeOffset, offset;
+
+    if (seconds > DST_MAX_SECONDS)
+        seconds = DST_MAX_SECONDS;
+    else if (seconds < 0)
+        seconds = DST_MIN_SECONDS;
+
+    r = &dstRange;
+    if (r->start <= seconds && seconds <= r->end)
+        return r->offset;
+    if (dstOldRange.start <= seconds && seconds <= dstOldRange.end)
+        return dstOldRange.offset;
+
+    /*
+     * Grow whichever range seconds is near, making it current, or else start
+     * a new current range and keep the last one.
+     */
+    if (!DST_RANGE_NEAR(r, seconds)) {
+        old = *r;
+        if (DST_RANGE_NEAR(&dstOldRange, seconds)) {
+            *r = dstOldRange;
+            dstOldRange = old;
+        } else {
+            dstOldRange = old;
+            r->offset = ComputeDSTOffset(seconds);
+            r->start = r->end = seconds;
+            return r->offset;
+        }
+    }
+
+    if (seconds > r->end) {
+        probe = r->end + DST_RANGE_EXPANSION;
+        if (probe > DST_MAX_SECONDS)
+            probe = DST_MAX_SECONDS;
+        probeOffset = ComputeDSTOffset(probe);
+        if (probeOffset == r->offset) {
+            r->end = probe;
+            return r->offset;
+        }
+
+        /* The offset changes between r->end and probe. */
+        offset = ComputeDSTOffset(seconds);
+        if (offset == probeOffset) {
+            r->start = seconds;
+            r->end = probe;
+        } else if (offset == r->offset) {
+            r->end = seconds;
+        } else {
+            r->start = r->end = seconds;
+        }
+        r->offset = offset;
+        return offset;
+    }
+
+    probe = r->start - DST_RANGE_EXPANSION;
+    if (probe < 0)
+        probe = 0;
+    probeOffset = ComputeDSTOffset(probe);
+    if (probeOffset == r->offset) {
+        r->start = probe;
+        return r->offset;
+    }
+    offset = ComputeDSTOffset(seconds);
+    if (offset == probeOffset) {
+        r->start = probe;
+        r->end = seconds;
+    } else if (offset == r->offset) {
+        r->start = seconds;
+    } else {
+        r->start = r->end = seconds;
+    }
+    r->offset = offset;
+    return offset;
+}
+
+static jsdouble
+DaylightSavingTA(jsdouble t)
+{
+    jsdouble result;
+
+    /* abort if NaN */
+    if (JSDOUBLE_IS_NaN(t))
+	return t;
+
+#ifdef JS_THREADSAFE
+    PR_Lock(dstLock);
+#endif
+    result = LookupDSTOffset(floor(t / msPerSecond));
+#ifdef JS_THREADSAFE
+    PR_Unlock(dstLock);
+#endif
+    return result;
+}
+
 #define LocalTime(t)    ((t) + LocalTZA + DaylightSavingTA(t))
 
 static jsdouble
@@ -1433,8 +1562,10 @@ new_explode(jsdouble time, PRMJTime *split, JSBool findEquivalent)
     split->tm_yday = (int16) DayWithinYear(time, year);
 
     /* not sure how this affects things, but it doesn't seem
-       to matter. */
-    split->tm_isdst = (DaylightSavingTA(time) != 0);
+       to matter.  Bypass the DST cache, though: strftime takes %Z from
+       the zone names libc's localtime last left behind. */
+    split->tm_isdst = !JSDOUBLE_IS_NaN(time) &&
+		      ComputeDSTOffset(floor(time / msPerSecond)) != 0;
 }
 
 /* helper function */
@@ -1800,8 +1931,23 @@ js_InitDateClass(JSContext *cx, JSObject *obj)
     JSObject *proto;
     jsdouble *proto_date;
 
-    /* set static LocalTZA */
+    /* set static LocalTZA, and forget DST offsets in case the zone moved */
     LocalTZA = -(PRMJ_LocalGMTDifference() * msPerSecond);
+#ifdef JS_THREADSAFE
+    if (!dstLock) {
+	dstLock = PR_NewLock();
+	if (!dstLock) {
+	    JS_ReportOutOfMemory(cx);
+	    return NULL;
+	}
+    }
+    PR_Lock(dstLock);
+#endif
+    dstRange.start = dstOldRange.start = 1;
+    dstRange.end = dstOldRange.end = 0;
+#ifdef JS_THREADSAFE
+    PR_Unlock(dstLock);
+#endif
     proto = JS_InitClass(cx, obj, NULL, &date_class, Date, MAXARGS,
 			 NULL, date_methods, NULL, date_static_methods);
     if (!proto)
@@ -20,26 +20,94 @@
  * JS debugging API.
  */
 #include "jsstddef.h"
+#include <stdlib.h>
 #include <string.h>
+#ifdef XP_UNIX
+#include <signal.h>
+#include <sys/time.h>
+#endif
 #include "jstypes.h"
 #include "jsutil.h" /* Added by JSIFY */
 #include "jsclist.h"
 #include "jsapi.h"
+#include "jsatom.h"
 #include "jscntxt.h"
 #include "jsconfig.h"
 #include "jsdbgapi.h"
+#include "jsemit.h"
 #include "jsfun.h"
 #include "jsgc.h"
 #include "jsinterp.h"
 #include "jslock.h"
 #include "jsobj.h"
 #include "jsopcode.h"
+#include "jsprf.h"
 #include "jsscope.h"
 #include "jsscript.h"
 #include "jsstr.h"
 
+/*
+ * Traps and watchpoints are indexed by hash tables created on first use.
+ * rt->trapTable maps a trapped pc to its JSTrap, rt->scriptTrapTable maps a
+ * script to one of its traps, and rt->watchPointTable maps an object to one
+ * of its watchpoints.  The traps of a script, and the watchpoints of an
+ * object, are linked in a circular list through their links members, with
+ * no list header: the table entry's value is the list's first element.
+ */
+static JSHashTable *
+NewPointerTable(JSContext *cx)
+{
+    JSHashTable *table;
+
+    table = JS_NewHashTable(16, JS_HashPointer, JS_CompareValues,
+			    JS_CompareValues, NULL, NULL);
+    if (!table)
+	JS_ReportOutOfMemory(cx);
+    return table;
+}
+
+/* Add link, the first member of its struct, to the list mapped by key. */
+static JSBool
+AddToList(JSContext *cx, JSHashTable *table, const void *key, JSCList *link)
+{
+    JSHashNumber keyHash;
+    JSHashEntry **hep, *he;
+
+    keyHash = JS_HashPointer(key);
+    hep = JS_HashTableRawLookup(table, keyHash, key);
+    he = *hep;
+    if (he) {
+	JS_APPEND_LINK(link, (JSCList *)he->value);
+	return JS_TRUE;
+    }
+    JS_INIT_CLIST(link);
+    if (!JS_HashTableRawAdd(table, hep, keyHash, key, link)) {
+	JS_ReportOutOfMemory(cx);
+	return JS_FALSE;
+    }
+    return JS_TRUE;
+}
+
+static void
+RemoveFromList(JSHashTable *table, const void *key, JSCList *link)
+{
+    JSHashEntry **hep, *he;
+
+    hep = JS_HashTableRawLookup(table, JS_HashPointer(key), key);
+    he = *hep;
+    JS_ASSERT(he);
+    if (JS_CLIST_IS_EMPTY(link)) {
+	JS_ASSERT(he->value == link);
+	JS_HashTableRawRemove(table, hep, he);
+	return;
+    }
+    if (he->value == link)
+	he->value = link->next;
+    JS_REMOVE_LINK(link);
+}
+
 typedef struct JSTrap {
-    JSCList         links;
+    JSCList         links;      /* must be first, see AddToList */
     JSScript        *script;
     jsbytecode      *pc;
     JSOp            op;
@@ -52,13 +120,11 @@ FindTrap(JSRuntime *rt, JSScript *script, jsbytecode *pc)
 {
     JSTrap *trap;
 
-    for (trap = (JSTrap *)rt->trapList.next;
-	 trap != (JSTrap *)&rt->trapList;
-	 trap = (JSTrap *)trap->links.next) {
-	if (trap->script == script && trap->pc == pc)
-	    return trap;
-    }
-    return NULL;
+    if (!rt->trapTable)
+	return NULL;
+    trap = (JSTrap *) JS_HashTableLookup(rt->trapTable, pc);
+    JS_ASSERT(!trap || trap->script == script);
+    return trap;
 }
 
 void
@@ -80,20 +146,43 @@ JS_SetTrap(JSContext *cx, JSScript *script, jsbytecode *pc,
     JSRuntime *rt;
     JSTrap *trap;
 
+    if (script->image) {
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL,
+			     JSMSG_CANT_TRAP_IMAGE);
+	return JS_FALSE;
+    }
     rt = cx->runtime;
     trap = FindTrap(rt, script, pc);
     if (trap) {
 	/* Restore opcode at pc so it can be saved again. */
 	*pc = (jsbytecode)trap->op;
     } else {
+	if (!rt->trapTable) {
+	    rt->trapTable = NewPointerTable(cx);
+	    if (!rt->trapTable)
+		return JS_FALSE;
+	    rt->scriptTrapTable = NewPointerTable(cx);
+	    if (!rt->scriptTrapTable) {
+		JS_HashTableDestroy(rt->trapTable);
+		rt->trapTable = NULL;
+		return JS_FALSE;
+	    }
+	}
 	trap = JS_malloc(cx, sizeof *trap);
 	if (!trap || !js_AddRoot(cx, &trap->closure, "trap->closure")) {
 	    if (trap)
 		JS_free(cx, trap);
 	    return JS_FALSE;
 	}
+	if (!JS_HashTableAdd(rt->trapTable, pc, trap)) {
+	    JS_ReportOutOfMemory(cx);
+	    goto bad;
+	}
+	if (!AddToList(cx, rt->scriptTrapTable, script, &trap->links)) {
+	    JS_HashTableRemove(rt->trapTable, pc);
+	    goto bad;
+	}
     }
-    JS_APPEND_LINK(&trap->links, &rt->trapList);
     trap->script = script;
     trap->pc = pc;
     trap->op = (JSOp)*pc;
@@ -101,6 +190,11 @@ JS_SetTrap(JSContext *cx, JSScript *script, jsbytecode *pc,
     trap->closure = closure;
     *pc = JSOP_TRAP;
     return JS_TRUE;
+
+bad:
+    js_RemoveRoot(cx, &trap->closure);
+    JS_free(cx, trap);
+    return JS_FALSE;
 }
 
 JS_PUBLIC_API(JSOp)
@@ -119,7 +213,11 @@ JS_GetTrapOpcode(JSContext *cx, JSScript *script, jsbytecode *pc)
 static void
 DestroyTrap(JSContext *cx, JSTrap *trap)
 {
-    JS_REMOVE_LINK(&trap->links);
+    JSRuntime *rt;
+
+    rt = cx->runtime;
+    JS_HashTableRemove(rt->trapTable, trap->pc);
+    RemoveFromList(rt->scriptTrapTable, trap->script, &trap->links);
     *trap->pc = (jsbytecode)trap->op;
     js_RemoveRoot(cx, &trap->closure);
     JS_free(cx, trap);
@@ -144,31 +242,44 @@ JS_PUBLIC_API(void)
 JS_ClearScriptTraps(JSContext *cx, JSScript *script)
 {
     JSRuntime *rt;
-    JSTrap *trap, *next;
+    JSTrap *trap;
 
     rt = cx->runtime;
-    for (trap = (JSTrap *)rt->trapList.next;
-	 trap != (JSTrap *)&rt->trapList;
-	 trap = next) {
-	next = (JSTrap *)trap->links.next;
-	if (trap->script == script)
-	    DestroyTrap(cx, trap);
+    if (!rt->scriptTrapTable)
+	return;
+    while ((trap = (JSTrap *)
+		   JS_HashTableLookup(rt->scriptTrapTable, script)) != NULL) {
+	DestroyTrap(cx, trap);
     }
 }
 
+static intN
+DestroyTrapEntry(JSHashEntry *he, intN i, void *arg)
+{
+    JSContext *cx;
+    JSTrap *trap;
+
+    cx = (JSContext *)arg;
+    trap = (JSTrap *)he->value;
+    *trap->pc = (jsbytecode)trap->op;
+    js_RemoveRoot(cx, &trap->closure);
+    JS_free(cx, trap);
+    return HT_ENUMERATE_NEXT;
+}
+
 JS_PUBLIC_API(void)
 JS_ClearAllTraps(JSContext *cx)
 {
     JSRuntime *rt;
-    JSTrap *trap, *next;
 
     rt = cx->runtime;
-    for (trap = (JSTrap *)rt->trapList.next;
-	 trap != (JSTrap *)&rt->trapList;
-	 trap = next) {
-	next = (JSTrap *)trap->links.next;
-	DestroyTrap(cx, trap);
-    }
+    if (!rt->trapTable)
+	return;
+    JS_HashTableEnumerateEntries(rt->trapTable, DestroyTrapEntry, cx);
+    JS_HashTableDestroy(rt->trapTable);
+    JS_HashTableDestroy(rt->scriptTrapTable);
+    rt->trapTable = NULL;
+    rt->scriptTrapTable = NULL;
 }
 
 JS_PUBLIC_API(JSTrapStatus)
@@ -196,9 +307,57 @@ JS_HandleTrap(JSContext *cx, JSScript *script, jsbytecode *pc, jsval *rval)
     return status;
 }
 
+/*
+ * Sampling profiler state.  A SIGPROF handler points rt->interruptHandler at
+ * ProfileInterrupt, so the interpreter's existing per-op interrupt test is
+ * the only cost between samples.  ProfileInterrupt runs on the interpreting
+ * thread, appends the frame ids of cx's stack to the samples buffer, and
+ * restores userHandler.  A full buffer is folded into the stacks table.
+ */
+#define PROFILE_MAX_DEPTH       64
+#define PROFILE_BUFFER_WORDS    16384
+#define PROFILE_DEFAULT_USEC    1000
+#define PROFILE_NO_FRAME        ((uint32)-1)
+
+struct JSProfiler {
+    JSBool              running;
+    JSTrapHandler       userHandler;    /* handler set by JS_SetInterrupt */
+    uint32              *samples;       /* [depth, leaf id, ... root id]... */
+    uint32              length;         /* words used in samples */
+    JSHashTable         *frames;        /* script or native => frame id */
+    JSHashTable         *nameIds;       /* frame name => frame id */
+    char                **names;        /* frame names, indexed by id */
+    uint32              nnames;
+    JSHashTable         *stacks;        /* [depth, root id, ...] => count */
+    uint32              nsamples;
+    uint32              ndropped;
+#ifdef XP_UNIX
+    struct sigaction    oldAction;
+    struct itimerval    oldTimer;
+#endif
+};
+
+static JSTrapStatus
+ProfileInterrupt(JSContext *cx, JSScript *script, jsbytecode *pc, jsval *rval,
+		 void *closure);
+
 JS_PUBLIC_API(JSBool)
 JS_SetInterrupt(JSRuntime *rt, JSTrapHandler handler, void *closure)
 {
+    JSProfiler *prof;
+
+    /*
+     * While the sampling profiler runs, rt->interruptHandler may briefly be
+     * ProfileInterrupt, which puts prof->userHandler back when it fires.
+     */
+    prof = rt->profiler;
+    if (prof && prof->running) {
+	prof->userHandler = handler;
+	rt->interruptHandlerData = closure;
+	if (rt->interruptHandler != ProfileInterrupt)
+	    rt->interruptHandler = handler;
+	return JS_TRUE;
+    }
     rt->interruptHandler = handler;
     rt->interruptHandlerData = closure;
     return JS_TRUE;
@@ -207,6 +366,20 @@ JS_SetInterrupt(JSRuntime *rt, JSTrapHandler handler, void *closure)
 JS_PUBLIC_API(JSBool)
 JS_ClearInterrupt(JSRuntime *rt, JSTrapHandler *handlerp, void **closurep)
 {
+    JSProfiler *prof;
+
+    prof = rt->profiler;
+    if (prof && prof->running) {
+	if (handlerp)
+	    *handlerp = prof->userHandler;
+	if (closurep)
+	    *closurep = rt->interruptHandlerData;
+	prof->userHandler = 0;
+	if (rt->interruptHandler != ProfileInterrupt)
+	    rt->interruptHandler = 0;
+	rt->interruptHandlerData = 0;
+	return JS_TRUE;
+    }
     if (handlerp)
 	*handlerp = (JSTrapHandler)rt->interruptHandler;
     if (closurep)
@@ -218,7 +391,7 @@ JS_ClearInterrupt(JSRuntime *rt, JSTrapHandler *handlerp, void **closurep)
 
 
 typedef struct JSWatchPoint {
-    JSCList             links;
+    JSCList             links;          /* must be first, see AddToList */
     JSObject            *object;	/* weak link, see js_FinalizeObject */
     jsval               userid;
     JSScopeProperty     *sprop;
@@ -239,22 +412,37 @@ DropWatchPoint(JSContext *cx, JSWatchPoint *wp)
     JS_LOCK_OBJ_VOID(cx, wp->object,
 		     js_DropScopeProperty(cx, (JSScope *)wp->object->map,
 					  wp->sprop));
-    JS_REMOVE_LINK(&wp->links);
+    RemoveFromList(cx->runtime->watchPointTable, wp->object, &wp->links);
     js_RemoveRoot(cx, &wp->closure);
     JS_free(cx, wp);
 }
 
+/*
+ * Return the first of obj's watchpoints, searching from which avoids scanning
+ * those of every other object.  Watchpoints are rare, and most objects being
+ * finalized have none, so JS_ClearWatchPointsForObject is cheap when so.
+ */
+static JSWatchPoint *
+FirstWatchPoint(JSRuntime *rt, JSObject *obj)
+{
+    if (!rt->watchPointTable)
+	return NULL;
+    return (JSWatchPoint *) JS_HashTableLookup(rt->watchPointTable, obj);
+}
+
 static JSWatchPoint *
 FindWatchPoint(JSRuntime *rt, JSObject *obj, jsval userid)
 {
-    JSWatchPoint *wp;
+    JSWatchPoint *first, *wp;
 
-    for (wp = (JSWatchPoint *)rt->watchPointList.next;
-	 wp != (JSWatchPoint *)&rt->watchPointList;
-	 wp = (JSWatchPoint *)wp->links.next) {
-	if (wp->object == obj && wp->userid == userid)
+    first = wp = FirstWatchPoint(rt, obj);
+    if (!wp)
+	return NULL;
+    do {
+	if (wp->userid == userid)
 	    return wp;
-    }
+	wp = (JSWatchPoint *)wp->links.next;
+    } while (wp != first);
     return NULL;
 }
 
@@ -272,8 +460,7 @@ js_FindWatchPoint(JSRuntime *rt, JSObject *obj, jsval userid)
 JSBool JS_DLL_CALLBACK
 js_watch_set(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
 {
-    JSRuntime *rt;
-    JSWatchPoint *wp;
+    JSWatchPoint *first, *wp;
     JSScopeProperty *sprop;
     JSSymbol *sym;
     jsval userid, value;
@@ -282,12 +469,10 @@ js_watch_set(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
     JSAtom *atom;
     JSBool ok;
 
-    rt = cx->runtime;
-    for (wp = (JSWatchPoint *)rt->watchPointList.next;
-	 wp != (JSWatchPoint *)&rt->watchPointList;
-	 wp = (JSWatchPoint *)wp->links.next) {
+    first = wp = FirstWatchPoint(cx->runtime, obj);
+    if (wp) do {
 	sprop = wp->sprop;
-	if (wp->object == obj && sprop->id == id) {
+	if (sprop->id == id) {
 	    JS_LOCK_OBJ(cx, obj);
 	    sym = sprop->symbols;
 	    if (!sym) {
@@ -328,7 +513,8 @@ js_watch_set(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
 	    DropWatchPoint(cx, wp);
 	    return ok;
 	}
-    }
+	wp = (JSWatchPoint *)wp->links.next;
+    } while (wp != first);
     JS_ASSERT(0);	/* XXX can't happen */
     return JS_FALSE;
 }
@@ -408,6 +594,11 @@ JS_SetWatchPoint(JSContext *cx, JSObject *obj, jsval id,
 
     wp = FindWatchPoint(rt, obj, id);
     if (!wp) {
+	if (!rt->watchPointTable) {
+	    rt->watchPointTable = NewPointerTable(cx);
+	    if (!rt->watchPointTable)
+		return JS_FALSE;
+	}
 	wp = JS_malloc(cx, sizeof *wp);
 	if (!wp)
 	    return JS_FALSE;
@@ -415,7 +606,11 @@ JS_SetWatchPoint(JSContext *cx, JSObject *obj, jsval id,
 	    JS_free(cx, wp);
 	    return JS_FALSE;
 	}
-	JS_APPEND_LINK(&wp->links, &rt->watchPointList);
+	if (!AddToList(cx, rt->watchPointTable, obj, &wp->links)) {
+	    js_RemoveRoot(cx, &wp->closure);
+	    JS_free(cx, wp);
+	    return JS_FALSE;
+	}
 	wp->object = obj;
 	wp->userid = id;
 	wp->sprop = js_HoldScopeProperty(cx, (JSScope *)obj->map, sprop);
@@ -433,21 +628,16 @@ JS_PUBLIC_API(void)
 JS_ClearWatchPoint(JSContext *cx, JSObject *obj, jsval id,
 		   JSWatchPointHandler *handlerp, void **closurep)
 {
-    JSRuntime *rt;
     JSWatchPoint *wp;
 
-    rt = cx->runtime;
-    for (wp = (JSWatchPoint *)rt->watchPointList.next;
-	 wp != (JSWatchPoint *)&rt->watchPointList;
-	 wp = (JSWatchPoint *)wp->links.next) {
-	if (wp->object == obj && wp->userid == id) {
-	    if (handlerp)
-		*handlerp = wp->handler;
-	    if (closurep)
-		*closurep = wp->closure;
-	    DropWatchPoint(cx, wp);
-	    return;
-	}
+    wp = FindWatchPoint(cx->runtime, obj, id);
+    if (wp) {
+	if (handlerp)
+	    *handlerp = wp->handler;
+	if (closurep)
+	    *closurep = wp->closure;
+	DropWatchPoint(cx, wp);
+	return;
     }
     if (handlerp)
 	*handlerp = NULL;
@@ -458,32 +648,61 @@ JS_ClearWatchPoint(JSContext *cx, JSObject *obj, jsval id,
 JS_PUBLIC_API(void)
 JS_ClearWatchPointsForObject(JSContext *cx, JSObject *obj)
 {
-    JSRuntime *rt;
-    JSWatchPoint *wp, *next;
+    JSWatchPoint *first, *wp, *next;
+    uintN n;
 
-    rt = cx->runtime;
-    for (wp = (JSWatchPoint *)rt->watchPointList.next;
-	 wp != (JSWatchPoint *)&rt->watchPointList;
-	 wp = next) {
+    first = wp = FirstWatchPoint(cx->runtime, obj);
+    if (!wp)
+	return;
+
+    /*
+     * Count before dropping: a held watchpoint survives DropWatchPoint, and
+     * one that doesn't may have been the list's first element.
+     */
+    n = 0;
+    do {
+	n++;
+	wp = (JSWatchPoint *)wp->links.next;
+    } while (wp != first);
+    while (n != 0) {
 	next = (JSWatchPoint *)wp->links.next;
-	if (wp->object == obj)
-	    DropWatchPoint(cx, wp);
+	DropWatchPoint(cx, wp);
+	wp = next;
+	n--;
     }
 }
 
+static intN
+CollectWatchedObject(JSHashEntry *he, intN i, void *arg)
+{
+    JSObject **vec;
+
+    vec = (JSObject **)arg;
+    vec[i] = (JSObject *)he->key;
+    return HT_ENUMERATE_NEXT;
+}
+
 JS_PUBLIC_API(void)
 JS_ClearAllWatchPoints(JSContext *cx)
 {
     JSRuntime *rt;
-    JSWatchPoint *wp, *next;
+    JSObject **vec;
+    uint32 i, n;
 
     rt = cx->runtime;
-    for (wp = (JSWatchPoint *)rt->watchPointList.next;
-	 wp != (JSWatchPoint *)&rt->watchPointList;
-	 wp = next) {
-	next = (JSWatchPoint *)wp->links.next;
-	DropWatchPoint(cx, wp);
-    }
+    if (!rt->watchPointTable)
+	return;
+    n = rt->watchPointTable->nentries;
+    if (n == 0)
+	return;
+    vec = (JSObject **) JS_malloc(cx, n * sizeof(JSObject *));
+    if (!vec)
+	return;
+    JS_HashTableEnumerateEntries(rt->watchPointTable, CollectWatchedObject,
+				 vec);
+    for (i = 0; i < n; i++)
+	JS_ClearWatchPointsForObject(cx, vec[i]);
+    JS_free(cx, vec);
 }
 
 JS_PUBLIC_API(uintN)
@@ -501,6 +720,9 @@ JS_LineNumberToPC(JSContext *cx, JSScript *script, uintN lineno)
 JS_PUBLIC_API(JSScript *)
 JS_GetFunctionScript(JSContext *cx, JSFunction *fun)
 {
+    /* A debugger wants to set traps in functions that have not yet run. */
+    if (!FUN_COMPILE_LAZY(cx, fun))
+	return NULL;
     return fun->script;
 }
 
@@ -878,3 +1100,878 @@ JS_SetDebugErrorHook(JSRuntime *rt, JSDebugErrorHook hook, void *closure)
     rt->debugErrorHookData = closure;
     return JS_TRUE;
 }
+
+/***************************************************************************/
+
+#ifdef XP_UNIX
+/* The SIGPROF timer is per-process, so only one runtime is sampled at once. */
+static JSRuntime *profiledRuntime;
+
+static void
+ProfileSignal(int sig)
+{
+    JSRuntime *rt;
+
+    rt = profiledRuntime;
+    if (rt)
+	rt->interruptHandler = ProfileInterrupt;
+}
+#endif
+
+static JSHashNumber
+HashStack(const void *key)
+{
+    const uint32 *stack;
+    uint32 i, n;
+    JSHashNumber h;
+
+    stack = (const uint32 *)key;
+    n = stack[0];
+    h = n;
+    for (i = 1; i <= n; i++)
+	h = (h >> 28) ^ (h << 4) ^ stack[i];
+    return h;
+}
+
+static intN
+CompareStacks(const void *v1, const void *v2)
+{
+    const uint32 *s1, *s2;
+
+    s1 = (const uint32 *)v1;
+    s2 = (const uint32 *)v2;
+    return s1[0] == s2[0] &&
+	   memcmp(s1 + 1, s2 + 1, s1[0] * sizeof(uint32)) == 0;
+}
+
+static intN
+FreeStackKey(JSHashEntry *he, intN i, void *arg)
+{
+    free((void *)he->key);
+    return HT_ENUMERATE_NEXT;
+}
+
+static void
+DestroyProfiler(JSProfiler *prof)
+{
+    uint32 i;
+
+    if (prof->stacks) {
+	JS_HashTableEnumerateEntries(prof->stacks, FreeStackKey, NULL);
+	JS_HashTableDestroy(prof->stacks);
+    }
+    if (prof->frames)
+	JS_HashTableDestroy(prof->frames);
+    if (prof->nameIds)
+	JS_HashTableDestroy(prof->nameIds);
+    for (i = 0; i < prof->nnames; i++)
+	JS_smprintf_free(prof->names[i]);
+    free(prof->names);
+    free(prof->samples);
+    free(prof);
+}
+
+char *
+js_DescribeFrame(JSStackFrame *fp)
+{
+    JSFunction *fun;
+    JSScript *script;
+    const char *name;
+
+    script = fp->script;
+    fun = fp->fun;
+    if (fun && (!script || fun->script == script))
+	name = fun->atom ? ATOM_BYTES(fun->atom) : "anonymous";
+    else
+	name = "(top-level)";
+    if (script) {
+	return JS_smprintf("%s (%s:%u)", name,
+			   script->filename ? script->filename : "<unknown>",
+			   script->lineno);
+    }
+    return JS_smprintf("%s (native)", name);
+}
+
+/*
+ * Map fp to a frame id, naming the frame the first time its script or native
+ * is seen.  Scripts are keyed by address, see js_ForgetProfiledScript, and
+ * frames with the same name share an id so that their samples fold together.
+ */
+static uint32
+GetFrameId(JSProfiler *prof, JSStackFrame *fp)
+{
+    const void *key;
+    JSFunction *fun;
+    JSScript *script;
+    JSHashNumber keyHash;
+    JSHashEntry **hep, *he, **nhep;
+    char *desc, **names;
+    uint32 id;
+
+    script = fp->script;
+    fun = fp->fun;
+    if (script)
+	key = script;
+    else if (fun && fun->call)
+	key = (const void *)fun->call;
+    else
+	return PROFILE_NO_FRAME;
+
+    keyHash = JS_HashPointer(key);
+    hep = JS_HashTableRawLookup(prof->frames, keyHash, key);
+    he = *hep;
+    if (he)
+	return (uint32)(jsword)he->value;
+
+    desc = js_DescribeFrame(fp);
+    if (!desc)
+	return PROFILE_NO_FRAME;
+    keyHash = JS_HashString(desc);
+    nhep = JS_HashTableRawLookup(prof->nameIds, keyHash, desc);
+    he = *nhep;
+    if (he) {
+	JS_smprintf_free(desc);
+	id = (uint32)(jsword)he->value;
+	if (!JS_HashTableRawAdd(prof->frames, hep, JS_HashPointer(key), key,
+				(void *)(jsword)id)) {
+	    return PROFILE_NO_FRAME;
+	}
+	return id;
+    }
+    if ((prof->nnames & (prof->nnames - 1)) == 0) {
+	names = (char **) realloc(prof->names,
+				  (prof->nnames ? 2 * prof->nnames : 1) *
+				  sizeof(char *));
+	if (!names) {
+	    JS_smprintf_free(desc);
+	    return PROFILE_NO_FRAME;
+	}
+	prof->names = names;
+    }
+    id = prof->nnames;
+    if (!JS_HashTableRawAdd(prof->nameIds, nhep, keyHash, desc,
+			    (void *)(jsword)id)) {
+	JS_smprintf_free(desc);
+	return PROFILE_NO_FRAME;
+    }
+    prof->names[prof->nnames++] = desc;
+    if (!JS_HashTableRawAdd(prof->frames, hep, JS_HashPointer(key), key,
+			    (void *)(jsword)id)) {
+	return PROFILE_NO_FRAME;
+    }
+    return id;
+}
+
+/*
+ * Fold the buffered samples into prof->stacks, reversing each record so that
+ * stacks read from the outermost frame in, and empty the buffer.
+ */
+static JSBool
+FoldSamples(JSProfiler *prof)
+{
+    uint32 *rec, *end, *key, n, i;
+    uint32 stack[1 + PROFILE_MAX_DEPTH];
+    JSHashNumber keyHash;
+    JSHashEntry **hep, *he;
+    JSBool ok;
+
+    ok = JS_TRUE;
+    rec = prof->samples;
+    end = rec + prof->length;
+    for (; rec < end; rec += 1 + n) {
+	n = rec[0];
+	stack[0] = n;
+	for (i = 1; i <= n; i++)
+	    stack[i] = rec[1 + n - i];
+	keyHash = HashStack(stack);
+	hep = JS_HashTableRawLookup(prof->stacks, keyHash, stack);
+	he = *hep;
+	if (he) {
+	    he->value = (void *)((jsword)he->value + 1);
+	    continue;
+	}
+	key = (uint32 *) malloc((1 + n) * sizeof(uint32));
+	if (!key) {
+	    prof->ndropped++;
+	    ok = JS_FALSE;
+	    continue;
+	}
+	memcpy(key, stack, (1 + n) * sizeof(uint32));
+	if (!JS_HashTableRawAdd(prof->stacks, hep, keyHash, key,
+				(void *)(jsword)1)) {
+	    free(key);
+	    prof->ndropped++;
+	    ok = JS_FALSE;
+	}
+    }
+    prof->length = 0;
+    return ok;
+}
+
+static void
+RecordSample(JSContext *cx, JSProfiler *prof)
+{
+    uint32 *rec, n, id;
+    JSStackFrame *fp;
+
+    if (prof->length + 1 + PROFILE_MAX_DEPTH > PROFILE_BUFFER_WORDS)
+	FoldSamples(prof);
+    rec = prof->samples + prof->length;
+    n = 0;
+    for (fp = cx->fp; fp && n < PROFILE_MAX_DEPTH; fp = fp->down) {
+	id = GetFrameId(prof, fp);
+	if (id != PROFILE_NO_FRAME)
+	    rec[1 + n++] = id;
+    }
+    if (n == 0) {
+	prof->ndropped++;
+	return;
+    }
+    rec[0] = n;
+    prof->length += 1 + n;
+    prof->nsamples++;
+}
+
+static JSTrapStatus
+ProfileInterrupt(JSContext *cx, JSScript *script, jsbytecode *pc, jsval *rval,
+		 void *closure)
+{
+    JSRuntime *rt;
+    JSProfiler *prof;
+    JSTrapHandler handler;
+
+    rt = cx->runtime;
+    JS_LOCK_RUNTIME(rt);
+    prof = rt->profiler;
+    handler = prof->userHandler;
+    rt->interruptHandler = handler;
+    if (prof->running)
+	RecordSample(cx, prof);
+    JS_UNLOCK_RUNTIME(rt);
+    if (!handler)
+	return JSTRAP_CONTINUE;
+    return handler(cx, script, pc, rval, closure);
+}
+
+static void
+StopProfiler(JSRuntime *rt)
+{
+    JSProfiler *prof;
+
+    prof = rt->profiler;
+    if (!prof || !prof->running)
+	return;
+#ifdef XP_UNIX
+    profiledRuntime = NULL;
+    setitimer(ITIMER_PROF, &prof->oldTimer, NULL);
+    sigaction(SIGPROF, &prof->oldAction, NULL);
+#endif
+    JS_LOCK_RUNTIME(rt);
+    prof->running = JS_FALSE;
+    if (rt->interruptHandler == ProfileInterrupt)
+	rt->interruptHandler = prof->userHandler;
+    JS_UNLOCK_RUNTIME(rt);
+}
+
+static void
+FinishProfiler(JSRuntime *rt)
+{
+    JSProfiler *prof;
+
+    prof = rt->profiler;
+    if (!prof)
+	return;
+    StopProfiler(rt);
+    rt->profiler = NULL;
+    DestroyProfiler(prof);
+}
+
+JS_PUBLIC_API(JSBool)
+JS_StartProfiling(JSContext *cx, uint32 usec)
+{
+    JSRuntime *rt;
+    JSProfiler *prof;
+#ifdef XP_UNIX
+    struct sigaction action;
+    struct itimerval timer;
+#endif
+
+    rt = cx->runtime;
+#ifdef XP_UNIX
+    if (profiledRuntime && profiledRuntime != rt) {
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_PROFILE);
+	return JS_FALSE;
+    }
+    FinishProfiler(rt);
+
+    prof = (JSProfiler *) calloc(1, sizeof(JSProfiler));
+    if (!prof)
+	goto out_of_memory;
+    prof->samples = (uint32 *) malloc(PROFILE_BUFFER_WORDS * sizeof(uint32));
+    prof->frames = JS_NewHashTable(64, JS_HashPointer, JS_CompareValues,
+				   JS_CompareValues, NULL, NULL);
+    prof->nameIds = JS_NewHashTable(64, JS_HashString, JS_CompareCStrings,
+				    JS_CompareValues, NULL, NULL);
+    prof->stacks = JS_NewHashTable(64, HashStack, CompareStacks,
+				   JS_CompareValues, NULL, NULL);
+    if (!prof->samples || !prof->frames || !prof->nameIds || !prof->stacks) {
+	DestroyProfiler(prof);
+	goto out_of_memory;
+    }
+    prof->userHandler = rt->interruptHandler;
+    prof->running = JS_TRUE;
+    rt->profiler = prof;
+
+    memset(&action, 0, sizeof action);
+    action.sa_handler = ProfileSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (usec == 0)
+	usec = PROFILE_DEFAULT_USEC;
+    timer.it_interval.tv_sec = usec / 1000000;
+    timer.it_interval.tv_usec = usec % 1000000;
+    timer.it_value = timer.it_interval;
+    profiledRuntime = rt;
+    if (sigaction(SIGPROF, &action, &prof->oldAction) != 0 ||
+	setitimer(ITIMER_PROF, &timer, &prof->oldTimer) != 0) {
+	profiledRuntime = NULL;
+	prof->running = JS_FALSE;
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_PROFILE);
+	return JS_FALSE;
+    }
+    return JS_TRUE;
+
+out_of_memory:
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+#else
+    JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_PROFILE);
+    return JS_FALSE;
+#endif
+}
+
+JS_PUBLIC_API(void)
+JS_StopProfiling(JSContext *cx)
+{
+    StopProfiler(cx->runtime);
+}
+
+typedef struct DumpArgs {
+    JSProfiler  *prof;
+    FILE        *fp;
+} DumpArgs;
+
+static intN
+DumpStack(JSHashEntry *he, intN i, void *arg)
+{
+    DumpArgs *args;
+    const uint32 *stack;
+    uint32 j;
+
+    args = (DumpArgs *)arg;
+    stack = (const uint32 *)he->key;
+    for (j = 1; j <= stack[0]; j++) {
+	fprintf(args->fp, "%s%s",
+		(j == 1) ? "" : ";", args->prof->names[stack[j]]);
+    }
+    fprintf(args->fp, " %lu\n", (unsigned long)(jsword)he->value);
+    return HT_ENUMERATE_NEXT;
+}
+
+JS_PUBLIC_API(JSBool)
+JS_DumpProfile(JSContext *cx, FILE *fp)
+{
+    JSRuntime *rt;
+    JSProfiler *prof;
+    JSBool ok;
+    DumpArgs args;
+
+    rt = cx->runtime;
+    prof = rt->profiler;
+    if (!prof)
+	return JS_TRUE;
+    JS_LOCK_RUNTIME(rt);
+    ok = FoldSamples(prof);
+    args.prof = prof;
+    args.fp = fp;
+    JS_HashTableEnumerateEntries(prof->stacks, DumpStack, &args);
+    JS_UNLOCK_RUNTIME(rt);
+    if (!ok)
+	JS_ReportOutOfMemory(cx);
+    return ok;
+}
+
+void
+js_ForgetProfiledScript(JSRuntime *rt, JSScript *script)
+{
+    JSProfiler *prof;
+
+    JS_LOCK_RUNTIME(rt);
+    prof = rt->profiler;
+    if (prof)
+	JS_HashTableRemove(prof->frames, script);
+    JS_UNLOCK_RUNTIME(rt);
+}
+
+/*
+ * Coverage state.  Counted scripts are registered in the scripts table until
+ * destroyed, and their pcCounts are credited to their file's lines (and then
+ * cleared) when they die or coverage is dumped.  A file's lines vector holds
+ * one plus the hit count of each line that has code, and 0 for other lines.
+ *
+ * Counts are first summed per source, so that the copies of one eval or
+ * Function body re-created by a loop add up.  A line's count is then the
+ * greatest of its sources' counts, so that a line shared by several scripts
+ * (a function and the script defining it, say) is not counted once per
+ * script.  Sources are told apart by where they start, their length and a
+ * hash of their source notes, which traps do not patch.
+ */
+typedef struct JSCoverageSource {
+    JSHashNumber        hash;           /* of lineno, length and notes */
+    uintN               lineno;         /* first line */
+    uint32              length;         /* bytecode length */
+    uint32              nnotes;         /* source notes length */
+    uintN               extent;         /* number of lines in counts */
+    uint32              counts[1];      /* line counts, biased like lines */
+} JSCoverageSource;
+
+typedef struct JSCoverageFile {
+    uint32              *lines;
+    uint32              nlines;
+    JSHashTable         *sources;       /* JSCoverageSource set */
+} JSCoverageFile;
+
+struct JSCoverage {
+    JSHashTable         *scripts;       /* live counted scripts */
+    JSHashTable         *files;         /* filename => JSCoverageFile */
+};
+
+static JSHashNumber
+HashCoverageSource(const void *key)
+{
+    return ((const JSCoverageSource *)key)->hash;
+}
+
+static intN
+CompareCoverageSources(const void *v1, const void *v2)
+{
+    const JSCoverageSource *src1, *src2;
+
+    src1 = (const JSCoverageSource *)v1;
+    src2 = (const JSCoverageSource *)v2;
+    return src1->hash == src2->hash &&
+	   src1->lineno == src2->lineno &&
+	   src1->length == src2->length &&
+	   src1->nnotes == src2->nnotes;
+}
+
+static JSCoverageFile *
+GetCoverageFile(JSCoverage *cov, const char *filename)
+{
+    JSHashNumber keyHash;
+    JSHashEntry **hep, *he;
+    JSCoverageFile *file;
+    char *name;
+
+    keyHash = JS_HashString(filename);
+    hep = JS_HashTableRawLookup(cov->files, keyHash, filename);
+    he = *hep;
+    if (he)
+	return (JSCoverageFile *)he->value;
+    file = (JSCoverageFile *) calloc(1, sizeof(JSCoverageFile));
+    name = (char *) malloc(strlen(filename) + 1);
+    if (!file || !name)
+	goto bad;
+    file->sources = JS_NewHashTable(16, HashCoverageSource,
+				    CompareCoverageSources, JS_CompareValues,
+				    NULL, NULL);
+    if (!file->sources)
+	goto bad;
+    strcpy(name, filename);
+    if (!JS_HashTableRawAdd(cov->files, hep, keyHash, name, file))
+	goto bad;
+    return file;
+
+bad:
+    free(name);
+    if (file && file->sources)
+	JS_HashTableDestroy(file->sources);
+    free(file);
+    return NULL;
+}
+
+/* Find or add the source in file of which script is a copy. */
+static JSCoverageSource *
+GetCoverageSource(JSCoverageFile *file, JSScript *script, uintN extent)
+{
+    JSCoverageSource key, *src;
+    jssrcnote *sn;
+    uint32 n;
+    JSHashNumber h;
+    JSHashEntry **hep;
+
+    key.lineno = script->lineno;
+    key.length = script->length;
+    for (sn = script->notes; !SN_IS_TERMINATOR(sn); sn = SN_NEXT(sn))
+	continue;
+    key.nnotes = PTRDIFF(sn, script->notes, jssrcnote);
+    h = (JSHashNumber)key.lineno ^ ((JSHashNumber)key.length << 16);
+    for (n = 0; n < key.nnotes; n++)
+	h = (h >> 28) ^ (h << 4) ^ script->notes[n];
+    key.hash = h;
+    hep = JS_HashTableRawLookup(file->sources, h, &key);
+    if (*hep)
+	return (JSCoverageSource *)(*hep)->value;
+    src = (JSCoverageSource *)
+	calloc(1, sizeof(JSCoverageSource) + (extent - 1) * sizeof(uint32));
+    if (!src)
+	return NULL;
+    src->hash = h;
+    src->lineno = key.lineno;
+    src->length = key.length;
+    src->nnotes = key.nnotes;
+    src->extent = extent;
+    if (!JS_HashTableRawAdd(file->sources, hep, h, src, src)) {
+	free(src);
+	return NULL;
+    }
+    return src;
+}
+
+/*
+ * Credit script's counts to the lines of its source, walking its notes along
+ * with its bytecode as js_PCToLineNumber does for a single pc, and then to the
+ * lines of its file.  Each line gets the greatest count of its ops, so that a
+ * statement that runs n times reads n however many ops it compiled to.
+ */
+static JSBool
+FoldScriptCounts(JSCoverage *cov, JSScript *script)
+{
+    JSCoverageFile *file;
+    JSCoverageSource *src;
+    jssrcnote *sn;
+    ptrdiff_t offset, snoffset;
+    uintN lineno, extent, i;
+    uint32 *maxima, *lines, count;
+
+    file = GetCoverageFile(cov, script->filename ? script->filename : "");
+    if (!file)
+	return JS_FALSE;
+    extent = js_GetScriptLineExtent(script);
+    if (extent == 0)
+	return JS_TRUE;
+    if (script->lineno + extent > file->nlines) {
+	lines = (uint32 *) realloc(file->lines,
+				   (script->lineno + extent) * sizeof(uint32));
+	if (!lines)
+	    return JS_FALSE;
+	memset(lines + file->nlines, 0,
+	       (script->lineno + extent - file->nlines) * sizeof(uint32));
+	file->lines = lines;
+	file->nlines = script->lineno + extent;
+    }
+    src = GetCoverageSource(file, script, extent);
+    if (!src)
+	return JS_FALSE;
+    maxima = (uint32 *) calloc(extent, sizeof(uint32));
+    if (!maxima)
+	return JS_FALSE;
+
+    sn = script->notes;
+    snoffset = SN_DELTA(sn);
+    lineno = script->lineno;
+    for (offset = 0; (uint32)offset < script->length; offset++) {
+	while (!SN_IS_TERMINATOR(sn) && snoffset <= offset) {
+	    if (SN_TYPE(sn) == SRC_SETLINE)
+		lineno = (uintN) js_GetSrcNoteOffset(sn, 0);
+	    else if (SN_TYPE(sn) == SRC_NEWLINE)
+		lineno++;
+	    sn = SN_NEXT(sn);
+	    snoffset += SN_DELTA(sn);
+	}
+	i = lineno - script->lineno;
+	if (i >= extent)
+	    continue;
+
+	/* Bias by one so that lines with code but no hits read non-zero. */
+	count = 1 + script->pcCounts[offset];
+	if (count > maxima[i])
+	    maxima[i] = count;
+    }
+
+    lines = file->lines + script->lineno;
+    for (i = 0; i < extent; i++) {
+	if (maxima[i] == 0)
+	    continue;
+	if (src->counts[i] == 0)
+	    src->counts[i] = 1;
+	src->counts[i] += maxima[i] - 1;
+	if (src->counts[i] > lines[i])
+	    lines[i] = src->counts[i];
+    }
+    free(maxima);
+    memset(script->pcCounts, 0, script->length * sizeof(uint32));
+    return JS_TRUE;
+}
+
+JSBool
+js_InitScriptCoverage(JSContext *cx, JSScript *script)
+{
+    JSRuntime *rt;
+    JSBool ok;
+
+    if (!script->notes)
+	return JS_TRUE;
+    script->pcCounts = (uint32 *)
+	JS_malloc(cx, script->length * sizeof(uint32));
+    if (!script->pcCounts)
+	return JS_FALSE;
+    memset(script->pcCounts, 0, script->length * sizeof(uint32));
+    rt = cx->runtime;
+    JS_LOCK_RUNTIME(rt);
+    ok = (JS_HashTableAdd(rt->coverage->scripts, script, script) != NULL);
+    JS_UNLOCK_RUNTIME(rt);
+    if (!ok) {
+	JS_free(cx, script->pcCounts);
+	script->pcCounts = NULL;
+	JS_ReportOutOfMemory(cx);
+    }
+    return ok;
+}
+
+void
+js_FinishScriptCoverage(JSContext *cx, JSScript *script)
+{
+    JSRuntime *rt;
+
+    rt = cx->runtime;
+    JS_LOCK_RUNTIME(rt);
+    FoldScriptCounts(rt->coverage, script);
+    JS_HashTableRemove(rt->coverage->scripts, script);
+    JS_UNLOCK_RUNTIME(rt);
+    JS_free(cx, script->pcCounts);
+    script->pcCounts = NULL;
+}
+
+static intN
+FreeCoverageSource(JSHashEntry *he, intN i, void *arg)
+{
+    free(he->value);
+    return HT_ENUMERATE_NEXT;
+}
+
+static intN
+FreeCoverageFile(JSHashEntry *he, intN i, void *arg)
+{
+    JSCoverageFile *file;
+
+    file = (JSCoverageFile *)he->value;
+    JS_HashTableEnumerateEntries(file->sources, FreeCoverageSource, NULL);
+    JS_HashTableDestroy(file->sources);
+    free(file->lines);
+    free(file);
+    free((void *)he->key);
+    return HT_ENUMERATE_NEXT;
+}
+
+static void
+DestroyCoverage(JSCoverage *cov)
+{
+    if (cov->files) {
+	JS_HashTableEnumerateEntries(cov->files, FreeCoverageFile, NULL);
+	JS_HashTableDestroy(cov->files);
+    }
+    if (cov->scripts)
+	JS_HashTableDestroy(cov->scripts);
+    free(cov);
+}
+
+JS_PUBLIC_API(JSBool)
+JS_SetCoverage(JSContext *cx, JSBool enable)
+{
+    JSRuntime *rt;
+    JSCoverage *cov;
+
+    rt = cx->runtime;
+    if (enable && !rt->coverage) {
+	cov = (JSCoverage *) calloc(1, sizeof(JSCoverage));
+	if (!cov)
+	    goto out_of_memory;
+	cov->scripts = JS_NewHashTable(64, JS_HashPointer, JS_CompareValues,
+				       JS_CompareValues, NULL, NULL);
+	cov->files = JS_NewHashTable(16, JS_HashString, JS_CompareCStrings,
+				     JS_CompareValues, NULL, NULL);
+	if (!cov->scripts || !cov->files) {
+	    DestroyCoverage(cov);
+	    goto out_of_memory;
+	}
+	rt->coverage = cov;
+    }
+    rt->coverageEnabled = enable;
+    return JS_TRUE;
+
+out_of_memory:
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+}
+
+typedef struct FoldArgs {
+    JSCoverage  *cov;
+    JSBool      ok;
+} FoldArgs;
+
+static intN
+FoldLiveScript(JSHashEntry *he, intN i, void *arg)
+{
+    FoldArgs *args;
+
+    args = (FoldArgs *)arg;
+    if (!FoldScriptCounts(args->cov, (JSScript *)he->key)) {
+	args->ok = JS_FALSE;
+	return HT_ENUMERATE_STOP;
+    }
+    return HT_ENUMERATE_NEXT;
+}
+
+static intN
+DumpCoverageFile(JSHashEntry *he, intN i, void *arg)
+{
+    FILE *fp;
+    JSCoverageFile *file;
+    uint32 line, nfound, nhit;
+
+    fp = (FILE *)arg;
+    file = (JSCoverageFile *)he->value;
+    fprintf(fp, "TN:\nSF:%s\n", (const char *)he->key);
+    nfound = nhit = 0;
+    for (line = 0; line < file->nlines; line++) {
+	if (file->lines[line] == 0)
+	    continue;
+	fprintf(fp, "DA:%lu,%lu\n",
+		(unsigned long)line, (unsigned long)(file->lines[line] - 1));
+	nfound++;
+	if (file->lines[line] > 1)
+	    nhit++;
+    }
+    fprintf(fp, "LF:%lu\nLH:%lu\nend_of_record\n",
+	    (unsigned long)nfound, (unsigned long)nhit);
+    return HT_ENUMERATE_NEXT;
+}
+
+JS_PUBLIC_API(JSBool)
+JS_DumpCoverage(JSContext *cx, FILE *fp)
+{
+    JSRuntime *rt;
+    JSCoverage *cov;
+    FoldArgs args;
+
+    rt = cx->runtime;
+    cov = rt->coverage;
+    if (!cov)
+	return JS_TRUE;
+    JS_LOCK_RUNTIME(rt);
+    args.cov = cov;
+    args.ok = JS_TRUE;
+    JS_HashTableEnumerateEntries(cov->scripts, FoldLiveScript, &args);
+    if (!args.ok) {
+	JS_UNLOCK_RUNTIME(rt);
+	JS_ReportOutOfMemory(cx);
+	return JS_FALSE;
+    }
+    JS_HashTableEnumerateEntries(cov->files, DumpCoverageFile, fp);
+    JS_UNLOCK_RUNTIME(rt);
+    return JS_TRUE;
+}
+
+JS_PUBLIC_API(JSBool)
+JS_SetCallProfiling(JSContext *cx, JSBool enable)
+{
+    return js_SetCallProfiling(cx, enable);
+}
+
+JS_PUBLIC_API(JSCallProfileEntry *)
+JS_GetCallProfile(JSContext *cx, uint32 *countp)
+{
+    return js_GetCallProfile(cx->runtime, countp);
+}
+
+static int
+CompareSelfTimes(const void *v1, const void *v2)
+{
+    const JSCallProfileEntry *e1, *e2;
+
+    e1 = *(const JSCallProfileEntry **)v1;
+    e2 = *(const JSCallProfileEntry **)v2;
+    if (e1->selfTime != e2->selfTime)
+	return (e1->selfTime < e2->selfTime) ? 1 : -1;
+    return strcmp(e1->name, e2->name);
+}
+
+JS_PUBLIC_API(JSBool)
+JS_DumpCallProfile(JSContext *cx, FILE *fp)
+{
+    JSRuntime *rt;
+    JSCallProfileEntry *entries, **sorted;
+    uint32 i, n;
+
+    rt = cx->runtime;
+    JS_LOCK_RUNTIME(rt);
+    entries = js_GetCallProfile(rt, &n);
+    sorted = NULL;
+    if (n != 0) {
+	sorted = (JSCallProfileEntry **) malloc(n * sizeof *sorted);
+	if (!sorted) {
+	    JS_UNLOCK_RUNTIME(rt);
+	    JS_ReportOutOfMemory(cx);
+	    return JS_FALSE;
+	}
+	for (i = 0; i < n; i++)
+	    sorted[i] = &entries[i];
+	qsort(sorted, n, sizeof *sorted, CompareSelfTimes);
+    }
+    fprintf(fp, "%10s %12s %12s %10s %10s  %s\n",
+	    "calls", "total ms", "self ms", "allocs", "self", "function");
+    for (i = 0; i < n; i++) {
+	fprintf(fp, "%10lu %12.3f %12.3f %10lu %10lu  %s\n",
+		(unsigned long)sorted[i]->calls,
+		sorted[i]->totalTime / 1e6, sorted[i]->selfTime / 1e6,
+		(unsigned long)sorted[i]->totalAllocs,
+		(unsigned long)sorted[i]->selfAllocs,
+		sorted[i]->name);
+    }
+    JS_UNLOCK_RUNTIME(rt);
+    free(sorted);
+    return JS_TRUE;
+}
+
+JS_PUBLIC_API(JSBool)
+JS_SetHeapProfiling(JSContext *cx, uint32 rate)
+{
+    return js_SetHeapProfiling(cx, rate);
+}
+
+JS_PUBLIC_API(JSBool)
+JS_DumpHeapProfile(JSContext *cx, FILE *fp)
+{
+    return js_DumpHeapProfile(cx, fp);
+}
+
+void
+js_FinishDebugState(JSRuntime *rt)
+{
+    FinishProfiler(rt);
+    js_FinishCallProfile(rt);
+    if (rt->trapTable) {
+	JS_HashTableDestroy(rt->trapTable);
+	JS_HashTableDestroy(rt->scriptTrapTable);
+	rt->trapTable = rt->scriptTrapTable = NULL;
+    }
+    if (rt->watchPointTable) {
+	JS_HashTableDestroy(rt->watchPointTable);
+	rt->watchPointTable = NULL;
+    }
+    if (rt->coverage) {
+	DestroyCoverage(rt->coverage);
+	rt->coverage = NULL;
+    }
+}
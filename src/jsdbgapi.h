@@ -30,6 +30,32 @@ JS_BEGIN_EXTERN_C
 extern void
 js_PatchOpcode(JSContext *cx, JSScript *script, jsbytecode *pc, JSOp op);
 
+/* Sampling profiler housekeeping for jsscript.c. */
+extern void
+js_ForgetProfiledScript(JSRuntime *rt, JSScript *script);
+
+/* Coverage counting for scripts compiled while rt->coverageEnabled. */
+extern JSBool
+js_InitScriptCoverage(JSContext *cx, JSScript *script);
+
+extern void
+js_FinishScriptCoverage(JSContext *cx, JSScript *script);
+
+/*
+ * Return a new "name (file:line)" or "name (native)" string naming fp's
+ * function or script for profiles, to be freed with JS_smprintf_free.
+ */
+extern char *
+js_DescribeFrame(JSStackFrame *fp);
+
+/* Free the runtime's trap, watchpoint, profiling and coverage state. */
+extern void
+js_FinishDebugState(JSRuntime *rt);
+
+/*
+ * Traps patch the script's bytecode, so they can't be set in a script whose
+ * bytecode is borrowed from a shared, possibly read-only XDR image.
+ */
 extern JS_PUBLIC_API(JSBool)
 JS_SetTrap(JSContext *cx, JSScript *script, jsbytecode *pc,
 	   JSTrapHandler handler, void *closure);
@@ -249,6 +275,88 @@ JS_SetThrowHook(JSRuntime *rt, JSTrapHandler hook, void *closure);
 extern JS_PUBLIC_API(JSBool)
 JS_SetDebugErrorHook(JSRuntime *rt, JSDebugErrorHook hook, void *closure);
 
+/************************************************************************/
+
+/*
+ * Statistical profiler.  Every usec microseconds of process CPU time (0 for
+ * the default of 1000), the next op interpreted in cx's runtime records the
+ * script and native frames on its context's stack.  JS_DumpProfile writes the
+ * samples taken since the last JS_StartProfiling as folded stacks, one
+ * "outer;...;inner count" line per distinct stack, for flamegraph.pl and
+ * similar tools.  Only one runtime at a time can be profiled, and only XP_UNIX
+ * builds have the SIGPROF timer that drives sampling.
+ */
+extern JS_PUBLIC_API(JSBool)
+JS_StartProfiling(JSContext *cx, uint32 usec);
+
+extern JS_PUBLIC_API(void)
+JS_StopProfiling(JSContext *cx);
+
+extern JS_PUBLIC_API(JSBool)
+JS_DumpProfile(JSContext *cx, FILE *fp);
+
+/************************************************************************/
+
+/*
+ * Bytecode coverage.  While enabled, newly compiled scripts count how often
+ * each of their ops runs.  The counts are credited to source lines when a
+ * script is destroyed or coverage is dumped, so dead scripts still report.
+ * JS_DumpCoverage writes all counts taken so far in lcov tracefile format
+ * (SF, DA, LF and LH records), the hit count of a line being the most times
+ * any one of its ops ran.  The ops a superinstruction fuses after its first
+ * are not counted, but as they belong to its statement, the line still is.
+ * Disabling stops counting in new scripts only.
+ */
+extern JS_PUBLIC_API(JSBool)
+JS_SetCoverage(JSContext *cx, JSBool enable);
+
+extern JS_PUBLIC_API(JSBool)
+JS_DumpCoverage(JSContext *cx, FILE *fp);
+
+/************************************************************************/
+
+/*
+ * Call profile.  While enabled, every call of a script or native function
+ * and every script execution in cx's runtime is counted and timed under its
+ * js_DescribeFrame name.  Times are in nanoseconds of elapsed time, total
+ * time including callees and self time excluding the callees that were also
+ * profiled; allocations count GC things made by js_AllocGCThing likewise.
+ * A recursive function's total time and allocations are counted once for
+ * each of its active frames.
+ *
+ * Enabling discards the profile taken so far.  JS_GetCallProfile returns the
+ * entries taken so far in the runtime's storage, which remains valid only
+ * until the next profiled call or change in profiling.  JS_DumpCallProfile
+ * writes them as a table sorted by decreasing self time.  See jsprvtd.h for
+ * JSCallProfileEntry.
+ */
+extern JS_PUBLIC_API(JSBool)
+JS_SetCallProfiling(JSContext *cx, JSBool enable);
+
+extern JS_PUBLIC_API(JSCallProfileEntry *)
+JS_GetCallProfile(JSContext *cx, uint32 *countp);
+
+extern JS_PUBLIC_API(JSBool)
+JS_DumpCallProfile(JSContext *cx, FILE *fp);
+
+/************************************************************************/
+
+/*
+ * Heap profile.  With a non-zero rate, one in rate GC things allocated in
+ * cx's runtime, at random intervals, is sampled along with its type and the
+ * file and line of the innermost script running.  Each GC then counts the
+ * sampled things and bytes that survive by allocation site, and all things
+ * and bytes that survive by JSClass (or by type, for strings and numbers).
+ * A thing's bytes include its slots or characters.  JS_DumpHeapProfile runs
+ * a GC and writes both tables, scaling the site counts by rate.  A rate of 0
+ * stops profiling and discards the profile; a new rate starts a new one.
+ */
+extern JS_PUBLIC_API(JSBool)
+JS_SetHeapProfiling(JSContext *cx, uint32 rate);
+
+extern JS_PUBLIC_API(JSBool)
+JS_DumpHeapProfile(JSContext *cx, FILE *fp);
+
 JS_END_EXTERN_C
 
 #endif /* jsdbgapi_h___ */
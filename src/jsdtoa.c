@@ -27,6 +27,7 @@
 
 #ifdef JS_THREADSAFE
 #include "prlock.h"
+#include "prthread.h"
 #endif
 
 /****************************************************************
@@ -354,26 +355,60 @@ struct Bigint {
 
 typedef struct Bigint Bigint;
 
+#ifdef JS_THREADSAFE
+/*
+ * Each thread keeps its own freelists, so conversions on different threads
+ * don't serialize on a lock.  They are freed when the thread exits.
+ */
+static PRUintn freelist_index;
+
+static void PR_CALLBACK FreeFreelist(void *priv)
+{
+	Bigint **freelist = (Bigint **)priv;
+	Bigint *v;
+	int32 k;
+
+	for (k = 0; k <= Kmax; k++) {
+		while ((v = freelist[k]) != NULL) {
+			freelist[k] = v->next;
+			free(v);
+		}
+	}
+	free(freelist);
+}
+
+/* Return this thread's freelists, or null if they can't be made. */
+static Bigint **GetFreelist(void)
+{
+	Bigint **freelist;
+
+	freelist = (Bigint **)PR_GetThreadPrivate(freelist_index);
+	if (!freelist) {
+		freelist = (Bigint **)calloc(Kmax+1, sizeof(Bigint *));
+		if (freelist &&
+		    PR_SetThreadPrivate(freelist_index, freelist) != PR_SUCCESS) {
+			free(freelist);
+			freelist = NULL;
+		}
+	}
+	return freelist;
+}
+#else
 static Bigint *freelist[Kmax+1];
 
-#ifdef JS_THREADSAFE
-static PRLock *freelist_lock;
+#define GetFreelist()	freelist
 #endif
 
 static Bigint *Balloc(int32 k)
 {
 	int32 x;
-	Bigint *rv;
+	Bigint *rv, **list;
 
-#ifdef JS_THREADSAFE
-	PR_Lock(freelist_lock);
-#endif
-	if ((rv = freelist[k]) != NULL) {
-		freelist[k] = rv->next;
+	rv = NULL;
+	list = GetFreelist();
+	if (list && (rv = list[k]) != NULL) {
+		list[k] = rv->next;
 	}
-#ifdef JS_THREADSAFE
-	PR_Unlock(freelist_lock);
-#endif
 	if (rv == NULL) {
 		x = 1 << k;
 		rv = (Bigint *)MALLOC(sizeof(Bigint) + (x-1)*sizeof(Long));
@@ -386,15 +421,16 @@ static Bigint *Balloc(int32 k)
 
 static void Bfree (Bigint *v)
 {
+	Bigint **list;
+
 	if (v) {
-#ifdef JS_THREADSAFE
-		PR_Lock(freelist_lock);
-#endif
-		v->next = freelist[v->k];
-		freelist[v->k] = v;
-#ifdef JS_THREADSAFE
-		PR_Unlock(freelist_lock);
-#endif
+		list = GetFreelist();
+		if (list) {
+			v->next = list[v->k];
+			list[v->k] = v;
+		} else {
+			free(v);
+		}
 	}
 }
 
@@ -1189,7 +1225,7 @@ static JSBool initialized = JS_FALSE;
 /* hacked replica of nspr _PR_InitDtoa */
 static void InitDtoa(void)
 {
-	freelist_lock = PR_NewLock();
+	PR_NewThreadPrivateIndex(&freelist_index, FreeFreelist);
         p5s_lock = PR_NewLock();
 	initialized = JS_TRUE;
 }
@@ -1923,7 +1959,7 @@ JS_dtoa(double d, int mode, int ndigits,
 	double d2, ds, eps;
 	char *s, *s0;
 	Bigint *result = 0;
-	static int32 result_k;
+	int32 result_k;
 	JSBool retval;
         size_t strsize;
 
@@ -2513,6 +2549,359 @@ ret1:
 	return retval;
 }
 
+/*
+ * Grisu3 below needs native 64-bit integers.  JSUint64 is a struct unless
+ * JS_HAVE_LONG_LONG is defined, which Unix builds don't do, so use long
+ * where it is wide enough.
+ */
+#ifndef ULLong
+#if JS_BYTES_PER_LONG == 8
+#define ULLong unsigned long
+#elif defined(JS_HAVE_LONG_LONG)
+#define ULLong JSUint64
+#endif
+#endif
+
+#if defined(IEEE_Arith) && defined(ULLong)
+/*
+ * Grisu3 shortest conversion, after Florian Loitsch, "Printing Floating-Point
+ * Numbers Quickly and Accurately with Integers" (PLDI 2010).  It uses 64-bit
+ * integer arithmetic on a "do-it-yourself" floating point value f * 2^e, and
+ * either produces the shortest digit string that reads back as the input,
+ * closest to it, or reports that it can't be sure.  That happens for about
+ * one double in 200, and JS_cnvtf then falls back to JS_dtoa.
+ */
+typedef struct DiyFp {
+	ULLong f;
+	int32 e;
+} DiyFp;
+
+#define DIY_SIGNIFICAND_SIZE	64
+#define DIY_HIDDEN_BIT		((ULLong)1 << 52)
+#define DIY_DENORMAL_EXPONENT	(-Bias - P + 2)
+#define DIY_MIN_TARGET_EXPONENT	(-60)
+#define DIY_MAX_TARGET_EXPONENT	(-32)
+
+/*
+ * Normalized 64-bit approximations of 10^k, k = -348, -340, ..., 340, each
+ * rounded to nearest, with their binary exponents.
+ */
+#define CACHED_POWERS_OFFSET	348
+#define CACHED_POWERS_STEP	8
+
+static CONST struct {
+	ULong fhi, flo;
+	int16 e, k;
+} cached_powers[] = {
+	{0xfa8fd5a0, 0x081c0288, -1220, -348},
+	{0xbaaee17f, 0xa23ebf76, -1193, -340},
+	{0x8b16fb20, 0x3055ac76, -1166, -332},
+	{0xcf42894a, 0x5dce35ea, -1140, -324},
+	{0x9a6bb0aa, 0x55653b2d, -1113, -316},
+	{0xe61acf03, 0x3d1a45df, -1087, -308},
+	{0xab70fe17, 0xc79ac6ca, -1060, -300},
+	{0xff77b1fc, 0xbebcdc4f, -1034, -292},
+	{0xbe5691ef, 0x416bd60c, -1007, -284},
+	{0x8dd01fad, 0x907ffc3c, -980, -276},
+	{0xd3515c28, 0x31559a83, -954, -268},
+	{0x9d71ac8f, 0xada6c9b5, -927, -260},
+	{0xea9c2277, 0x23ee8bcb, -901, -252},
+	{0xaecc4991, 0x4078536d, -874, -244},
+	{0x823c1279, 0x5db6ce57, -847, -236},
+	{0xc2109436, 0x4dfb5637, -821, -228},
+	{0x9096ea6f, 0x3848984f, -794, -220},
+	{0xd77485cb, 0x25823ac7, -768, -212},
+	{0xa086cfcd, 0x97bf97f4, -741, -204},
+	{0xef340a98, 0x172aace5, -715, -196},
+	{0xb23867fb, 0x2a35b28e, -688, -188},
+	{0x84c8d4df, 0xd2c63f3b, -661, -180},
+	{0xc5dd4427, 0x1ad3cdba, -635, -172},
+	{0x936b9fce, 0xbb25c996, -608, -164},
+	{0xdbac6c24, 0x7d62a584, -582, -156},
+	{0xa3ab6658, 0x0d5fdaf6, -555, -148},
+	{0xf3e2f893, 0xdec3f126, -529, -140},
+	{0xb5b5ada8, 0xaaff80b8, -502, -132},
+	{0x87625f05, 0x6c7c4a8b, -475, -124},
+	{0xc9bcff60, 0x34c13053, -449, -116},
+	{0x964e858c, 0x91ba2655, -422, -108},
+	{0xdff97724, 0x70297ebd, -396, -100},
+	{0xa6dfbd9f, 0xb8e5b88f, -369, -92},
+	{0xf8a95fcf, 0x88747d94, -343, -84},
+	{0xb9447093, 0x8fa89bcf, -316, -76},
+	{0x8a08f0f8, 0xbf0f156b, -289, -68},
+	{0xcdb02555, 0x653131b6, -263, -60},
+	{0x993fe2c6, 0xd07b7fac, -236, -52},
+	{0xe45c10c4, 0x2a2b3b06, -210, -44},
+	{0xaa242499, 0x697392d3, -183, -36},
+	{0xfd87b5f2, 0x8300ca0e, -157, -28},
+	{0xbce50864, 0x92111aeb, -130, -20},
+	{0x8cbccc09, 0x6f5088cc, -103, -12},
+	{0xd1b71758, 0xe219652c, -77, -4},
+	{0x9c400000, 0x00000000, -50, 4},
+	{0xe8d4a510, 0x00000000, -24, 12},
+	{0xad78ebc5, 0xac620000, 3, 20},
+	{0x813f3978, 0xf8940984, 30, 28},
+	{0xc097ce7b, 0xc90715b3, 56, 36},
+	{0x8f7e32ce, 0x7bea5c70, 83, 44},
+	{0xd5d238a4, 0xabe98068, 109, 52},
+	{0x9f4f2726, 0x179a2245, 136, 60},
+	{0xed63a231, 0xd4c4fb27, 162, 68},
+	{0xb0de6538, 0x8cc8ada8, 189, 76},
+	{0x83c7088e, 0x1aab65db, 216, 84},
+	{0xc45d1df9, 0x42711d9a, 242, 92},
+	{0x924d692c, 0xa61be758, 269, 100},
+	{0xda01ee64, 0x1a708dea, 295, 108},
+	{0xa26da399, 0x9aef774a, 322, 116},
+	{0xf209787b, 0xb47d6b85, 348, 124},
+	{0xb454e4a1, 0x79dd1877, 375, 132},
+	{0x865b8692, 0x5b9bc5c2, 402, 140},
+	{0xc83553c5, 0xc8965d3d, 428, 148},
+	{0x952ab45c, 0xfa97a0b3, 455, 156},
+	{0xde469fbd, 0x99a05fe3, 481, 164},
+	{0xa59bc234, 0xdb398c25, 508, 172},
+	{0xf6c69a72, 0xa3989f5c, 534, 180},
+	{0xb7dcbf53, 0x54e9bece, 561, 188},
+	{0x88fcf317, 0xf22241e2, 588, 196},
+	{0xcc20ce9b, 0xd35c78a5, 614, 204},
+	{0x98165af3, 0x7b2153df, 641, 212},
+	{0xe2a0b5dc, 0x971f303a, 667, 220},
+	{0xa8d9d153, 0x5ce3b396, 694, 228},
+	{0xfb9b7cd9, 0xa4a7443c, 720, 236},
+	{0xbb764c4c, 0xa7a44410, 747, 244},
+	{0x8bab8eef, 0xb6409c1a, 774, 252},
+	{0xd01fef10, 0xa657842c, 800, 260},
+	{0x9b10a4e5, 0xe9913129, 827, 268},
+	{0xe7109bfb, 0xa19c0c9d, 853, 276},
+	{0xac2820d9, 0x623bf429, 880, 284},
+	{0x80444b5e, 0x7aa7cf85, 907, 292},
+	{0xbf21e440, 0x03acdd2d, 933, 300},
+	{0x8e679c2f, 0x5e44ff8f, 960, 308},
+	{0xd433179d, 0x9c8cb841, 986, 316},
+	{0x9e19db92, 0xb4e31ba9, 1013, 324},
+	{0xeb96bf6e, 0xbadf77d9, 1039, 332},
+	{0xaf87023b, 0x9bf0ee6b, 1066, 340},
+};
+
+static CONST ULong small_powers_of_ten[] = {
+	0, 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000
+};
+
+static DiyFp
+diy_multiply(DiyFp a, DiyFp b)
+{
+	/* The high 64 bits of the 128-bit product, rounded. */
+	ULLong m32, a_hi, a_lo, b_hi, b_lo, ac, bc, ad, bd, tmp;
+	DiyFp r;
+
+	m32 = 0xffffffff;
+	a_hi = a.f >> 32;
+	a_lo = a.f & m32;
+	b_hi = b.f >> 32;
+	b_lo = b.f & m32;
+	ac = a_hi * b_hi;
+	bc = a_lo * b_hi;
+	ad = a_hi * b_lo;
+	bd = a_lo * b_lo;
+	tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+	tmp += (ULLong)1 << 31;
+	r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+	r.e = a.e + b.e + 64;
+	return r;
+}
+
+static DiyFp
+diy_normalize(DiyFp a)
+{
+	while (!(a.f & ((ULLong)0xffc00000 << 32))) {
+		a.f <<= 10;
+		a.e -= 10;
+	}
+	while (!(a.f & ((ULLong)1 << 63))) {
+		a.f <<= 1;
+		a.e--;
+	}
+	return a;
+}
+
+/* Split the positive finite double d into w and its normalized boundaries. */
+static void
+diy_boundaries(double d, DiyFp *w, DiyFp *minus, DiyFp *plus)
+{
+	int32 biased;
+	DiyFp v;
+
+	biased = (word0(d) & Exp_mask) >> Exp_shift;
+	v.f = ((ULLong)(word0(d) & Frac_mask) << 32) | word1(d);
+	if (biased) {
+		v.f += DIY_HIDDEN_BIT;
+		v.e = biased - Bias - P + 1;
+	} else {
+		v.e = DIY_DENORMAL_EXPONENT;
+	}
+
+	plus->f = (v.f << 1) + 1;
+	plus->e = v.e - 1;
+	*plus = diy_normalize(*plus);
+
+	/* The lower boundary is closer when d is a power of two. */
+	if (v.f == DIY_HIDDEN_BIT && biased > 1) {
+		minus->f = (v.f << 2) - 1;
+		minus->e = v.e - 2;
+	} else {
+		minus->f = (v.f << 1) - 1;
+		minus->e = v.e - 1;
+	}
+	minus->f <<= minus->e - plus->e;
+	minus->e = plus->e;
+
+	*w = diy_normalize(v);
+}
+
+/*
+ * Find the cached power c_mk = 10^-k such that the exponent of w * c_mk,
+ * where w has binary exponent e, is in the target range.
+ */
+static DiyFp
+diy_cached_power(int32 e, int32 *mk)
+{
+	int32 min_exponent, k, index;
+	DiyFp c;
+
+	min_exponent = DIY_MIN_TARGET_EXPONENT - (e + DIY_SIGNIFICAND_SIZE);
+	k = (int32)ceil((min_exponent + DIY_SIGNIFICAND_SIZE - 1) *
+			0.30102999566398114);
+	index = (CACHED_POWERS_OFFSET + k - 1) / CACHED_POWERS_STEP + 1;
+	c.f = ((ULLong)cached_powers[index].fhi << 32) |
+	      cached_powers[index].flo;
+	c.e = cached_powers[index].e;
+	*mk = cached_powers[index].k;
+	return c;
+}
+
+/*
+ * Nudge the last digit of buf towards w while that keeps it inside the safe
+ * interval, then say whether the result is certainly the closest shortest.
+ */
+static JSBool
+grisu_round_weed(char *buf, int32 len, ULLong distance_too_high_w,
+		 ULLong unsafe_interval, ULLong rest, ULLong ten_kappa,
+		 ULLong unit)
+{
+	ULLong small_distance, big_distance;
+
+	small_distance = distance_too_high_w - unit;
+	big_distance = distance_too_high_w + unit;
+	while (rest < small_distance &&
+	       unsafe_interval - rest >= ten_kappa &&
+	       (rest + ten_kappa < small_distance ||
+		small_distance - rest >= rest + ten_kappa - small_distance)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+	if (rest < big_distance &&
+	    unsafe_interval - rest >= ten_kappa &&
+	    (rest + ten_kappa < big_distance ||
+	     big_distance - rest > rest + ten_kappa - big_distance)) {
+		return JS_FALSE;
+	}
+	return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+/*
+ * Generate the digits of w, scaled with its boundaries into the target
+ * exponent range, stopping as soon as they identify w.
+ */
+static JSBool
+grisu_digit_gen(DiyFp low, DiyFp w, DiyFp high, char *buf, int32 *lenp,
+		int32 *kappap)
+{
+	ULLong unit, too_low, too_high, unsafe_interval, one, fractionals,
+		rest;
+	ULong integrals, divisor, digit;
+	int32 shift, bits, kappa, len;
+
+	unit = 1;
+	too_low = low.f - unit;
+	too_high = high.f + unit;
+	unsafe_interval = too_high - too_low;
+	shift = -w.e;
+	one = (ULLong)1 << shift;
+	integrals = (ULong)(too_high >> shift);
+	fractionals = too_high & (one - 1);
+
+	/* Find the largest power of ten not above integrals. */
+	bits = DIY_SIGNIFICAND_SIZE - shift;
+	kappa = ((bits + 1) * 1233 >> 12) + 1;
+	if (integrals < small_powers_of_ten[kappa])
+		kappa--;
+	divisor = small_powers_of_ten[kappa];
+
+	len = 0;
+	while (kappa > 0) {
+		digit = integrals / divisor;
+		buf[len++] = (char)('0' + digit);
+		integrals %= divisor;
+		kappa--;
+		rest = ((ULLong)integrals << shift) + fractionals;
+		if (rest < unsafe_interval) {
+			*lenp = len;
+			*kappap = kappa;
+			return grisu_round_weed(buf, len, too_high - w.f,
+						unsafe_interval, rest,
+						(ULLong)divisor << shift,
+						unit);
+		}
+		divisor /= 10;
+	}
+
+	for (;;) {
+		fractionals *= 10;
+		unit *= 10;
+		unsafe_interval *= 10;
+		digit = (ULong)(fractionals >> shift);
+		buf[len++] = (char)('0' + digit);
+		fractionals &= one - 1;
+		kappa--;
+		if (fractionals < unsafe_interval) {
+			*lenp = len;
+			*kappap = kappa;
+			return grisu_round_weed(buf, len,
+						(too_high - w.f) * unit,
+						unsafe_interval, fractionals,
+						one, unit);
+		}
+	}
+}
+
+/*
+ * Store the shortest digits of the positive finite double d, NUL-terminated,
+ * in buf (which needs room for 18 chars), and its decimal point position in
+ * *decpt, as JS_dtoa mode 0 does.  Return false when they can't be found
+ * with 64-bit arithmetic.
+ */
+static JSBool
+grisu3(double d, char *buf, int *decpt)
+{
+	DiyFp w, minus, plus, c_mk;
+	int32 mk, len, kappa;
+
+	diy_boundaries(d, &w, &minus, &plus);
+	c_mk = diy_cached_power(w.e, &mk);
+	if (!grisu_digit_gen(diy_multiply(minus, c_mk), diy_multiply(w, c_mk),
+			     diy_multiply(plus, c_mk), buf, &len, &kappa)) {
+		return JS_FALSE;
+	}
+	while (len > 1 && buf[len - 1] == '0') {
+		len--;
+		kappa++;
+	}
+	buf[len] = '\0';
+	*decpt = len + kappa - mk;
+	return JS_TRUE;
+}
+#endif /* IEEE_Arith && ULLong */
+
 /*
 ** conversion routines for floating point
 ** prcsn - number of digits of precision to generate floating
@@ -2531,6 +2920,23 @@ JS_cnvtf(char *buf,int bufsz, int prcsn,double fval)
     char *num, *nump;
     char *bufp = buf;
     char *endnum;
+#if defined(IEEE_Arith) && defined(ULLong)
+    double absval;
+    char digits[18];
+
+	/* Finite nonzero doubles rarely need JS_dtoa's Bigints. */
+	num = NULL;
+	absval = fval;
+	word0(absval) &= ~Sign_bit;
+	if ((word0(absval) & Exp_mask) != Exp_mask &&
+	    (word0(absval) | word1(absval)) != 0 &&
+	    grisu3(absval, digits, &decpt)) {
+		sign = (word0(fval) & Sign_bit) != 0;
+		numdigits = strlen(digits);
+		nump = digits;
+		goto convert;
+	}
+#endif
 
 	/* If anything fails, we store an empty string in 'buf' */
 	num = (char *)MALLOC(bufsz);
@@ -2547,6 +2953,10 @@ JS_cnvtf(char *buf,int bufsz, int prcsn,double fval)
 	numdigits = endnum - num;
 	nump = num;
 
+#if defined(IEEE_Arith) && defined(ULLong)
+convert:
+#endif
+
 	/* If negative and not signed zero and not a NaN, print leading "-". */
 	if (sign &&
 	    !(word0(fval) == Sign_bit && word1(fval) == 0) &&
@@ -2607,5 +3017,6 @@ JS_cnvtf(char *buf,int bufsz, int prcsn,double fval)
 	    *bufp++ = '\0';
 	}
 done:
-        free(num);
+        if (num)
+            free(num);
 }
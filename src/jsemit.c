@@ -359,6 +359,34 @@ EmitAtomOp(JSContext *cx, JSParseNode *pn, JSOp op, JSCodeGenerator *cg)
     return JS_TRUE;
 }
 
+/*
+ * Outside any with statement (a catch block pushes one too), the object a name
+ * is bound in is usually the head of the scope chain, so use the name ops that
+ * cache where their names were found.  A with statement around an enclosing
+ * function or eval is not visible here, but the cached ops check the scope
+ * chain head at run time and just miss in that case.
+ */
+static JSOp
+CachedNameOp(JSCodeGenerator *cg, JSOp op)
+{
+    JSStmtInfo *stmt;
+
+    for (stmt = cg->treeContext.topStmt; stmt; stmt = stmt->down) {
+	if (stmt->type == STMT_WITH)
+	    return op;
+    }
+    switch (op) {
+      case JSOP_NAME:
+	return JSOP_GNAME;
+      case JSOP_BINDNAME:
+	return JSOP_BINDGNAME;
+      case JSOP_SETNAME2:
+	return JSOP_SETGNAME;
+      default:
+	return op;
+    }
+}
+
 static JSBool
 EmitPropOp(JSContext *cx, JSParseNode *pn, JSOp op, JSCodeGenerator *cg)
 {
@@ -558,20 +586,25 @@ js_EmitTree(JSContext *cx, JSCodeGenerator *cg, JSParseNode *pn)
       {
 	JSFunction *fun;
 
-	/* Fold constants and generate code for the function's body. */
-	pn2 = pn->pn_body;
-	if (!js_FoldConstants(cx, pn2))
-	    return JS_FALSE;
-	if (!js_InitCodeGenerator(cx, &cg2, cg->filename,
-				  pn->pn_pos.begin.lineno,
-				  cg->principals)) {
-	    return JS_FALSE;
-	}
-	cg2.treeContext.tryCount = pn->pn_tryCount;
+	/*
+	 * Fold constants and generate code for the function's body, unless
+	 * the parser deferred that until the function is first called.
+	 */
 	fun = pn->pn_fun;
-	if (!js_EmitFunctionBody(cx, &cg2, pn2, fun))
-	    return JS_FALSE;
-	js_FinishCodeGenerator(cx, &cg2);
+	if (!fun->lazy) {
+	    pn2 = pn->pn_body;
+	    if (!js_FoldConstants(cx, pn2))
+		return JS_FALSE;
+	    if (!js_InitCodeGenerator(cx, &cg2, cg->filename,
+				      pn->pn_pos.begin.lineno,
+				      cg->principals)) {
+		return JS_FALSE;
+	    }
+	    cg2.treeContext.tryCount = pn->pn_tryCount;
+	    if (!js_EmitFunctionBody(cx, &cg2, pn2, fun))
+		return JS_FALSE;
+	    js_FinishCodeGenerator(cx, &cg2);
+	}
 
 	/* Make the function object a literal in the outer script's pool. */
 	atom = js_AtomizeObject(cx, fun->object, 0);
@@ -1550,8 +1583,11 @@ js_EmitTree(JSContext *cx, JSCodeGenerator *cg, JSParseNode *pn)
 		atomIndex = ale->index;
 	    }
 	    if (pn2->pn_expr) {
-		if (op == JSOP_SETNAME2)
-		    EMIT_ATOM_INDEX_OP(JSOP_BINDNAME, atomIndex);
+		if (op == JSOP_SETNAME2) {
+		    EMIT_ATOM_INDEX_OP(CachedNameOp(cg, JSOP_BINDNAME),
+				       atomIndex);
+		    op = CachedNameOp(cg, op);
+		}
 		if (!js_EmitTree(cx, cg, pn2->pn_expr))
 		    return JS_FALSE;
 	    }
@@ -1686,7 +1722,7 @@ js_EmitTree(JSContext *cx, JSCodeGenerator *cg, JSParseNode *pn)
 		if (!ale)
 		    return JS_FALSE;
 		atomIndex = ale->index;
-		EMIT_ATOM_INDEX_OP(JSOP_BINDNAME, atomIndex);
+		EMIT_ATOM_INDEX_OP(CachedNameOp(cg, JSOP_BINDNAME), atomIndex);
 	    }
 	    break;
 	  case TOK_DOT:
@@ -1758,6 +1794,8 @@ js_EmitTree(JSContext *cx, JSCodeGenerator *cg, JSParseNode *pn)
 	/* Finally, emit the specialized assignment bytecode. */
 	switch (pn2->pn_type) {
 	  case TOK_NAME:
+	    EMIT_ATOM_INDEX_OP(CachedNameOp(cg, pn2->pn_op), atomIndex);
+	    break;
 	  case TOK_DOT:
 	    EMIT_ATOM_INDEX_OP(pn2->pn_op, atomIndex);
 	    break;
@@ -2170,7 +2208,10 @@ js_EmitTree(JSContext *cx, JSCodeGenerator *cg, JSParseNode *pn)
 	 * Token types for STRING and OBJECT have corresponding bytecode ops
 	 * in pn_op and emit the same format as NAME, so they share this code.
 	 */
-	return EmitAtomOp(cx, pn, pn->pn_op, cg);
+	op = pn->pn_op;
+	if (pn->pn_type == TOK_NAME)
+	    op = CachedNameOp(cg, op);
+	return EmitAtomOp(cx, pn, op, cg);
 
       case TOK_NUMBER:
 	return EmitNumberOp(cx, pn->pn_dval, cg);
@@ -2537,3 +2578,133 @@ js_FinishTakingTryNotes(JSContext *cx, JSCodeGenerator *cg, JSTryNote **tryp)
     *tryp = final;
     return JS_TRUE;
 }
+
+/*
+ * Return the length of the instruction at pc, including the jump tables that
+ * follow a switch op.
+ */
+static ptrdiff_t
+InstructionLength(jsbytecode *pc)
+{
+    JSCodeSpec *cs;
+    jsbytecode *pc2, *end;
+    jsint low, high;
+    uintN npairs;
+
+    cs = &js_CodeSpec[(JSOp)*pc];
+    switch (cs->format & JOF_TYPEMASK) {
+      case JOF_TABLESWITCH:
+	pc2 = pc;
+	end = pc + GET_JUMP_OFFSET(pc2);
+	pc2 += JUMP_OFFSET_LEN;
+	low = GET_JUMP_OFFSET(pc2);
+	pc2 += JUMP_OFFSET_LEN;
+	high = GET_JUMP_OFFSET(pc2);
+	pc2 += JUMP_OFFSET_LEN;
+	if (pc2 + 1 < end)
+	    pc2 += (high - low + 1) * JUMP_OFFSET_LEN;
+	return 1 + PTRDIFF(pc2, pc, jsbytecode);
+
+      case JOF_LOOKUPSWITCH:
+	pc2 = pc + JUMP_OFFSET_LEN;
+	npairs = (uintN) GET_ATOM_INDEX(pc2);
+	pc2 += ATOM_INDEX_LEN;
+	pc2 += npairs * (ATOM_INDEX_LEN + JUMP_OFFSET_LEN);
+	return 1 + PTRDIFF(pc2, pc, jsbytecode);
+
+      default:
+	return cs->length;
+    }
+}
+
+void
+js_FuseBytecode(JSCodeGenerator *cg)
+{
+    jsbytecode *pc, *end, *pc2;
+    JSOp op, op2, fused;
+    ptrdiff_t len;
+
+    pc = cg->base;
+    end = cg->next;
+    while (pc < end) {
+	op = (JSOp)*pc;
+	len = InstructionLength(pc);
+	pc2 = pc + len;
+	if (pc2 >= end) {
+	    pc = pc2;
+	    continue;
+	}
+
+	/*
+	 * Pick the superinstruction, if any, that starts at pc.  Sequences
+	 * fused here must match the ones the interpreter checks for.
+	 */
+	op2 = (JSOp)*pc2;
+	fused = JSOP_NOP;
+	switch (op) {
+	  case JSOP_LT:
+	  case JSOP_LE:
+	  case JSOP_GT:
+	  case JSOP_GE:
+	    if (op2 == JSOP_IFEQ)
+		fused = (JSOp)(JSOP_LTIFEQ + (op - JSOP_LT));
+	    break;
+
+	  case JSOP_GETVAR:
+	    if (op2 == JSOP_ONE &&
+		end - pc2 >= 6 &&
+		pc2[1] == JSOP_ADD &&
+		pc2[2] == JSOP_SETVAR &&
+		GET_VARNO(pc2 + 2) == GET_VARNO(pc) &&
+		(pc2[5] == JSOP_POP || pc2[5] == JSOP_POPV)) {
+		fused = JSOP_GETVARADD1;
+		pc2 += 6;
+		break;
+	    }
+	    if (op2 == JSOP_GETVAR)
+		fused = JSOP_GETVARVAR;
+	    else if (op2 == JSOP_GETARG)
+		fused = JSOP_GETVARARG;
+	    break;
+
+	  case JSOP_INCVAR:
+	  case JSOP_VARINC:
+	    if (op2 == JSOP_POP)
+		fused = (op == JSOP_INCVAR) ? JSOP_INCVARPOP : JSOP_VARINCPOP;
+	    break;
+
+	  case JSOP_POP:
+	    if (op2 == JSOP_GOTO)
+		fused = JSOP_POPGOTO;
+	    break;
+
+	  case JSOP_NAME:
+	    if (op2 == JSOP_GETPROP)
+		fused = JSOP_NAMEGETPROP;
+	    break;
+
+	  case JSOP_GNAME:
+	    if (op2 == JSOP_GETPROP)
+		fused = JSOP_GNAMEGETPROP;
+	    break;
+
+	  default:;
+	}
+
+	if (fused == JSOP_NOP) {
+	    pc += len;
+	    continue;
+	}
+
+	/*
+	 * Overwrite only the first op, and resume after the whole sequence so
+	 * that no op inside it starts another superinstruction.
+	 */
+	JS_ASSERT(JOF_UNFUSE(js_CodeSpec[fused].format) == op);
+	JS_ASSERT(js_CodeSpec[fused].length == len);
+	*pc = (jsbytecode)fused;
+	if (fused != JSOP_GETVARADD1)
+	    pc2 += js_CodeSpec[op2].length;
+	pc = pc2;
+    }
+}
@@ -364,6 +364,14 @@ js_NewTryNote(JSContext *cx, JSCodeGenerator *cg, ptrdiff_t start,
 extern JSBool
 js_FinishTakingTryNotes(JSContext *cx, JSCodeGenerator *cg, JSTryNote **tryp);
 
+/*
+ * Rewrite common op sequences in cg's bytecode as superinstructions (see the
+ * end of jsopcode.tbl).  Only the opcode byte starting each sequence changes,
+ * so offsets, source notes and try notes taken from cg remain valid.
+ */
+extern void
+js_FuseBytecode(JSCodeGenerator *cg);
+
 JS_END_EXTERN_C
 
 #endif /* jsemit_h___ */
@@ -50,6 +50,10 @@
 /* NSPR dependencies */
 #include "prio.h"
 #include "prerror.h"
+#include "prlock.h"
+#include "prcvar.h"
+#include "prthread.h"
+#include "prinit.h"
 #include "jsutil.h" /* Added by JSIFY */
 
 /* bunch of defines. */
@@ -69,6 +73,9 @@
 #define FIRST_ARGUMENT_WRITEALL_NOT_ARRAY_ERROR "writeAll expects an array for argument."
 #define CANNOT_OPEN_FILE_ERROR "Cannot open file"
 #define FIRST_ARGUMENT_CONSTRUCTOR_NOT_STRING_ERROR "The argument to the File constructor must be a string."
+#define EACHLINE_EXPECTS_ONE_ARG_ERROR "file.eachLine expects one argument."
+#define ASYNC_EXPECTS_CALLBACK_ERROR "Asynchronous file operations expect a callback function."
+#define CANNOT_START_IO_ERROR "Cannot start the file I/O threads."
 
 #define SPECIAL_FILE_STRING "Special File"
 #define CURRENTDIR_PROPERTY "currentDir"
@@ -666,253 +673,573 @@ typedef struct JSFile {
     PRFileDesc* handle; /* the handle for the file, if opened.  */
     FILE*       nativehandle; /* native handle, for stuff NSPR doesn't do. */
     JSBool      opened;
-    JSString    *linebuffer; /* temp buffer used by readln. */
+    jschar      *linebuffer; /* line assembled by readln, reused across calls */
+    size_t      linesize;    /* number of chars allocated at linebuffer */
     int32       mode;   /* mode used to open the file: read, write, append, create, etc.. */
     int32       type;   /* Asciiz, utf, unicode */
-    char        byteBuffer[3]; /* bytes read in advance by JS_FileRead ( UTF8 encoding ) */
-    jsint         nbBytesInBuf; /* number of bytes stored in the buffer above */
-    jschar      charBuffer; /* character read in advance by readln ( mac files only ) */
-    JSBool      charBufferUsed; /* flag indicating if the buffer above is being used */
+    unsigned char *readbuf;  /* bytes read in advance of the decoder */
+    int32       readpos;     /* offset of the next byte to decode */
+    int32       readlen;     /* offset just past the last byte read */
+    PRFileMap   *map;        /* if non-null, readbuf maps the whole file */
     JSBool      randomAccess; /* can the file be randomly accessed? false for stdin, and 
                                  UTF-encoded files. */
     JSBool      autoflush;   /* should we force a flush for each line break? */
 } JSFile;
 
+/*
+ * Blocking I/O runs outside the caller's request, so a slow read or write
+ * doesn't hold up a GC wanted by another thread.  Nothing between the two
+ * calls may touch a GC-thing.  A nested request can't be suspended, so the
+ * I/O then runs inside it as before.
+ */
+static JSBool
+beginBlockingIO(JSContext *cx)
+{
+#ifdef JS_THREADSAFE
+    if (cx->requestDepth==1) {
+        JS_SuspendRequest(cx);
+        return JS_TRUE;
+    }
+#endif
+    return JS_FALSE;
+}
+
+static void
+endBlockingIO(JSContext *cx, JSBool suspended)
+{
+#ifdef JS_THREADSAFE
+    if (suspended)
+        JS_ResumeRequest(cx);
+#endif
+}
+
+#define COPY_BUFFER_SIZE    65536
+
+/*
+ * Copy the file at from to the path to, a block at a time.  This touches no
+ * JS state, so it may run outside a request or on an I/O thread.  Return 0,
+ * or a message saying what failed.
+ */
+static const char *
+copyFile(const char *from, const char *to)
+{
+    PRFileDesc *in, *out;
+    char *buffer;
+    int32 count;
+    const char *error;
+
+    in=PR_Open(from, PR_RDONLY, 0644);
+    if (!in)
+        return CANNOT_ACCESS_FILE_INFO_ERROR;
+    out=PR_Open(to, PR_WRONLY|PR_CREATE_FILE|PR_TRUNCATE, 0644);
+    if (!out) {
+        PR_Close(in);
+        return COPY_WRITE_ERROR;
+    }
+    buffer=malloc(COPY_BUFFER_SIZE);
+    error=buffer ? NULL : COPY_READ_ERROR;
+    while (!error) {
+        count=PR_Read(in, buffer, COPY_BUFFER_SIZE);
+        if (count<=0) {
+            if (count<0)
+                error=COPY_READ_ERROR;
+            break;
+        }
+        if (PR_Write(out, buffer, count)!=count)
+            error=COPY_WRITE_ERROR;
+    }
+    free(buffer);
+    PR_Close(in);
+    PR_Close(out);
+    return error;
+}
+
+/*
+ * Read the names in the directory at path into a malloc'd vector of malloc'd
+ * strings, skipping "." and "..".  Like copyFile, this touches no JS state.
+ * Return false if the directory can't be read or memory runs out.
+ */
+static JSBool
+readDirectory(const char *path, char ***namesp, size_t *countp)
+{
+    PRDir *dir;
+    PRDirEntry *entry;
+    char **names, **tmp, *name;
+    size_t count, size;
+
+    dir=PR_OpenDir(path);
+    if (!dir)
+        return JS_FALSE;
+    names=NULL;
+    count=size=0;
+    while ((entry=PR_ReadDir(dir,PR_SKIP_BOTH))!=NULL) {
+        if (count==size) {
+            size=size ? 2*size : 16;
+            tmp=realloc(names, size*sizeof *names);
+            if (!tmp)
+                goto bad;
+            names=tmp;
+        }
+        name=malloc(strlen(entry->name)+1);
+        if (!name)
+            goto bad;
+        strcpy(name, entry->name);
+        names[count++]=name;
+    }
+    PR_CloseDir(dir);
+    *namesp=names;
+    *countp=count;
+    return JS_TRUE;
+
+bad:
+    PR_CloseDir(dir);
+    while (count>0)
+        free(names[--count]);
+    free(names);
+    return JS_FALSE;
+}
+
+static void
+freeDirectory(char **names, size_t count)
+{
+    while (count>0)
+        free(names[--count]);
+    free(names);
+}
 
+#define READ_BUFFER_SIZE    8192        /* bytes per buffered read */
+#define MAP_MIN_SIZE        (1L << 20)  /* map read-only files this big */
+#define LINE_BUFFER_SIZE    128         /* initial readln buffer length */
+
+/* Discard any bytes read in advance, leaving the handle where it is. */
 static void 
 resetBuffers(JSFile * f) 
 {
-    f->charBufferUsed=JS_FALSE;
-    f->nbBytesInBuf=0;
+    f->readpos=f->readlen=0;
 }
 
+/*
+ * Drop a mapping made by file_open.  The read buffer pointed into it, so
+ * reset the buffer too.
+ */
+static void
+unmapFile(JSFile *f)
+{
+    if (f->map) {
+        PR_MemUnmap(f->readbuf, f->readlen);
+        PR_CloseFileMap(f->map);
+        f->map=NULL;
+        f->readbuf=NULL;
+    }
+    resetBuffers(f);
+}
 
-/* Helper function. buffered version of PR_Read. used by JS_FileRead */
+/*
+ * Return the offset of the next byte to decode, which lags the handle's
+ * position by the bytes buffered but not yet decoded.
+ */
 static int32
-JS_BufferedRead(JSFile * f,char*buf, int32 len) 
-{
-    int32 count=0;
-    while (f->nbBytesInBuf>0&&len>0) {
-        buf[0]=f->byteBuffer[0];
-        f->byteBuffer[0]=f->byteBuffer[1];
-        f->byteBuffer[1]=f->byteBuffer[2];
-        f->nbBytesInBuf--;
-        len--;
-        buf+=1;
-        count++;
+JS_FileTell(JSFile *f)
+{
+    int32 pos;
+
+    if (f->map)
+        return f->readpos;
+    if (f->handle) {
+        pos=PR_Seek(f->handle, 0, PR_SEEK_CUR);
+    } else {
+        pos=ftell(f->nativehandle);
     }
-    if (len>0) {
+    if (pos<0)
+        return pos;
+    return pos-(f->readlen-f->readpos);
+}
+
+/*
+ * Give back the bytes buffered but not yet decoded before writing or
+ * seeking, so the handle is positioned where the reader left off.
+ */
+static void
+dropReadBuffer(JSFile *f)
+{
+    int32 ahead;
+
+    if (f->map)
+        return;
+    ahead=f->readlen-f->readpos;
+    if (ahead>0) {
         if (f->handle) {
-            count+=PR_Read(f->handle, buf, len);
+            PR_Seek(f->handle, -ahead, PR_SEEK_CUR);
         } else {
-            count+=fread(buf, 1, len, f->nativehandle);
+            fseek(f->nativehandle, -ahead, SEEK_CUR);
         }
     }
-    return count;
+    resetBuffers(f);
 }
 
-
+/*
+ * Make sure at least want bytes are buffered at f->readbuf + f->readpos,
+ * reading another block if there are fewer.  Return the number of bytes
+ * buffered, which is less than want only at the end of the file, or -1 if
+ * out of memory.
+ */
 static int32
-JS_FileRead(JSContext *cx, JSFile * f,jschar*buf,int32 len,int32 mode) 
+fillBuffer(JSContext *cx, JSFile *f, int32 want)
 {
-    unsigned char*aux;
-    int32 count,i;
-    jsint remainder;
-    unsigned char utfbuf[3];
+    int32 avail, count;
+    int c;
+    JSBool suspended;
+
+    avail=f->readlen-f->readpos;
+    if (avail>=want || f->map)
+        return avail;
+
+    if (!f->readbuf) {
+        f->readbuf=(unsigned char*)JS_malloc(cx, READ_BUFFER_SIZE);
+        if (!f->readbuf)
+            return -1;
+    }
+    if (f->readpos>0) {
+        memmove(f->readbuf, f->readbuf+f->readpos, avail);
+        f->readpos=0;
+        f->readlen=avail;
+    }
 
-    if (f->charBufferUsed) {
-      buf[0]=f->charBuffer;
-      buf++;
-      len--;
-      f->charBufferUsed=JS_FALSE;
+    suspended=beginBlockingIO(cx);
+    if (f->handle) {
+        count=PR_Read(f->handle, f->readbuf+avail, READ_BUFFER_SIZE-avail);
+        if (count>0)
+            f->readlen+=count;
+    } else {
+        /*
+         * Native handles are stdio streams, often interactive, so read no
+         * further than the next newline rather than block for a full block.
+         * Stdio buffers underneath, so this is not a call per byte.
+         */
+        while (f->readlen<READ_BUFFER_SIZE &&
+               (c=getc(f->nativehandle))!=EOF) {
+            f->readbuf[f->readlen++]=(unsigned char)c;
+            if (c=='\n')
+                break;
+        }
     }
+    endBlockingIO(cx, suspended);
+    return f->readlen-f->readpos;
+}
+
+/* A word with the high bit of each of its bytes set. */
+#define HIGH_BITS       (((jsuword)-1 / 0xff) * 0x80)
+
+/*
+ * Decode the bytes buffered from f->readbuf + f->readpos up to limit into at
+ * most len chars at buf, and advance f->readpos past the bytes used.  Return
+ * the number of chars stored.  Decoding stops short of a UTF-8 sequence cut
+ * off by limit, or of half a UCS-2 char, leaving it for the next call.
+ */
+static int32
+decodeBuffered(JSFile *f, unsigned char *limit, jschar *buf, int32 len,
+               int32 mode)
+{
+    unsigned char *p;
+    jschar *cp, *end;
+    jsuword word;
+    int32 n;
+    int16 i;
+
+    p=f->readbuf+f->readpos;
+    cp=buf;
+    end=buf+len;
 
     switch (mode) {
     case ASCII:
-      aux = (unsigned char*)JS_malloc(cx, len);
-      if (!aux) {
-        JS_ReportOutOfMemory(cx);
-        return 0;
-      }
-      count=JS_BufferedRead(f,aux,len);
-      if (count==-1) {
-        JS_free(cx, aux);
-        return 0;
-      }
-      for (i=0;i<len;i++) {
-        buf[i]=(jschar)aux[i];
-      }
-      JS_free(cx, aux);
-      break;
+        n=JS_MIN(limit-p, end-cp);
+        while (--n>=0)
+            *cp++=(jschar)*p++;
+        break;
     case UTF8:
-        remainder = 0;
-        for (count=0;count<len;count++) {
-            i=JS_BufferedRead(f,utfbuf+remainder,3-remainder);
-            if (i<=0) {
-                return count;
+        while (p<limit && cp<end) {
+            if (*p<0x80) {
+                /*
+                 * Most text is runs of ASCII: test a word at a time for any
+                 * high bit, then widen each byte.
+                 */
+                while (limit-p>=(ptrdiff_t)sizeof word &&
+                       end-cp>=(ptrdiff_t)sizeof word) {
+                    memcpy(&word, p, sizeof word);
+                    if (word & HIGH_BITS)
+                        break;
+                    for (n=0; n<(int32)sizeof word; n++)
+                        cp[n]=(jschar)p[n];
+                    p+=sizeof word;
+                    cp+=sizeof word;
+                }
+                while (p<limit && cp<end && *p<0x80)
+                    *cp++=(jschar)*p++;
+                continue;
             }
-            i=utf8_to_ucs2_char(utfbuf, (int16)i, &buf[count] );
+            i=utf8_to_ucs2_char(p, (int16)JS_MIN(limit-p, 3), cp);
+            if (i==-2)
+                break;
             if (i<0) {
-                return count;
-            } else {
-                if (i==1) {
-                    utfbuf[0]=utfbuf[1];
-                    utfbuf[1]=utfbuf[2];
-                    remainder=2;
-                } else
-                if (i==2) {
-                    utfbuf[0]=utfbuf[2];
-                    remainder=1;
-                } else
-                if (i==3)
-                    remainder=0;
+                /* Not UTF-8: substitute the default char and resync. */
+                *cp=DEFAULT_CHAR;
+                i=1;
             }
+            cp++;
+            p+=i;
         }
-        while (remainder>0) {
-            f->byteBuffer[f->nbBytesInBuf]=utfbuf[0];
-            f->nbBytesInBuf++;
-            utfbuf[0]=utfbuf[1];
-            utfbuf[1]=utfbuf[2];
-            remainder--;
-        }
-      break;
+        break;
     case UCS2:
-      count=JS_BufferedRead(f,(char*)buf,len*2)>>1;
-      if (count==-1) {
-          return 0;
-      }
-      break;
+        n=JS_MIN((limit-p)/2, end-cp);
+        memcpy(cp, p, n*sizeof(jschar));
+        cp+=n;
+        p+=n*sizeof(jschar);
+        break;
     }
-    return count;
+    f->readpos=p-f->readbuf;
+    return cp-buf;
 }
 
 static int32
-JS_FileSkip(JSFile * f, int32 len, int32 mode) 
+JS_FileRead(JSContext *cx, JSFile * f,jschar*buf,int32 len,int32 mode) 
 {
-    int32 count,i;
-    jsint remainder;
-    unsigned char utfbuf[3];
-    jschar tmp;
+    int32 count,avail,want;
 
-    switch (mode) {
-    case ASCII:
-        if (f->handle) {
-            count=PR_Seek(f->handle, len, PR_SEEK_CUR);
-        } else {
-            count=fseek(f->nativehandle, len, SEEK_CUR);
+    count=0;
+    want=1;
+    while (count<len) {
+        avail=fillBuffer(cx, f, want);
+        if (avail<0) {
+            JS_ReportOutOfMemory(cx);
+            return count;
         }
-        break;
-    case UTF8:
-        remainder = 0;
-        for (count=0;count<len;count++) {
-            i=JS_BufferedRead(f,utfbuf+remainder,3-remainder);
-            if (i<=0) {
-                return 0;
+        if (avail<want) {
+            /*
+             * Drop a partial char at the end of the file, but leave a
+             * mapped file's window alone: it is the whole file.
+             */
+            if (!f->map)
+                resetBuffers(f);
+            break;
+        }
+        count+=decodeBuffered(f, f->readbuf+f->readlen, buf+count,
+                              len-count, mode);
+
+        /* Anything left over is a partial char: read until it's whole. */
+        want=f->readlen-f->readpos+1;
+    }
+    return count;
+}
+
+/*
+ * Read the next line into f->linebuffer, without its terminator.  A line
+ * ends with a newline, a carriage return, or both.  Set *lengthp to the
+ * line's length, or to -1 at the end of the file.  Return false only if out
+ * of memory.
+ */
+static JSBool
+JS_FileReadLine(JSContext *cx, JSFile *f, int32 *lengthp)
+{
+    int32 length,avail,want,unit,n;
+    unsigned char *p,*q,*limit;
+    jschar *buf;
+    size_t size;
+    JSBool more,cr;
+
+    if (!f->linebuffer) {
+        f->linebuffer=(jschar*)JS_malloc(cx, LINE_BUFFER_SIZE*sizeof(jschar));
+        if (!f->linebuffer)
+            return JS_FALSE;
+        f->linesize=LINE_BUFFER_SIZE;
+    }
+
+    unit=(f->type==UCS2) ? sizeof(jschar) : 1;
+    length=0;
+    more=JS_FALSE;
+    want=unit;
+    for (;;) {
+        avail=fillBuffer(cx, f, want);
+        if (avail<0)
+            goto out_of_memory;
+        if (avail<want) {
+            if (!f->map)
+                resetBuffers(f);
+            *lengthp=(length>0||more) ? length : -1;
+            return JS_TRUE;
+        }
+        more=JS_TRUE;
+
+        /*
+         * Find the end of the line among the buffered bytes.  Newline and
+         * carriage return bytes never occur within a UTF-8 sequence.
+         */
+        p=f->readbuf+f->readpos;
+        limit=f->readbuf+f->readlen;
+        cr=JS_FALSE;
+        if (unit==1) {
+            for (q=p; q<limit; q++) {
+                if (*q=='\n' || *q=='\r')
+                    break;
             }
-            i=utf8_to_ucs2_char(utfbuf, (int16)i, &tmp );
-            if (i<0) {
-                return 0;   
-            } else {
-                
-                if (i==1) {
-                    utfbuf[0]=utfbuf[1];
-                    utfbuf[1]=utfbuf[2];
-                    remainder=2;
-                } else
-                if (i==2) {
-                    utfbuf[0]=utfbuf[2];
-                    remainder=1;
-                } else
-                if (i==3)
-                    remainder=0;
+        } else {
+            jschar c;
+
+            for (q=p; limit-q>=unit; q+=unit) {
+                memcpy(&c, q, sizeof c);
+                if (c=='\n' || c=='\r')
+                    break;
             }
+            if (limit-q<unit)
+                q=limit;
         }
-        while (remainder>0) {
-            f->byteBuffer[f->nbBytesInBuf]=utfbuf[0];
-            f->nbBytesInBuf++;
-            utfbuf[0]=utfbuf[1];
-            utfbuf[1]=utfbuf[2];
-            remainder--;
+
+        /* Decoding never yields more chars than there are bytes. */
+        size=length+(q-p)+1;
+        if (size>f->linesize) {
+            size=JS_MAX(size, 2*f->linesize);
+            buf=(jschar*)JS_realloc(cx, f->linebuffer, size*sizeof(jschar));
+            if (!buf)
+                goto out_of_memory;
+            f->linebuffer=buf;
+            f->linesize=size;
         }
-      break;
-    case UCS2:
-        if (f->handle) {
-            count=PR_Seek(f->handle, len*2, PR_SEEK_CUR)/2;
+        n=decodeBuffered(f, q, f->linebuffer+length, f->linesize-length,
+                         f->type);
+        length+=n;
+
+        if (q==limit) {
+            /* Read on, finishing any char cut off at the end of the block. */
+            want=f->readlen-f->readpos+unit;
+            continue;
+        }
+
+        /* A sequence cut off by the terminator is not UTF-8. */
+        if (f->readbuf+f->readpos<q) {
+            f->linebuffer[length++]=DEFAULT_CHAR;
+            f->readpos=q-f->readbuf;
+        }
+
+        /* Skip the terminator and, after a carriage return, a newline. */
+        if (unit==1) {
+            cr=(*q=='\r');
         } else {
-            count=fseek(f->nativehandle, len*2, SEEK_CUR)/2;
+            jschar c;
+
+            memcpy(&c, q, sizeof c);
+            cr=(c=='\r');
         }
-        break;
+        f->readpos+=unit;
+        if (cr && fillBuffer(cx, f, unit)>=unit) {
+            p=f->readbuf+f->readpos;
+            if (unit==1) {
+                if (*p=='\n')
+                    f->readpos++;
+            } else {
+                jschar c;
+
+                memcpy(&c, p, sizeof c);
+                if (c=='\n')
+                    f->readpos+=unit;
+            }
+        }
+        *lengthp=length;
+        return JS_TRUE;
     }
-    return count;
+
+out_of_memory:
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
 }
 
+static int32
+JS_FileSkip(JSContext *cx, JSFile * f, int32 len, int32 mode) 
+{
+    jschar buf[256];
+    int32 count,n;
+
+    /* Decode and discard, since UTF-8 chars vary in length. */
+    count=0;
+    while (count<len) {
+        n=JS_FileRead(cx, f, buf, JS_MIN(len-count, (int32)(sizeof buf / sizeof buf[0])),
+                      mode);
+        if (n<=0)
+            break;
+        count+=n;
+    }
+    return count;
+}
 
 
-static int32
-JS_FileWrite(JSContext *cx, JSFile* f, jschar*buf, int32 len, int32 mode) 
+/*
+ * Encode len chars at buf in mode, into a new JS_malloc'd vector of bytes
+ * whose length is stored at *lengthp.  Return null if out of memory or if a
+ * char can't be encoded.
+ */
+static unsigned char *
+encodeChars(JSContext *cx, jschar *buf, int32 len, int32 mode, int32 *lengthp)
 {
-    unsigned char*aux;
-    int32 count,i,j;
-    unsigned char*utfbuf;
+    unsigned char *bytes;
+    int32 i, j, count;
+
     switch (mode) {
     case ASCII:
-        aux = (unsigned char*)JS_malloc(cx, len);
-        if (!aux) {
-            JS_ReportOutOfMemory(cx);
-            return 0;
-        }
+        bytes = (unsigned char*)JS_malloc(cx, len+1);
+        if (!bytes)
+            return NULL;
         for (i=0; i<len; i++) {
-            aux[i]=buf[i]%256;
-        }
-        if (f->handle) {
-            count = PR_Write(f->handle,aux,len);
-        } else {
-            count = fwrite(aux, 1, len, f->nativehandle);
+            bytes[i]=buf[i]%256;
         }
-        if (count==-1) {
-            JS_free(cx, aux);
-            return 0;
-        }
-        JS_free(cx, aux);
+        count=len;
         break;
     case UTF8:
-        utfbuf = (unsigned char*)JS_malloc(cx, len*3);
-        if (!utfbuf) { 
-            JS_ReportOutOfMemory(cx);
-            return 0;
-        }
+        bytes = (unsigned char*)JS_malloc(cx, len*3+1);
+        if (!bytes)
+            return NULL;
         i=0;
         for (count=0;count<len;count++) {
-            j=one_ucs2_to_utf8_char(utfbuf+i,utfbuf+len*3,buf[count]);
+            j=one_ucs2_to_utf8_char(bytes+i,bytes+len*3,buf[count]);
             if (j==-1) {
-                JS_free(cx, utfbuf);
-                return 0;
+                JS_free(cx, bytes);
+                return NULL;
             }
             i+=j;
         }
-        if (f->handle) {
-            j = PR_Write(f->handle, utfbuf, i);
-        } else {
-            j = fwrite(utfbuf, 1, i, f->nativehandle);
-        }
-        if (j<i) {
-            JS_free(cx, utfbuf);
-            return 0;
-        }
-        JS_free(cx, utfbuf);
-      break;
-    case UCS2:        
-        if (f->handle) {
-            count = PR_Write(f->handle,buf,len*2)>>1;
-        } else {
-            count = fwrite(buf, 1, len*2, f->nativehandle)>>1;
-        }
-        if (count==-1) {
-            return 0;
-        }
+        count=i;
+        break;
+    default:
+        bytes = (unsigned char*)JS_malloc(cx, len*2+1);
+        if (!bytes)
+            return NULL;
+        memcpy(bytes, buf, len*2);
+        count=len*2;
         break;
     }
-    return count;
+    *lengthp=count;
+    return bytes;
+}
+
+static int32
+JS_FileWrite(JSContext *cx, JSFile* f, jschar*buf, int32 len, int32 mode) 
+{
+    unsigned char *bytes;
+    int32 count,nbytes;
+    JSBool suspended;
+
+    dropReadBuffer(f);
+    bytes=encodeChars(cx, buf, len, mode, &nbytes);
+    if (!bytes)
+        return 0;
+    suspended=beginBlockingIO(cx);
+    if (f->handle) {
+        count = PR_Write(f->handle, bytes, nbytes);
+    } else {
+        count = fwrite(bytes, 1, nbytes, f->nativehandle);
+    }
+    endBlockingIO(cx, suspended);
+    JS_free(cx, bytes);
+    if (count<nbytes)
+        return 0;
+    return len;
 }
 
 
@@ -930,6 +1257,17 @@ file_toString(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval
     return JS_TRUE;
 }
 
+/* Map an encoding name to ASCII, UTF8 or UCS2, defaulting to UTF8. */
+static int32
+fileType(const char *ctype)
+{
+    if (!strcmp(ctype,asciistring))
+        return ASCII;
+    if (!strcmp(ctype,unicodestring))
+        return UCS2;
+    return UTF8;
+}
+
 /* Ripped off from lm_win.c .. */
 /* where is strcasecmp?.. for now, it's case sensitive.. */
 static int32
@@ -1001,16 +1339,7 @@ file_open(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     } else
       ctype = "";
 
-    if (!strcmp(ctype,asciistring))
-        type=ASCII;
-    else
-    if (!strcmp(ctype,utfstring))
-        type=UTF8;
-    else
-    if (!strcmp(ctype,unicodestring))
-        type=UCS2;
-    else
-        type=UTF8;
+    type=fileType(ctype);
 
 
     mask=0;
@@ -1040,6 +1369,31 @@ file_open(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 
     resetBuffers(file);
 
+    /*
+     * Map large files opened only for reading, rather than copy them through
+     * the read buffer.  Reads then just decode from the mapping.
+     */
+    if (handle!=NULL && (mask&(PR_WRONLY|PR_RDWR))==0) {
+        PRFileInfo info;
+        void *addr;
+
+        if (PR_GetOpenFileInfo(handle, &info)==PR_SUCCESS &&
+            info.size>=MAP_MIN_SIZE) {
+            file->map=PR_CreateFileMap(handle, info.size, PR_PROT_READONLY);
+            if (file->map) {
+                addr=PR_MemMap(file->map, 0, (PRUint32)info.size);
+                if (addr) {
+                    JS_free(cx, file->readbuf);
+                    file->readbuf=(unsigned char*)addr;
+                    file->readlen=(int32)info.size;
+                } else {
+                    PR_CloseFileMap(file->map);
+                    file->map=NULL;
+                }
+            }
+        }
+    }
+
     if (handle==NULL) {
         *rval=BOOLEAN_TO_JSVAL(JS_FALSE);
     } else {
@@ -1066,6 +1420,7 @@ file_close(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     }
 
     if (file->handle) {
+        unmapFile(file);
         status=PR_Close(file->handle);
     } else {
         status=fclose(file->nativehandle);
@@ -1169,12 +1524,9 @@ static JSBool
 file_copyTo(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
     JSFile  *file;
-    JSStatus status;
-    char*str;
-    PRFileDesc* handle;
-    PRFileInfo info;
-    char* buffer;
-    uint32 count;
+    JSString *str;
+    const char *dest, *error;
+    JSBool suspended;
 
     if (argc!=1)
     return JS_FALSE; 
@@ -1183,7 +1535,10 @@ file_copyTo(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     if (!file)
     return JS_FALSE;
 
-    str=JS_GetStringBytes(JS_ValueToString(cx, argv[0]));
+    str=JS_ValueToString(cx, argv[0]);
+    if (!str)
+    return JS_FALSE;
+    argv[0]=STRING_TO_JSVAL(str);
 
     if (file->opened) {
         JS_ReportError(cx, CANNOT_COPY_OPENED_FILE_ERROR);
@@ -1191,38 +1546,15 @@ file_copyTo(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
         return JS_TRUE;
     }
 
-    handle=PR_Open(str, PR_WRONLY|PR_CREATE_FILE|PR_TRUNCATE, 0644 );
-    file->handle=PR_Open(file->path, PR_RDONLY, 0644);
-
-    status=PR_GetOpenFileInfo(file->handle,&info);
-    if (status==JS_FAILURE) {
-      JS_ReportError(cx, CANNOT_ACCESS_FILE_INFO_ERROR );
-      *rval = JSVAL_FALSE;
-      return JS_TRUE;
-    }
-
-    buffer=JS_malloc(cx,info.size);
-    count=PR_Read(file->handle,buffer,info.size);
-    if (count!=info.size) {
-        JS_free(cx,buffer);
-        PR_Close(file->handle);
-        PR_Close(handle);
-        JS_ReportError(cx, COPY_READ_ERROR );
+    dest=JS_GetStringBytes(str);
+    suspended=beginBlockingIO(cx);
+    error=copyFile(file->path, dest);
+    endBlockingIO(cx, suspended);
+    if (error) {
+        JS_ReportError(cx, error);
         *rval = JSVAL_FALSE;
         return JS_TRUE;
     }
-    count=PR_Write(handle,buffer,info.size);
-    if (count!=info.size) {
-        JS_free(cx,buffer);
-        PR_Close(file->handle);
-        PR_Close(handle);
-        JS_ReportError(cx, COPY_WRITE_ERROR );
-        *rval=JSVAL_FALSE;
-        return JS_TRUE;
-    }
-    JS_free(cx,buffer);
-    PR_Close(file->handle);
-    PR_Close(handle);
 
     *rval = JSVAL_TRUE;
     return JS_TRUE;
@@ -1452,11 +1784,7 @@ file_readln(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
     JSFile      *file;
     JSString    *str;
-    jschar      *buf;
-    int32       offset;
-    intN        room;
-    jschar      data,data2;
-    JSBool  endofline;
+    int32       length;
 
     file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
     if (!file)
@@ -1478,64 +1806,16 @@ file_readln(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
         }
     }
 
-    if (!file->linebuffer) {
-        buf = JS_malloc(cx, 128*(sizeof data));
-        if (!buf) {
-            JS_ReportOutOfMemory(cx);
-            return JS_FALSE;
-        }           
-        file->linebuffer=JS_NewUCString(cx,buf,128);
-    }
-    room=JS_GetStringLength(file->linebuffer);
-    offset=0;
-
-    /* XXX TEST ME!! */
-    for(;;) {
-        if (!JS_FileRead(cx, file,&data,1,file->type)) {
-            endofline=JS_FALSE;
-            goto loop;
-        }
-        switch (data) {
-        case '\n' : 
-            endofline=JS_TRUE;
-            goto loop;
-        case '\r' :
-            if (!JS_FileRead(cx, file,&data2,1,file->type)) {
-                endofline=JS_TRUE;
-                goto loop;
-            }
-            if (data2!='\n') { /* we read one char to far. buffer it. */
-                file->charBuffer=data2;
-                file->charBufferUsed=JS_TRUE;
-            }
-            endofline=JS_TRUE;
-            goto loop;
-        default:
-            if (--room < 0) {
-                buf = JS_malloc(cx, (offset+ 128)*sizeof data);
-                if (!buf) {
-                    JS_ReportOutOfMemory(cx);
-                    return JS_FALSE;
-                }
-                room = 127;
-                memcpy(buf,JS_GetStringChars(file->linebuffer),
-                    JS_GetStringLength(file->linebuffer));
-                /* what follows may not be the cleanest way. */
-                file->linebuffer->chars = buf;
-                file->linebuffer->length= offset+128;
-            }
-            file->linebuffer->chars[offset++] = data;
-            break;
-        }
+    if (!JS_FileReadLine(cx, file, &length))
+        return JS_FALSE;
+    if (length<0) {
+        *rval = JSVAL_NULL;
+        return JS_TRUE;
     }
-loop:
-    file->linebuffer->chars[offset]=0;
-    if ((endofline==JS_TRUE)) {
-    str = JS_NewUCStringCopyN(cx,JS_GetStringChars(file->linebuffer),
-          offset);
+    str = JS_NewUCStringCopyN(cx, file->linebuffer, length);
+    if (!str)
+        return JS_FALSE;
     *rval=STRING_TO_JSVAL(str);
-    } else
-    *rval = JSVAL_NULL;
     return JS_TRUE;
 }
 
@@ -1543,12 +1823,11 @@ static JSBool
 file_readAll(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
     JSFile      *file;
-    PRFileInfo  info;
-    JSStatus    status;
     JSObject    *array;
     jsint         len;
+    int32       length;
+    JSString    *str;
     jsval       line;
-    JSBool      ok=JS_TRUE;
 
 
     file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
@@ -1556,6 +1835,8 @@ file_readAll(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     return JS_FALSE;
 
     array=JS_NewArrayObject(cx, 0, NULL);
+    if (!array)
+        return JS_FALSE;
     *rval = OBJECT_TO_JSVAL(array);
     len = 0;
 
@@ -1576,29 +1857,87 @@ file_readAll(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
         }
     }
 
-    if (file->handle) {
-        status=PR_GetOpenFileInfo(file->handle,&info);
-    } else {
-        status=PR_GetFileInfo(file->path,&info);
-    }
-
-    if (status==JS_FAILURE)
+    for (;;) {
+        if (!JS_FileReadLine(cx, file, &length))
+            return JS_FALSE;
+        if (length<0)
+            break;
+        str = JS_NewUCStringCopyN(cx, file->linebuffer, length);
+        if (!str)
+            return JS_FALSE;
+        line = STRING_TO_JSVAL(str);
+        if (!JS_SetElement(cx, array, len, &line))
+            return JS_FALSE;
+        len++;
+    }
+
+    return JS_TRUE;
+}
+
+/*
+ * eachLine(f) calls f(line, lineno) for each line not yet read, stopping early
+ * if f returns false.  Lines are handed out straight from the read and line
+ * buffers, and the result is the number of lines passed to f.
+ */
+static JSBool
+file_eachLine(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JSFile      *file;
+    JSString    *str;
+    int32       length;
+    jsint       count;
+    jsval       args[2];
+    jsval       fval, result;
+
+    file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
+    if (!file)
     return JS_FALSE;
-    
-    if (file->handle) {
-        while (ok&&(info.size>(JSUint32)PR_Seek(file->handle, 0, PR_SEEK_CUR))) {
-            ok=file_readln(cx,obj,0,NULL,&line);
-            JS_SetElement(cx, array, len, &line);
-            len++;
+
+    if (argc<1) {
+        JS_ReportError(cx, EACHLINE_EXPECTS_ONE_ARG_ERROR);
+        return JS_FALSE;
+    }
+    if (!JS_ValueToFunction(cx, argv[0]))
+        return JS_FALSE;
+    fval=argv[0];
+
+    if (!file->opened) {
+        JSString *type,*mask;
+        jsval v[2];
+        jsval rval;
+        JSBool b;
+        type= JS_NewStringCopyZ(cx, utfstring);
+        mask= JS_NewStringCopyZ(cx, "readOnly");
+        v[0]=STRING_TO_JSVAL(type);
+        v[1]=STRING_TO_JSVAL(mask);
+        b=file_open(cx,obj,2,v,&rval);
+        if (!file->opened) {
+            JS_ReportError(cx, CANNOT_OPEN_FILE_ERROR);
+            return JS_FALSE;
         }
-    } else {
-        while (ok&&(info.size>(JSUint32)fseek(file->nativehandle, 0, SEEK_CUR))) {
-            ok=file_readln(cx,obj,0,NULL,&line);
-            JS_SetElement(cx, array, len, &line);
-            len++;
-        }        
     }
 
+    count=0;
+    for (;;) {
+        if (!JS_FileReadLine(cx, file, &length))
+            return JS_FALSE;
+        if (length<0)
+            break;
+        str = JS_NewUCStringCopyN(cx, file->linebuffer, length);
+        if (!str)
+            return JS_FALSE;
+
+        /* argv[1] roots the line while f runs. */
+        argv[1]=args[0]=STRING_TO_JSVAL(str);
+        args[1]=INT_TO_JSVAL(count);
+        count++;
+        if (!JS_CallFunctionValue(cx, obj, fval, 2, args, &result))
+            return JS_FALSE;
+        if (result==JSVAL_FALSE)
+            break;
+    }
+
+    *rval=INT_TO_JSVAL(count);
     return JS_TRUE;
 }
 
@@ -1631,7 +1970,7 @@ file_skip(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     if (!JS_ValueToInt32(cx, argv[0], &toskip))
     return JS_FALSE;
 
-    count= JS_FileSkip(file,toskip,file->type);
+    count= JS_FileSkip(cx,file,toskip,file->type);
     if (count!=toskip)
         return JS_FALSE;
 
@@ -1641,8 +1980,9 @@ file_skip(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 static JSBool
 file_list(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) 
 {
-    PRDir *dir;
-    PRDirEntry *entry;
+    char **names;
+    size_t count, i;
+    JSBool ok, suspended;
     JSFile * file;
     JSObject *array;
     JSObject *each;
@@ -1674,20 +2014,24 @@ file_list(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
         *rval = JSVAL_FALSE;
         return JS_TRUE; /* or return an empty array? or do a readAll?  */
     }
-    dir=PR_OpenDir(file->path);
     /* Create JSArray here.. */
     array=JS_NewArrayObject(cx, 0, NULL);
+    if (!array)
+    return JS_FALSE;
     *rval = OBJECT_TO_JSVAL(array);
     len=0;
 
-    entry=NULL;
-    if (dir==NULL)
+    /* Read the whole directory before filtering, which may run script. */
+    suspended=beginBlockingIO(cx);
+    ok=readDirectory(file->path, &names, &count);
+    endBlockingIO(cx, suspended);
+    if (!ok)
     return JS_TRUE;
     
-    while ((entry=PR_ReadDir(dir,PR_SKIP_BOTH))!=NULL) {
+    for (i=0; i<count; i++) {
         /* First, check if we have a filter */
         if (re!=NULL) {
-            tmp=JS_NewStringCopyZ(cx,entry->name);
+            tmp=JS_NewStringCopyZ(cx,names[i]);
             index=0;
             js_ExecuteRegExp(cx, re, tmp, &index, JS_TRUE, &v);
             if (v==JSVAL_NULL) {
@@ -1696,30 +2040,31 @@ file_list(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 
         }
         if (func!=NULL) {
-            tmp=JS_NewStringCopyZ(cx,entry->name);
+            tmp=JS_NewStringCopyZ(cx,names[i]);
             args[0]=STRING_TO_JSVAL(tmp);
             JS_CallFunction(cx, obj, func, 1, args, &v);
             if (v==JSVAL_FALSE) {
                 continue;
             }
         }
-        aux = combinePath(cx, file->path, (char*)entry->name);
+        aux = combinePath(cx, file->path, names[i]);
 
         each=NewFileObject(cx, aux);
         JS_free(cx, aux);
         if (!each)
-        return JS_FALSE;
+        break;
         eachObj = JS_GetInstancePrivate(cx, each, &file_class, NULL);
         if (!eachObj)
-        return JS_FALSE;
+        break;
         v=OBJECT_TO_JSVAL(each);
         JS_SetElement(cx, array, len, &v);
-        JS_SetProperty(cx, array, entry->name, &v); /* accessible by name.. make sense I think.. */
+        JS_SetProperty(cx, array, names[i], &v); /* accessible by name.. make sense I think.. */
         len++;
     }
-    PR_CloseDir(dir);
+    ok=(i==count);
+    freeDirectory(names, count);
 
-    return JS_TRUE;
+    return ok;
 }
 
 static JSBool
@@ -1752,6 +2097,612 @@ file_mkdir(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
     return JS_TRUE;
 }
 
+/*
+ * Asynchronous I/O.  readAsync, writeAsync, copyToAsync and listAsync hand a
+ * job to a small pool of NSPR threads, which do the I/O outside any request
+ * and touch no JS state.  A finished job waits until File.poll() or
+ * File.wait() runs on the context that started it, which calls the job's
+ * callback with the result, and with the File object as this.  Until then
+ * the callback and object are rooted.  Jobs still undelivered when their
+ * context is destroyed are dropped without a callback, see js_CancelFileJobs.
+ * The threads are started with the first job, and stopped when a runtime is
+ * destroyed while no jobs are left.
+ */
+typedef enum FileJobKind {
+    FILE_JOB_READ,              /* read and decode the whole file */
+    FILE_JOB_WRITE,             /* append encoded bytes to the file */
+    FILE_JOB_COPY,              /* copy the file to dest */
+    FILE_JOB_LIST               /* list the directory */
+} FileJobKind;
+
+typedef enum FileJobState {
+    FILE_JOB_PENDING,
+    FILE_JOB_RUNNING,
+    FILE_JOB_DONE
+} FileJobState;
+
+typedef struct FileJob FileJob;
+
+struct FileJob {
+    FileJob         *next;      /* next job not yet delivered */
+    JSContext       *cx;        /* context that runs the callback */
+    FileJobKind     kind;
+    FileJobState    state;
+    char            *path;      /* malloc'd copy of the file's path */
+    char            *dest;      /* malloc'd path to copy to */
+    int32           type;       /* encoding to read with */
+    unsigned char   *bytes;     /* JS_malloc'd bytes to write */
+    int32           length;     /* number of bytes to write, or chars read */
+    jschar          *chars;     /* chars read */
+    char            **names;    /* names listed, see readDirectory */
+    size_t          count;
+    JSBool          ok;
+    jsval           callback;   /* rooted until the job is delivered */
+    jsval           object;     /* the File object, likewise */
+    jsval           result;     /* the callback's argument, likewise */
+};
+
+#define FILE_IO_THREADS     4
+
+static PRCallOnceType   ioOnce;
+static PRLock           *ioLock;
+static PRCondVar        *ioWork;        /* notified when a job is queued */
+static PRCondVar        *ioDone;        /* notified when a job finishes, or
+                                           a thread exits */
+static FileJob          *ioJobs;        /* undelivered jobs, oldest first */
+static uintN            ioThreads;      /* number of running I/O threads */
+static JSBool           ioStopping;     /* true while the threads exit */
+
+static char *
+copyPath(const char *path)
+{
+    char *copy;
+
+    copy=malloc(strlen(path)+1);
+    if (copy)
+        strcpy(copy, path);
+    return copy;
+}
+
+static void
+runJob(FileJob *job)
+{
+    PRFileDesc *handle;
+    unsigned char *bytes, *tmp;
+    int32 size, length, count;
+    JSFile file;
+
+    switch (job->kind) {
+    case FILE_JOB_READ:
+        handle=PR_Open(job->path, PR_RDONLY, 0644);
+        if (!handle)
+            break;
+        bytes=NULL;
+        size=length=0;
+        for (;;) {
+            if (length==size) {
+                size=size ? 2*size : READ_BUFFER_SIZE;
+                tmp=realloc(bytes, size);
+                if (!tmp)
+                    break;
+                bytes=tmp;
+            }
+            count=PR_Read(handle, bytes+length, size-length);
+            if (count<=0) {
+                job->ok=(count==0);
+                break;
+            }
+            length+=count;
+        }
+        PR_Close(handle);
+        if (job->ok) {
+            job->chars=malloc((length+1)*sizeof(jschar));
+            if (job->chars) {
+                memset(&file, 0, sizeof file);
+                file.readbuf=bytes;
+                file.readlen=length;
+                job->length=decodeBuffered(&file, bytes+length, job->chars,
+                                           length, job->type);
+                job->chars[job->length]=0;
+            } else {
+                job->ok=JS_FALSE;
+            }
+        }
+        free(bytes);
+        break;
+
+    case FILE_JOB_WRITE:
+        handle=PR_Open(job->path, PR_WRONLY|PR_CREATE_FILE|PR_APPEND, 0644);
+        if (!handle)
+            break;
+        job->ok=(PR_Write(handle, job->bytes, job->length)==job->length);
+        PR_Close(handle);
+        break;
+
+    case FILE_JOB_COPY:
+        job->ok=!copyFile(job->path, job->dest);
+        break;
+
+    case FILE_JOB_LIST:
+        job->ok=readDirectory(job->path, &job->names, &job->count);
+        break;
+    }
+}
+
+static void
+ioThread(void *arg)
+{
+    FileJob *job;
+
+    PR_Lock(ioLock);
+    for (;;) {
+        for (job=ioJobs; job; job=job->next) {
+            if (job->state==FILE_JOB_PENDING)
+                break;
+        }
+        if (!job) {
+            if (ioStopping)
+                break;
+            PR_WaitCondVar(ioWork, PR_INTERVAL_NO_TIMEOUT);
+            continue;
+        }
+        job->state=FILE_JOB_RUNNING;
+        PR_Unlock(ioLock);
+        runJob(job);
+        PR_Lock(ioLock);
+        job->state=FILE_JOB_DONE;
+        PR_NotifyAllCondVar(ioDone);
+    }
+    ioThreads--;
+    PR_NotifyAllCondVar(ioDone);
+    PR_Unlock(ioLock);
+}
+
+static PRStatus
+newIOLock(void)
+{
+    ioLock=PR_NewLock();
+    if (!ioLock)
+        return PR_FAILURE;
+    ioWork=PR_NewCondVar(ioLock);
+    ioDone=PR_NewCondVar(ioLock);
+    if (!ioWork || !ioDone)
+        return PR_FAILURE;
+    return PR_SUCCESS;
+}
+
+/*
+ * Start the I/O threads unless they are running, waiting for any that are
+ * exiting first.  Return false if none could be started.
+ */
+static JSBool
+startIOThreads(void)
+{
+    JSBool ok;
+
+    if (PR_CallOnce(&ioOnce, newIOLock)!=PR_SUCCESS)
+        return JS_FALSE;
+    PR_Lock(ioLock);
+    while (ioStopping)
+        PR_WaitCondVar(ioDone, PR_INTERVAL_NO_TIMEOUT);
+    while (ioThreads<FILE_IO_THREADS) {
+        if (!PR_CreateThread(PR_SYSTEM_THREAD, ioThread, NULL,
+                             PR_PRIORITY_NORMAL, PR_GLOBAL_THREAD,
+                             PR_UNJOINABLE_THREAD, 0)) {
+            break;
+        }
+        ioThreads++;
+    }
+    ok=(ioThreads!=0);
+    PR_Unlock(ioLock);
+    return ok;
+}
+
+static void
+destroyJob(JSContext *cx, FileJob *job)
+{
+    JS_RemoveRoot(cx, &job->callback);
+    JS_RemoveRoot(cx, &job->object);
+    JS_RemoveRoot(cx, &job->result);
+    free(job->path);
+    free(job->dest);
+    JS_free(cx, job->bytes);
+    free(job->chars);
+    if (job->names)
+        freeDirectory(job->names, job->count);
+    free(job);
+}
+
+/*
+ * Make a job of kind on obj's file, to call fval when it's done.  The caller
+ * fills in any other inputs before queueing it with queueJob.
+ */
+static FileJob *
+newJob(JSContext *cx, JSObject *obj, JSFile *file, FileJobKind kind,
+       jsval fval)
+{
+    FileJob *job;
+
+    if (!JS_ValueToFunction(cx, fval))
+        return NULL;
+    if (!startIOThreads()) {
+        JS_ReportError(cx, CANNOT_START_IO_ERROR);
+        return NULL;
+    }
+    job=calloc(1, sizeof *job);
+    if (!job) {
+        JS_ReportOutOfMemory(cx);
+        return NULL;
+    }
+    job->cx=cx;
+    job->kind=kind;
+    job->state=FILE_JOB_PENDING;
+    job->callback=fval;
+    job->object=OBJECT_TO_JSVAL(obj);
+    job->result=JSVAL_NULL;
+    if (!JS_AddRoot(cx, &job->callback) ||
+        !JS_AddRoot(cx, &job->object) ||
+        !JS_AddRoot(cx, &job->result)) {
+        destroyJob(cx, job);
+        return NULL;
+    }
+    job->path=copyPath(file->path);
+    if (!job->path) {
+        JS_ReportOutOfMemory(cx);
+        destroyJob(cx, job);
+        return NULL;
+    }
+    return job;
+}
+
+static void
+queueJob(FileJob *job)
+{
+    FileJob **jobp;
+
+    PR_Lock(ioLock);
+    for (jobp=&ioJobs; *jobp; jobp=&(*jobp)->next)
+        continue;
+    *jobp=job;
+    PR_NotifyCondVar(ioWork);
+    PR_Unlock(ioLock);
+}
+
+/* Call job's callback with its result, and destroy the job. */
+static JSBool
+deliverJob(JSContext *cx, FileJob *job)
+{
+    JSObject *array, *each;
+    JSString *str;
+    jsval v;
+    char *aux;
+    size_t i;
+    JSBool ok;
+
+    ok=JS_TRUE;
+    switch (job->kind) {
+    case FILE_JOB_READ:
+        if (job->ok) {
+            str=JS_NewUCString(cx, job->chars, job->length);
+            if (!str) {
+                ok=JS_FALSE;
+                break;
+            }
+            job->chars=NULL;
+            job->result=STRING_TO_JSVAL(str);
+        }
+        break;
+
+    case FILE_JOB_WRITE:
+    case FILE_JOB_COPY:
+        job->result=BOOLEAN_TO_JSVAL(job->ok);
+        break;
+
+    case FILE_JOB_LIST:
+        if (!job->ok)
+            break;
+        array=JS_NewArrayObject(cx, 0, NULL);
+        if (!array) {
+            ok=JS_FALSE;
+            break;
+        }
+        job->result=OBJECT_TO_JSVAL(array);
+        for (i=0; ok && i<job->count; i++) {
+            aux=combinePath(cx, job->path, job->names[i]);
+            each=aux ? NewFileObject(cx, aux) : NULL;
+            JS_free(cx, aux);
+            if (!each) {
+                ok=JS_FALSE;
+                break;
+            }
+            v=OBJECT_TO_JSVAL(each);
+            ok=JS_SetElement(cx, array, (jsint)i, &v) &&
+               JS_SetProperty(cx, array, job->names[i], &v);
+        }
+        break;
+    }
+
+    if (ok) {
+        ok=JS_CallFunctionValue(cx, JSVAL_TO_OBJECT(job->object),
+                                job->callback, 1, &job->result, &v);
+    }
+    destroyJob(cx, job);
+    return ok;
+}
+
+/* Test whether cx has a finished job.  Call with ioLock held. */
+static JSBool
+hasFinishedJob(JSContext *cx)
+{
+    FileJob *job;
+
+    for (job=ioJobs; job; job=job->next) {
+        if (job->cx==cx && job->state==FILE_JOB_DONE)
+            return JS_TRUE;
+    }
+    return JS_FALSE;
+}
+
+/*
+ * Deliver cx's finished jobs, in the order they were started.  If wait is
+ * true, keep going until cx has no jobs left, waiting outside the request for
+ * running ones.  Store the number delivered at *countp.
+ */
+static JSBool
+deliverJobs(JSContext *cx, JSBool wait, jsint *countp)
+{
+    FileJob **jobp, *job;
+    JSBool pending, suspended;
+
+    *countp=0;
+    if (!ioLock)
+        return JS_TRUE;
+    for (;;) {
+        PR_Lock(ioLock);
+        pending=JS_FALSE;
+        job=NULL;
+        for (jobp=&ioJobs; *jobp; jobp=&(*jobp)->next) {
+            if ((*jobp)->cx!=cx)
+                continue;
+            if ((*jobp)->state==FILE_JOB_DONE) {
+                job=*jobp;
+                *jobp=job->next;
+                break;
+            }
+            pending=JS_TRUE;
+        }
+        if (!job && pending && wait) {
+            /*
+             * Don't suspend the request while holding ioLock, and look again
+             * once it's retaken in case a job finished in between.
+             */
+            PR_Unlock(ioLock);
+            suspended=beginBlockingIO(cx);
+            PR_Lock(ioLock);
+            if (!hasFinishedJob(cx))
+                PR_WaitCondVar(ioDone, PR_INTERVAL_NO_TIMEOUT);
+            PR_Unlock(ioLock);
+            endBlockingIO(cx, suspended);
+            continue;
+        }
+        PR_Unlock(ioLock);
+        if (!job)
+            return JS_TRUE;
+        (*countp)++;
+        if (!deliverJob(cx, job))
+            return JS_FALSE;
+    }
+}
+
+void
+js_CancelFileJobs(JSContext *cx)
+{
+    FileJob **jobp, *job, *cancelled;
+    JSBool running;
+
+    if (!ioLock)
+        return;
+    cancelled=NULL;
+    PR_Lock(ioLock);
+    do {
+        running=JS_FALSE;
+        jobp=&ioJobs;
+        while ((job=*jobp)!=NULL) {
+            if (job->cx!=cx) {
+                jobp=&job->next;
+            } else if (job->state==FILE_JOB_RUNNING) {
+                running=JS_TRUE;
+                jobp=&job->next;
+            } else {
+                *jobp=job->next;
+                job->next=cancelled;
+                cancelled=job;
+            }
+        }
+
+        /* A running job's thread still uses it, so wait for it to finish. */
+        if (running)
+            PR_WaitCondVar(ioDone, PR_INTERVAL_NO_TIMEOUT);
+    } while (running);
+    PR_Unlock(ioLock);
+
+    while ((job=cancelled)!=NULL) {
+        cancelled=job->next;
+        destroyJob(cx, job);
+    }
+}
+
+void
+js_StopFileThreads(void)
+{
+    if (!ioLock)
+        return;
+    PR_Lock(ioLock);
+    if (!ioJobs && ioThreads!=0 && !ioStopping) {
+        ioStopping=JS_TRUE;
+        PR_NotifyAllCondVar(ioWork);
+        while (ioThreads!=0)
+            PR_WaitCondVar(ioDone, PR_INTERVAL_NO_TIMEOUT);
+        ioStopping=JS_FALSE;
+        PR_NotifyAllCondVar(ioDone);
+    }
+    PR_Unlock(ioLock);
+}
+
+static JSBool
+file_poll(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    jsint count;
+
+    if (!deliverJobs(cx, JS_FALSE, &count))
+        return JS_FALSE;
+    *rval=INT_TO_JSVAL(count);
+    return JS_TRUE;
+}
+
+static JSBool
+file_wait(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    jsint count;
+
+    if (!deliverJobs(cx, JS_TRUE, &count))
+        return JS_FALSE;
+    *rval=INT_TO_JSVAL(count);
+    return JS_TRUE;
+}
+
+static JSBool
+file_readAsync(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JSFile      *file;
+    JSString    *str;
+    FileJob     *job;
+    int32       type;
+
+    file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
+    if (!file)
+    return JS_FALSE;
+
+    if (argc<1) {
+        JS_ReportError(cx, ASYNC_EXPECTS_CALLBACK_ERROR);
+        return JS_FALSE;
+    }
+    type=UTF8;
+    if (argc>=2) {
+        str=JS_ValueToString(cx, argv[1]);
+        if (!str)
+            return JS_FALSE;
+        type=fileType(JS_GetStringBytes(str));
+    }
+
+    job=newJob(cx, obj, file, FILE_JOB_READ, argv[0]);
+    if (!job)
+        return JS_FALSE;
+    job->type=type;
+    queueJob(job);
+    *rval=JSVAL_TRUE;
+    return JS_TRUE;
+}
+
+static JSBool
+file_writeAsync(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JSFile      *file;
+    JSString    *str, *strtype;
+    FileJob     *job;
+    int32       type;
+
+    file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
+    if (!file)
+    return JS_FALSE;
+
+    if (argc<2) {
+        JS_ReportError(cx, ASYNC_EXPECTS_CALLBACK_ERROR);
+        return JS_FALSE;
+    }
+    str=JS_ValueToString(cx, argv[0]);
+    if (!str)
+        return JS_FALSE;
+    argv[0]=STRING_TO_JSVAL(str);
+    type=UTF8;
+    if (argc>=3) {
+        strtype=JS_ValueToString(cx, argv[2]);
+        if (!strtype)
+            return JS_FALSE;
+        type=fileType(JS_GetStringBytes(strtype));
+    }
+
+    job=newJob(cx, obj, file, FILE_JOB_WRITE, argv[1]);
+    if (!job)
+        return JS_FALSE;
+    job->bytes=encodeChars(cx, JS_GetStringChars(str), JS_GetStringLength(str),
+                           type, &job->length);
+    if (!job->bytes) {
+        destroyJob(cx, job);
+        return JS_FALSE;
+    }
+    queueJob(job);
+    *rval=JSVAL_TRUE;
+    return JS_TRUE;
+}
+
+static JSBool
+file_copyToAsync(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JSFile      *file;
+    JSString    *str;
+    FileJob     *job;
+
+    file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
+    if (!file)
+    return JS_FALSE;
+
+    if (argc<2) {
+        JS_ReportError(cx, ASYNC_EXPECTS_CALLBACK_ERROR);
+        return JS_FALSE;
+    }
+    str=JS_ValueToString(cx, argv[0]);
+    if (!str)
+        return JS_FALSE;
+    argv[0]=STRING_TO_JSVAL(str);
+
+    job=newJob(cx, obj, file, FILE_JOB_COPY, argv[1]);
+    if (!job)
+        return JS_FALSE;
+    job->dest=copyPath(JS_GetStringBytes(str));
+    if (!job->dest) {
+        JS_ReportOutOfMemory(cx);
+        destroyJob(cx, job);
+        return JS_FALSE;
+    }
+    queueJob(job);
+    *rval=JSVAL_TRUE;
+    return JS_TRUE;
+}
+
+static JSBool
+file_listAsync(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+    JSFile      *file;
+    FileJob     *job;
+
+    file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
+    if (!file)
+    return JS_FALSE;
+
+    if (argc<1) {
+        JS_ReportError(cx, ASYNC_EXPECTS_CALLBACK_ERROR);
+        return JS_FALSE;
+    }
+
+    job=newJob(cx, obj, file, FILE_JOB_LIST, argv[0]);
+    if (!job)
+        return JS_FALSE;
+    queueJob(job);
+    *rval=JSVAL_TRUE;
+    return JS_TRUE;
+}
+
 static JSFunctionSpec file_functions[] = {
     { "toString",       file_toString, 0},
     { "open",           file_open, 0},
@@ -1764,11 +2715,22 @@ static JSFunctionSpec file_functions[] = {
     { "read",           file_read, 0},
     { "readln",         file_readln, 0},
     { "readAll",        file_readAll, 0},
+    { "eachLine",       file_eachLine, 1, 0, 1},
     { "write",          file_write, 0},
     { "writeln",        file_writeln, 0},
     { "writeAll",       file_writeAll, 0},
     { "list",           file_list, 0},
     { "mkdir",          file_mkdir, 0},
+    { "readAsync",      file_readAsync, 1},
+    { "writeAsync",     file_writeAsync, 2},
+    { "copyToAsync",    file_copyToAsync, 2},
+    { "listAsync",      file_listAsync, 1},
+    {0}
+};
+
+static JSFunctionSpec file_static_functions[] = {
+    { "poll",           file_poll, 0},
+    { "wait",           file_wait, 0},
     {0}
 };
 
@@ -1998,11 +2960,7 @@ file_getProperty(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
         break;
     case FILE_POSITION:
         if (file->opened) {
-            if (file->handle) {
-                *vp = INT_TO_JSVAL(PR_Seek(file->handle, 0, PR_SEEK_CUR));
-            } else {
-                *vp = INT_TO_JSVAL(fseek(file->nativehandle, 0, SEEK_CUR));
-            }
+            *vp = INT_TO_JSVAL(JS_FileTell(file));
         } else {
           *vp = JSVAL_VOID;
         }
@@ -2036,12 +2994,17 @@ file_setProperty(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
     case FILE_POSITION:
         if (file->randomAccess) {
             offset=JSVAL_TO_INT(*vp);
-            if (file->handle) {
+            if (file->map) {
+                count = (offset>=0 && offset<=file->readlen) ? offset : -1;
+                if (count>=0)
+                    file->readpos=offset;
+            } else if (file->handle) {
+                resetBuffers(file);
                 count = PR_Seek( file->handle, offset, PR_SEEK_SET);
             } else {
+                resetBuffers(file);
                 count = fseek( file->nativehandle, offset, SEEK_SET);
             }
-            resetBuffers(file);
             *vp = INT_TO_JSVAL(count);
         }
         break;
@@ -2059,9 +3022,12 @@ file_finalize(JSContext *cx, JSObject *obj)
     file = JS_GetInstancePrivate(cx, obj, &file_class, NULL);
     if (!file)
         return;
+    unmapFile(file);
+    if (file->opened && file->handle)
+        PR_Close(file->handle);
     JS_free(cx, file->path);
-    if (file->linebuffer)
-        JS_free(cx, file->linebuffer);
+    JS_free(cx, file->linebuffer);
+    JS_free(cx, file->readbuf);
     JS_free(cx, file);
 }
 
@@ -2089,8 +3055,6 @@ file_constructor(JSContext *cx, JSObject*obj, char *bytes)
 
     file->opened=JS_FALSE;
     file->handle=NULL;
-    file->nbBytesInBuf=0;
-    file->charBufferUsed=JS_FALSE;
     file->randomAccess=JS_TRUE; /* innocent until proven guilty */
 
     if (!JS_SetPrivate(cx, obj, file)) {
@@ -2201,7 +3165,7 @@ js_InitFileClass(JSContext *cx, JSObject* obj)
     char* currentdir;
     
     file = JS_InitClass(cx, obj, NULL, &file_class, File, 1,
-        file_props, file_functions, NULL, NULL);
+        file_props, file_functions, NULL, file_static_functions);
 
     if (!file)
         return NULL;
@@ -22,6 +22,17 @@
 extern JSObject*
 js_InitFileClass(JSContext *cx, JSObject* obj);
 
+/*
+ * Drop cx's undelivered asynchronous file jobs without calling back, waiting
+ * for any that are running.  Called when cx is destroyed.
+ */
+extern void
+js_CancelFileJobs(JSContext *cx);
+
+/* Stop the asynchronous file I/O threads if no jobs are left. */
+extern void
+js_StopFileThreads(void);
+
 
 #endif /* _jsfile_h__ */
 
@@ -20,6 +20,7 @@
  * JS function support.
  */
 #include "jsstddef.h"
+#include <stdlib.h>
 #include <string.h>
 #include "jstypes.h"
 #include "jsutil.h" /* Added by JSIFY */
@@ -835,12 +836,14 @@ fun_enumProperty(JSContext *cx, JSObject *obj)
     for (sprop = scope->props; sprop; sprop = sprop->next) {
 	jsval id = sprop->id;
 	if (!JSVAL_IS_INT(id)) {
-	    if (id == ATOM_KEY(cx->runtime->atomState.arityAtom) ||
-		id == ATOM_KEY(cx->runtime->atomState.lengthAtom) ||
-		id == ATOM_KEY(cx->runtime->atomState.callerAtom) ||
-		id == ATOM_KEY(cx->runtime->atomState.nameAtom))
+	    if ((id == ATOM_KEY(cx->runtime->atomState.arityAtom) ||
+		 id == ATOM_KEY(cx->runtime->atomState.lengthAtom) ||
+		 id == ATOM_KEY(cx->runtime->atomState.callerAtom) ||
+		 id == ATOM_KEY(cx->runtime->atomState.nameAtom)) &&
+		(sprop->attrs & JSPROP_ENUMERATE))
 	    {
 		sprop->attrs &= ~JSPROP_ENUMERATE;
+		SCOPE_NEW_SHAPE(cx, scope);
 	    }
 	}
     }
@@ -996,6 +999,8 @@ fun_finalize(JSContext *cx, JSObject *obj)
 	return;
     if (fun->script)
 	js_DestroyScript(cx, fun->script);
+    if (fun->lazy)
+	js_DestroyLazyFunction(cx, fun->lazy);
     JS_free(cx, fun);
 }
 
@@ -1034,6 +1039,8 @@ fun_xdrObject(JSXDRState *xdr, JSObject **objp)
 	fun = JS_GetPrivate(xdr->cx, *objp);
 	if (!fun)
 	    return JS_TRUE;
+	if (!FUN_COMPILE_LAZY(xdr->cx, fun))
+	    return JS_FALSE;
 	atomstr = fun->atom ? ATOM_TO_STRING(fun->atom) : NULL;
     } else {
 	fun = js_NewFunction(xdr->cx, NULL, NULL, 0, 0, NULL, NULL);
@@ -1732,9 +1739,134 @@ js_NewFunction(JSContext *cx, JSObject *funobj, JSNative call, uintN nargs,
     fun->atom = atom;
     fun->script = NULL;
     fun->clasp = NULL;
+    fun->lazy = NULL;
     return fun;
 }
 
+#ifdef JS_THREADSAFE
+/*
+ * Claim fun's lazy body for compilation by this thread, waiting while another
+ * thread compiles it.  Return null if that thread succeeded, so fun->script
+ * is ready.  The wait drops our request, in case the compile must run the GC.
+ */
+static JSLazyFunction *
+ClaimLazyFunction(JSContext *cx, JSFunction *fun)
+{
+    JSRuntime *rt;
+    JSLazyFunction *lazy;
+
+    rt = cx->runtime;
+    JS_LOCK_GC(rt);
+    while ((lazy = fun->lazy) != NULL && lazy->compiling) {
+	if (cx->requestDepth) {
+	    JS_ASSERT(rt->requestCount > 0);
+	    rt->requestCount--;
+	    JS_NOTIFY_REQUEST_DONE(rt);
+	}
+	JS_WAIT_CONDVAR(rt->lazyDone, JS_NO_TIMEOUT);
+	if (cx->requestDepth) {
+	    while (rt->gcLevel > 0)
+		JS_AWAIT_GC_DONE(rt);
+	    rt->requestCount++;
+	}
+    }
+    if (lazy)
+	lazy->compiling = JS_TRUE;
+    JS_UNLOCK_GC(rt);
+    return lazy;
+}
+
+/*
+ * Release the claim taken by ClaimLazyFunction, publishing the compiled body
+ * if ok, and wake any threads waiting for it.
+ */
+static void
+ReleaseLazyFunction(JSContext *cx, JSFunction *fun, JSBool ok)
+{
+    JSRuntime *rt;
+
+    rt = cx->runtime;
+    JS_LOCK_GC(rt);
+    fun->lazy->compiling = JS_FALSE;
+    if (ok)
+	fun->lazy = NULL;
+    JS_NOTIFY_ALL_CONDVAR(rt->lazyDone);
+    JS_UNLOCK_GC(rt);
+}
+#else
+#define ClaimLazyFunction(cx, fun)          ((fun)->lazy)
+#define ReleaseLazyFunction(cx, fun, ok)    ((ok) ? (void)((fun)->lazy = NULL)\
+					          : (void)0)
+#endif
+
+JSBool
+js_CompileLazyFunction(JSContext *cx, JSFunction *fun)
+{
+    JSLazyFunction *lazy;
+    void *mark;
+    JSTokenStream *ts;
+    JSStackFrame *fp, frame;
+    JSVersion version;
+    jsbytecode jsop_eq, jsop_ne;
+    JSBool ok;
+
+    lazy = ClaimLazyFunction(cx, fun);
+    if (!lazy) {
+	JS_ASSERT(fun->script);
+	return JS_TRUE;
+    }
+    JS_ASSERT(!fun->script && fun->object);
+    mark = JS_ARENA_MARK(&cx->tempPool);
+    ts = js_NewTokenStream(cx, lazy->chars, lazy->length, lazy->filename,
+			   lazy->lineno, lazy->principals);
+    if (!ts) {
+	JS_ARENA_RELEASE(&cx->tempPool, mark);
+	ReleaseLazyFunction(cx, fun, JS_FALSE);
+	return JS_FALSE;
+    }
+
+    /*
+     * Compile in the scope and with the version in effect when the enclosing
+     * script was compiled, not those of our caller.
+     */
+    fp = cx->fp;
+    memset(&frame, 0, sizeof frame);
+    frame.scopeChain = OBJ_GET_PARENT(cx, fun->object);
+    frame.down = fp;
+    cx->fp = &frame;
+    version = cx->version;
+    jsop_eq = cx->jsop_eq;
+    jsop_ne = cx->jsop_ne;
+    cx->version = lazy->version;
+    cx->jsop_eq = lazy->jsop_eq;
+    cx->jsop_ne = lazy->jsop_ne;
+
+    ok = js_CompileFunctionBody(cx, ts, fun);
+
+    cx->version = version;
+    cx->jsop_eq = jsop_eq;
+    cx->jsop_ne = jsop_ne;
+    cx->fp = fp;
+    if (!js_CloseTokenStream(cx, ts))
+	ok = JS_FALSE;
+    JS_ARENA_RELEASE(&cx->tempPool, mark);
+    ReleaseLazyFunction(cx, fun, ok);
+    if (!ok)
+	return JS_FALSE;
+    js_DestroyLazyFunction(cx, lazy);
+    return JS_TRUE;
+}
+
+void
+js_DestroyLazyFunction(JSContext *cx, JSLazyFunction *lazy)
+{
+    if (lazy->principals)
+	JSPRINCIPALS_DROP(cx, lazy->principals);
+    JS_free(cx, lazy->filename);
+    free(lazy->chars);          /* from js_FinishSourceCapture's realloc */
+    JS_free(cx, lazy);
+}
+
 JSBool
 js_LinkFunctionObject(JSContext *cx, JSFunction *fun, JSObject *object)
 {
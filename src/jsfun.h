@@ -39,8 +39,36 @@ struct JSFunction {
     JSScript     *script;       /* interpreted bytecode descriptor or null */
     JSClass      *clasp;        /* this function is a constructor for objects 
                                  * of this class */
+    JSLazyFunction *lazy;       /* body source if not yet compiled, or null */
 };
 
+/*
+ * Source for a function whose body was only syntax-checked when its enclosing
+ * script was compiled.  The body is compiled into fun->script on first call,
+ * or when anything else (the decompiler, XDR, the debugger) needs the script.
+ * The formal parameters and local variables were already defined on
+ * fun->object by the syntax check.
+ */
+struct JSLazyFunction {
+    jschar       *chars;        /* body source between the braces, malloc'd */
+    size_t       length;        /* number of jschars at chars */
+    char         *filename;     /* copy of the script's filename, or null */
+    uintN        lineno;        /* line number of the opening brace */
+    JSPrincipals *principals;   /* principals for the enclosing script */
+    JSVersion    version;       /* cx->version when the script was compiled */
+    jsbytecode   jsop_eq;       /* and the equality ops for that version */
+    jsbytecode   jsop_ne;
+    JSBool       compiling;     /* a thread is compiling chars, see jsfun.c */
+};
+
+/*
+ * Compile fun's body if it was deferred.  Return false with an error reported
+ * if compilation fails, leaving fun->lazy set so a later call may retry.
+ * Only one thread compiles a given function; others wait for its script.
+ */
+#define FUN_COMPILE_LAZY(cx, fun)                                             \
+    (!(fun)->lazy || js_CompileLazyFunction(cx, fun))
+
 extern JSClass js_ArgumentsClass;
 extern JSClass js_CallClass;
 extern JSClass js_ClosureClass;
@@ -100,6 +128,12 @@ js_GetArgsObject(JSContext *cx, JSStackFrame *fp);
 extern JSBool
 js_PutArgsObject(JSContext *cx, JSStackFrame *fp);
 
+extern JSBool
+js_CompileLazyFunction(JSContext *cx, JSFunction *fun);
+
+extern void
+js_DestroyLazyFunction(JSContext *cx, JSLazyFunction *lazy);
+
 extern JSBool
 js_XDRFunction(JSXDRState *xdr, JSObject **objp);
 
@@ -27,6 +27,7 @@
  * XXX swizzle page to freelist for better locality of reference
  */
 #include "jsstddef.h"
+#include <stdio.h>
 #include <stdlib.h>     /* for free, called by JS_ARENA_DESTROY */
 #include <string.h>	/* for memset, called by jsarena.h macros if DEBUG */
 #include "jstypes.h"
@@ -42,6 +43,7 @@
 #include "jslock.h"
 #include "jsnum.h"
 #include "jsobj.h"
+#include "jsprf.h"
 #include "jsscope.h"
 #include "jsscript.h"
 #include "jsstr.h"
@@ -56,6 +58,7 @@
 #define GC_ROOTS_SIZE	256		/* SWAG, small enough to amortize */
 
 static JSHashNumber   gc_hash_root(const void *key);
+static void           gc_destroy_heap_profile(JSHeapProfile *prof);
 
 struct JSGCThing {
     JSGCThing       *next;
@@ -139,6 +142,10 @@ js_FinishGC(JSRuntime *rt)
     JS_HashTableDestroy(rt->gcRootsHash);
     rt->gcRootsHash = NULL;
     rt->gcFreeList = NULL;
+    if (rt->heapProfile) {
+	gc_destroy_heap_profile(rt->heapProfile);
+	rt->heapProfile = NULL;
+    }
 }
 
 JSBool
@@ -165,6 +172,404 @@ js_RemoveRoot(JSContext *cx, void *rp)
     return JS_TRUE;
 }
 
+/*
+ * Heap profile, see JS_SetHeapProfiling.  One in rate allocations maps its
+ * thing to the allocation site, named "file:line type" after the innermost
+ * scripted frame, in the samples table.  After marking, each GC walks the
+ * heap: it forgets samples that are garbage, and counts the things and bytes
+ * still live, by site for samples and by class (or type, for things other
+ * than objects) for all things.
+ */
+typedef struct JSHeapSite {
+    char                *name;
+    uint32              samples;        /* sampled allocations */
+    uint32              live;           /* sampled things live at last GC */
+    size_t              liveBytes;      /* bytes of those things */
+} JSHeapSite;
+
+typedef struct JSHeapClass {
+    const char          *name;
+    uint32              live;           /* things live at last GC */
+    size_t              liveBytes;      /* bytes of those things */
+} JSHeapClass;
+
+struct JSHeapProfile {
+    uint32              rate;           /* mean allocations per sample */
+    uint32              countdown;      /* allocations until the next sample */
+    uint32              seed;           /* state for randomizing countdown */
+    uint32              ndropped;       /* samples lost to lack of memory */
+    uint32              gcNumber;       /* rt->gcNumber of the last walk */
+    JSHashTable         *sites;         /* site name => JSHeapSite */
+    JSHashTable         *samples;       /* sampled thing => JSHeapSite */
+    JSHashTable         *classes;       /* JSClass or type => JSHeapClass */
+};
+
+static const char *gc_type_names[GCX_NTYPES] = {
+    "object", "string", "double", "decimal"
+};
+
+/*
+ * Draw the number of allocations until the next sample uniformly from 1 to
+ * 2 * rate - 1, so that samples do not fall in step with a loop that makes
+ * the same number of allocations in each iteration.
+ */
+static void
+gc_reset_countdown(JSHeapProfile *prof)
+{
+    prof->seed = prof->seed * 1103515245 + 12345;
+    prof->countdown = 1 + (prof->seed >> 8) % (2 * prof->rate - 1);
+}
+
+static void
+gc_sample_thing(JSContext *cx, JSHeapProfile *prof, void *thing, uintN flags)
+{
+    JSStackFrame *fp;
+    JSScript *script;
+    const char *type;
+    char *name;
+    JSHashNumber keyHash;
+    JSHashEntry **hep, *he;
+    JSHeapSite *site;
+
+    gc_reset_countdown(prof);
+    type = gc_type_names[flags & GCF_TYPEMASK];
+    for (fp = cx->fp; fp && !(fp->script && fp->pc); fp = fp->down)
+	continue;
+    if (fp) {
+	script = fp->script;
+	name = JS_smprintf("%s:%u %s",
+			   script->filename ? script->filename : "<unknown>",
+			   js_PCToLineNumber(script, fp->pc), type);
+    } else {
+	name = JS_smprintf("(no script) %s", type);
+    }
+    if (!name)
+	goto bad;
+
+    keyHash = JS_HashString(name);
+    hep = JS_HashTableRawLookup(prof->sites, keyHash, name);
+    he = *hep;
+    if (he) {
+	JS_smprintf_free(name);
+	site = he->value;
+    } else {
+	site = (JSHeapSite *) calloc(1, sizeof(JSHeapSite));
+	if (!site) {
+	    JS_smprintf_free(name);
+	    goto bad;
+	}
+	site->name = name;
+	if (!JS_HashTableRawAdd(prof->sites, hep, keyHash, name, site)) {
+	    JS_smprintf_free(name);
+	    free(site);
+	    goto bad;
+	}
+    }
+    if (!JS_HashTableAdd(prof->samples, thing, site))
+	goto bad;
+    site->samples++;
+    return;
+
+bad:
+    prof->ndropped++;
+}
+
+/* Return the bytes held by thing, including its slots or characters. */
+static size_t
+gc_thing_size(void *thing, uintN type)
+{
+    size_t nbytes;
+    JSObject *obj;
+    JSObjectMap *map;
+    uint32 nslots;
+
+    nbytes = sizeof(JSGCThing) + sizeof(uint8);
+    switch (type) {
+      case GCX_OBJECT:
+	obj = (JSObject *)thing;
+	map = obj->map;
+	if (obj->slots && map) {
+	    nslots = (MAP_IS_NATIVE(map) && ((JSScope *)map)->object != obj)
+		     ? JS_INITIAL_NSLOTS
+		     : map->nslots;
+	    nbytes += nslots * sizeof(jsval);
+	}
+	break;
+      case GCX_STRING:
+	if (((JSString *)thing)->chars)
+	    nbytes += (((JSString *)thing)->length + 1) * sizeof(jschar);
+	break;
+    }
+    return nbytes;
+}
+
+static intN
+gc_clear_site(JSHashEntry *he, intN i, void *arg)
+{
+    JSHeapSite *site;
+
+    site = he->value;
+    site->live = 0;
+    site->liveBytes = 0;
+    return HT_ENUMERATE_NEXT;
+}
+
+static intN
+gc_clear_class(JSHashEntry *he, intN i, void *arg)
+{
+    JSHeapClass *hc;
+
+    hc = he->value;
+    hc->live = 0;
+    hc->liveBytes = 0;
+    return HT_ENUMERATE_NEXT;
+}
+
+/*
+ * Count thing, which is live if marked or locked, in the heap profile, and
+ * forget it if it is a sampled thing about to be finalized.
+ */
+static void
+gc_profile_thing(JSHeapProfile *prof, void *thing, uintN flags)
+{
+    uintN type;
+    JSBool live;
+    JSHashEntry **hep, *he;
+    size_t nbytes;
+    const void *key;
+    JSClass *clasp;
+    JSHeapSite *site;
+    JSHeapClass *hc;
+
+    type = flags & GCF_TYPEMASK;
+    live = (flags & (GCF_MARK | GCF_LOCKMASK)) != 0;
+    hep = JS_HashTableRawLookup(prof->samples, JS_HashPointer(thing), thing);
+    he = *hep;
+    if (!live) {
+	if (he)
+	    JS_HashTableRawRemove(prof->samples, hep, he);
+	return;
+    }
+
+    nbytes = gc_thing_size(thing, type);
+    if (he) {
+	site = he->value;
+	site->live++;
+	site->liveBytes += nbytes;
+    }
+
+    /* Key objects by class, other things by their type name. */
+    clasp = NULL;
+    if (type == GCX_OBJECT && ((JSObject *)thing)->slots) {
+	clasp = (JSClass *)
+		JSVAL_TO_PRIVATE(((JSObject *)thing)->slots[JSSLOT_CLASS]);
+    }
+    key = clasp ? (const void *)clasp : (const void *)gc_type_names[type];
+    hep = JS_HashTableRawLookup(prof->classes, JS_HashPointer(key), key);
+    he = *hep;
+    if (he) {
+	hc = he->value;
+    } else {
+	hc = (JSHeapClass *) calloc(1, sizeof(JSHeapClass));
+	if (!hc)
+	    return;
+	hc->name = clasp ? clasp->name : gc_type_names[type];
+	if (!JS_HashTableRawAdd(prof->classes, hep, JS_HashPointer(key), key,
+				hc)) {
+	    free(hc);
+	    return;
+	}
+    }
+    hc->live++;
+    hc->liveBytes += nbytes;
+}
+
+static intN
+gc_free_value(JSHashEntry *he, intN i, void *arg)
+{
+    free(he->value);
+    return HT_ENUMERATE_REMOVE;
+}
+
+static intN
+gc_free_site(JSHashEntry *he, intN i, void *arg)
+{
+    JSHeapSite *site;
+
+    site = he->value;
+    JS_smprintf_free(site->name);
+    free(site);
+    return HT_ENUMERATE_REMOVE;
+}
+
+static void
+gc_destroy_heap_profile(JSHeapProfile *prof)
+{
+    if (prof->samples)
+	JS_HashTableDestroy(prof->samples);
+    if (prof->sites) {
+	JS_HashTableEnumerateEntries(prof->sites, gc_free_site, NULL);
+	JS_HashTableDestroy(prof->sites);
+    }
+    if (prof->classes) {
+	JS_HashTableEnumerateEntries(prof->classes, gc_free_value, NULL);
+	JS_HashTableDestroy(prof->classes);
+    }
+    free(prof);
+}
+
+JSBool
+js_SetHeapProfiling(JSContext *cx, uint32 rate)
+{
+    JSRuntime *rt;
+    JSHeapProfile *prof, *oldprof;
+
+    rt = cx->runtime;
+    prof = NULL;
+    if (rate != 0) {
+	prof = (JSHeapProfile *) calloc(1, sizeof(JSHeapProfile));
+	if (!prof)
+	    goto bad;
+	prof->rate = rate;
+	prof->seed = rt->gcNumber;
+	gc_reset_countdown(prof);
+	prof->sites = JS_NewHashTable(64, JS_HashString, JS_CompareCStrings,
+				      JS_CompareValues, NULL, NULL);
+	prof->samples = JS_NewHashTable(256, JS_HashPointer, JS_CompareValues,
+					JS_CompareValues, NULL, NULL);
+	prof->classes = JS_NewHashTable(32, JS_HashPointer, JS_CompareValues,
+					JS_CompareValues, NULL, NULL);
+	if (!prof->sites || !prof->samples || !prof->classes) {
+	    gc_destroy_heap_profile(prof);
+	    goto bad;
+	}
+    }
+
+    JS_LOCK_GC(rt);
+    oldprof = rt->heapProfile;
+    rt->heapProfile = prof;
+    JS_UNLOCK_GC(rt);
+    if (oldprof)
+	gc_destroy_heap_profile(oldprof);
+    return JS_TRUE;
+
+bad:
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+}
+
+typedef struct HeapDumpArgs {
+    void                **vector;
+    uint32              length;
+} HeapDumpArgs;
+
+static intN
+gc_collect_value(JSHashEntry *he, intN i, void *arg)
+{
+    HeapDumpArgs *args;
+
+    args = arg;
+    args->vector[args->length++] = he->value;
+    return HT_ENUMERATE_NEXT;
+}
+
+static int
+gc_compare_sites(const void *v1, const void *v2)
+{
+    const JSHeapSite *s1, *s2;
+
+    s1 = *(const JSHeapSite **)v1;
+    s2 = *(const JSHeapSite **)v2;
+    if (s1->liveBytes != s2->liveBytes)
+	return (s1->liveBytes < s2->liveBytes) ? 1 : -1;
+    if (s1->samples != s2->samples)
+	return (s1->samples < s2->samples) ? 1 : -1;
+    return strcmp(s1->name, s2->name);
+}
+
+static int
+gc_compare_classes(const void *v1, const void *v2)
+{
+    const JSHeapClass *c1, *c2;
+
+    c1 = *(const JSHeapClass **)v1;
+    c2 = *(const JSHeapClass **)v2;
+    if (c1->liveBytes != c2->liveBytes)
+	return (c1->liveBytes < c2->liveBytes) ? 1 : -1;
+    return strcmp(c1->name, c2->name);
+}
+
+/* Collect the values of table into a new vector, sorted by cmp. */
+static JSBool
+gc_sort_values(JSHashTable *table, int (*cmp)(const void *, const void *),
+	       HeapDumpArgs *args)
+{
+    args->length = 0;
+    args->vector = malloc(JS_MAX(table->nentries, 1) * sizeof(void *));
+    if (!args->vector)
+	return JS_FALSE;
+    JS_HashTableEnumerateEntries(table, gc_collect_value, args);
+    qsort(args->vector, args->length, sizeof(void *), cmp);
+    return JS_TRUE;
+}
+
+JSBool
+js_DumpHeapProfile(JSContext *cx, FILE *fp)
+{
+    JSRuntime *rt;
+    JSHeapProfile *prof;
+    HeapDumpArgs sites, classes;
+    JSHeapSite *site;
+    JSHeapClass *hc;
+    uint32 i, rate;
+
+    rt = cx->runtime;
+    if (!rt->heapProfile)
+	return JS_TRUE;
+    js_ForceGC(cx);
+
+    JS_LOCK_GC(rt);
+    prof = rt->heapProfile;
+    sites.vector = classes.vector = NULL;
+    if (!gc_sort_values(prof->sites, gc_compare_sites, &sites) ||
+	!gc_sort_values(prof->classes, gc_compare_classes, &classes)) {
+	JS_UNLOCK_GC(rt);
+	free(sites.vector);
+	JS_ReportOutOfMemory(cx);
+	return JS_FALSE;
+    }
+
+    /* Scale sampled counts by rate to estimate all things from each site. */
+    rate = prof->rate;
+    fprintf(fp, "Heap at GC %lu, sampling 1 in %lu allocations",
+	    (unsigned long)prof->gcNumber, (unsigned long)rate);
+    if (prof->ndropped)
+	fprintf(fp, " (%lu samples dropped)", (unsigned long)prof->ndropped);
+    fprintf(fp, ":\n\n%10s %10s %12s  %s\n",
+	    "allocs", "live", "live bytes", "allocation site (estimated)");
+    for (i = 0; i < sites.length; i++) {
+	site = sites.vector[i];
+	fprintf(fp, "%10lu %10lu %12lu  %s\n",
+		(unsigned long)site->samples * rate,
+		(unsigned long)site->live * rate,
+		(unsigned long)site->liveBytes * rate,
+		site->name);
+    }
+    fprintf(fp, "\n%10s %12s  %s\n", "live", "live bytes", "class");
+    for (i = 0; i < classes.length; i++) {
+	hc = classes.vector[i];
+	if (hc->live == 0)
+	    continue;
+	fprintf(fp, "%10lu %12lu  %s\n",
+		(unsigned long)hc->live, (unsigned long)hc->liveBytes,
+		hc->name);
+    }
+    JS_UNLOCK_GC(rt);
+    free(sites.vector);
+    free(classes.vector);
+    return JS_TRUE;
+}
+
 void *
 js_AllocGCThing(JSContext *cx, uintN flags)
 {
@@ -213,6 +618,9 @@ retry:
     *flagp = (uint8)flags;
     rt->gcBytes += sizeof(JSGCThing) + sizeof(uint8);
     cx->newborn[flags & GCF_TYPEMASK] = thing;
+    cx->gcAllocCount++;
+    if (rt->heapProfile && --rt->heapProfile->countdown == 0)
+	gc_sample_thing(cx, rt->heapProfile, thing, flags);
 
     /*
      * Clear thing before unlocking in case a GC run is about to scan it,
@@ -629,6 +1037,7 @@ js_GC(JSContext *cx)
     JSGCThing *thing, *final, **flp, **oflp;
     GCFinalizeOp finalizer;
     JSBool a_all_clear, f_all_clear;
+    JSHeapProfile *prof;
 
     /*
      * XXX kludge for pre-ECMAv2 compile-time switch case expr eval, see
@@ -710,6 +1119,8 @@ js_GC(JSContext *cx)
 
     /* Drop atoms held by the property cache, and clear property weak links. */
     js_FlushPropertyCache(cx);
+    js_FlushNumberStrings(cx);
+    js_FlushEnumCache(rt);
 restart:
     rt->gcNumber++;
 
@@ -780,6 +1191,12 @@ restart:
     ma = cx->tempPool.current;
     mark = JS_ARENA_MARK(&cx->tempPool);
     js_SweepAtomState(&rt->atomState);
+    prof = rt->heapProfile;
+    if (prof) {
+	JS_HashTableEnumerateEntries(prof->sites, gc_clear_site, NULL);
+	JS_HashTableEnumerateEntries(prof->classes, gc_clear_class, NULL);
+	prof->gcNumber = rt->gcNumber;
+    }
     fa = rt->gcFlagsPool.first.next;
     flagp = (uint8 *)fa->base;
     for (a = rt->gcArenaPool.first.next; a; a = a->next) {
@@ -795,6 +1212,8 @@ restart:
 		flagp = (uint8 *)fa->base;
 	    }
 	    flags = *flagp;
+	    if (prof && !(flags & GCF_FINAL))
+		gc_profile_thing(prof, thing, flags);
 	    if (flags & GCF_MARK) {
 		*flagp &= ~GCF_MARK;
 	    } else if (!(flags & (GCF_LOCKMASK | GCF_FINAL))) {
@@ -21,6 +21,7 @@
 /*
  * JS Garbage Collector.
  */
+#include <stdio.h>
 #include "jspubtd.h"
 
 JS_BEGIN_EXTERN_C
@@ -77,6 +78,13 @@ js_ForceGC(JSContext *cx);
 extern void
 js_GC(JSContext *cx);
 
+/* Heap profiling, see JS_SetHeapProfiling. */
+extern JSBool
+js_SetHeapProfiling(JSContext *cx, uint32 rate);
+
+extern JSBool
+js_DumpHeapProfile(JSContext *cx, FILE *fp);
+
 #ifdef JS_GCMETER
 
 typedef struct JSGCStats {
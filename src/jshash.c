@@ -448,3 +448,16 @@ JS_CompareValues(const void *v1, const void *v2)
 {
     return v1 == v2;
 }
+
+JS_EXPORT_API(JSHashNumber)
+JS_HashPointer(const void *key)
+{
+    /* Drop the low bits, which are clear in aligned addresses. */
+    return (JSHashNumber)((JSUword)key >> 2);
+}
+
+JS_EXPORT_API(intN)
+JS_CompareCStrings(const void *v1, const void *v2)
+{
+    return strcmp((const char *)v1, (const char *)v2) == 0;
+}
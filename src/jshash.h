@@ -126,6 +126,14 @@ JS_HashString(const void *key);
 JS_EXTERN_API(intN)
 JS_CompareValues(const void *v1, const void *v2);
 
+/* Address hash function, for tables keyed by pointer. */
+JS_EXTERN_API(JSHashNumber)
+JS_HashPointer(const void *key);
+
+/* Compare C strings, for tables hashed with JS_HashString. */
+JS_EXTERN_API(intN)
+JS_CompareCStrings(const void *v1, const void *v2);
+
 JS_END_EXTERN_C
 
 #endif /* jshash_h___ */
@@ -21,8 +21,12 @@
  */
 #include "jsstddef.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef XP_UNIX
+#include <time.h>
+#endif
 #include "jstypes.h"
 #include "jsarena.h" /* Added by JSIFY */
 #include "jsutil.h" /* Added by JSIFY */
@@ -38,12 +42,14 @@
 #include "jsgc.h"
 #include "jsinterp.h"
 #include "jslock.h"
+#include "jslong.h"
 #include "jsnum.h"
 #include "jsobj.h"
 #include "jsopcode.h"
 #include "jsscope.h"
 #include "jsscript.h"
 #include "jsstr.h"
+#include "prmjtime.h"
 
 void
 js_FlushPropertyCache(JSContext *cx)
@@ -51,6 +57,7 @@ js_FlushPropertyCache(JSContext *cx)
     JSPropertyCache *cache;
 
     cache = &cx->runtime->propertyCache;
+    cache->generation++;
     if (cache->empty)
 	return;
     memset(cache->table, 0, sizeof cache->table);
@@ -67,6 +74,7 @@ js_FlushPropertyCacheByProp(JSContext *cx, JSProperty *prop)
     JSProperty *pce_prop;
 
     cache = &cx->runtime->propertyCache;
+    cache->generation++;
     if (cache->empty)
 	return;
 
@@ -88,6 +96,95 @@ js_FlushPropertyCacheByProp(JSContext *cx, JSProperty *prop)
     cache->empty = empty;
 }
 
+/*
+ * Look up the JSOP_GNAME family cache entry for the name op at pc, which names
+ * id.  On a hit, set *objp to the object binding id when the scope chain head
+ * is head, and return its own property for id with *objp locked.
+ */
+static JSScopeProperty *
+TestGNameCache(JSContext *cx, jsbytecode *pc, JSObject *head, jsid id,
+	       JSObject **objp)
+{
+    JSGNameCacheEntry *gce;
+    JSObject *obj;
+    uintN n;
+    JSScopeProperty *sprop;
+
+    gce = &cx->gnameCache[GNAME_CACHE_HASH(pc)];
+    if (gce->pc != pc || gce->head != head ||
+	gce->generation != cx->runtime->propertyCache.generation) {
+	return NULL;
+    }
+    if (gce->nguards) {
+	if (OBJ_GET_PARENT(cx, head) != gce->object)
+	    return NULL;
+	for (n = 0, obj = head; n < gce->nguards;
+	     n++, obj = OBJ_GET_PROTO(cx, obj)) {
+	    if (!obj ||
+		obj->map != gce->guards[n].map ||
+		((JSScope *)obj->map)->proptail != gce->guards[n].proptail) {
+		return NULL;
+	    }
+	}
+	if (obj)
+	    return NULL;
+    }
+
+    /*
+     * Re-check the generation with obj locked: a flush on another thread
+     * after the test above may have let sprop be destroyed.
+     */
+    obj = gce->object;
+    JS_LOCK_OBJ(cx, obj);
+    if (gce->generation != cx->runtime->propertyCache.generation) {
+	JS_UNLOCK_OBJ(cx, obj);
+	return NULL;
+    }
+    sprop = gce->sprop;
+    if (!sprop->symbols || sym_id(sprop->symbols) != id) {
+	JS_UNLOCK_OBJ(cx, obj);
+	return NULL;
+    }
+    *objp = obj;
+    return sprop;
+}
+
+/*
+ * Remember that obj's own property sprop bound the name at pc when the scope
+ * chain head was head, if obj is head or head's parent.  Call with obj
+ * unlocked, passing the property cache generation from before obj's lock was
+ * dropped, so that an entry made stale by a racing delete is never valid.
+ */
+static void
+FillGNameCache(JSContext *cx, jsbytecode *pc, JSObject *head, JSObject *obj,
+	       JSScopeProperty *sprop, uint32 generation)
+{
+    JSGNameCacheEntry *gce;
+    uintN n;
+    JSObject *pobj;
+
+    gce = &cx->gnameCache[GNAME_CACHE_HASH(pc)];
+    gce->pc = NULL;
+    n = 0;
+    if (head != obj) {
+	if (OBJ_GET_PARENT(cx, head) != obj)
+	    return;
+	for (pobj = head; pobj; pobj = OBJ_GET_PROTO(cx, pobj)) {
+	    if (n == GNAME_CACHE_GUARDS || !OBJ_IS_NATIVE(pobj))
+		return;
+	    gce->guards[n].map = pobj->map;
+	    gce->guards[n].proptail = ((JSScope *)pobj->map)->proptail;
+	    n++;
+	}
+    }
+    gce->pc = pc;
+    gce->head = head;
+    gce->object = obj;
+    gce->sprop = sprop;
+    gce->generation = generation;
+    gce->nguards = n;
+}
+
 /*
  * Class for for/in loop property iterator objects.
  */
@@ -415,6 +512,8 @@ js_Invoke(JSContext *cx, uintN argc, JSBool constructing)
     JSBool ok;
     JSInterpreterHook hook;
     void *hookData;
+    JSBool profiled;
+    JSProfiledCall call;
 
     /* Reach under args and this to find the callable on the stack. */
     fp = cx->fp;
@@ -500,6 +599,15 @@ have_fun:
 	}
     }
 
+    /* Compile the function's body if that was deferred until its first call. */
+    if (fun && fun->lazy) {
+	if (!js_CompileLazyFunction(cx, fun)) {
+	    ok = JS_FALSE;
+	    goto out2;
+	}
+	script = fun->script;
+    }
+
     /* Initialize most of frame, except for thisp and scopeChain. */
     frame.callobj = frame.argsobj = NULL;
     frame.script = script;
@@ -574,6 +682,7 @@ have_fun:
     /* init these now in case we goto out before first hook call */
     hook = cx->runtime->callHook;
     hookData = NULL;
+    profiled = JS_FALSE;
 
     /* Check for missing arguments expected by the function. */
     nslots = (intN)((argc < minargs) ? minargs - argc : 0);
@@ -643,6 +752,8 @@ have_fun:
     /* call the hook if present */
     if (hook && (native || script))
         hookData = hook(cx, &frame, JS_TRUE, 0, cx->runtime->callHookData);
+    if (cx->runtime->callProfiling && (native || script))
+	profiled = js_BeginProfiledCall(cx, &frame, &call);
 
     /* Call the function, either a native method or an interpreted script. */
     if (native) {
@@ -675,6 +786,8 @@ have_fun:
     }
 
 out:
+    if (profiled)
+	js_EndProfiledCall(cx, &call);
     if (hook && hookData)
         hook(cx, &frame, JS_FALSE, &ok, hookData);
 #if JS_HAS_CALL_OBJECT
@@ -755,6 +868,8 @@ js_Execute(JSContext *cx, JSObject *chain, JSScript *script, JSFunction *fun,
     JSBool ok;
     JSInterpreterHook hook;
     void *hookData;
+    JSBool profiled;
+    JSProfiledCall call;
 
     hook = cx->runtime->executeHook;
     hookData = NULL;
@@ -811,9 +926,13 @@ js_Execute(JSContext *cx, JSObject *chain, JSScript *script, JSFunction *fun,
     cx->fp = &frame;
     if (hook)
         hookData = hook(cx, &frame, JS_TRUE, 0, cx->runtime->executeHookData);
+    profiled = cx->runtime->callProfiling &&
+	       js_BeginProfiledCall(cx, &frame, &call);
 
     ok = js_Interpret(cx, result);
 
+    if (profiled)
+	js_EndProfiledCall(cx, &call);
     if (hook && hookData)
         hook(cx, &frame, JS_FALSE, &ok, hookData);
     cx->fp = oldfp;
@@ -827,6 +946,269 @@ js_Execute(JSContext *cx, JSObject *chain, JSScript *script, JSFunction *fun,
     return ok;
 }
 
+/*
+ * Call profile state.  Entries are found by script, or by native for native
+ * functions, and frames with the same js_DescribeFrame name share an entry,
+ * so that evals of the same source and re-created scripts add up.  Enabling
+ * again empties the profile and bumps generation, so that calls begun before
+ * do not credit the new profile's entries.
+ */
+struct JSCallProfile {
+    JSCallProfileEntry  *entries;
+    uint32              length;
+    uint32              generation;
+    JSHashTable         *keys;          /* script or native => entry index */
+    JSHashTable         *names;         /* entry name => entry index */
+};
+
+/* Return elapsed time in nanoseconds since some fixed point. */
+static jsdouble
+CallProfileNow(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (jsdouble)ts.tv_sec * 1e9 + (jsdouble)ts.tv_nsec;
+#else
+    jsdouble d;
+
+    JSLL_L2D(d, PRMJ_Now());
+    return d * 1e3;
+#endif
+}
+
+/*
+ * Map fp's script or native to its entry index, adding an entry the first
+ * time its name is seen.  Return -1 if fp has neither or memory runs out.
+ */
+static int32
+GetCallProfileIndex(JSCallProfile *prof, JSStackFrame *fp)
+{
+    const void *key;
+    JSFunction *fun;
+    JSHashEntry **hep, *he, **nhep;
+    JSHashNumber nameHash;
+    JSCallProfileEntry *entries, *entry;
+    char *name;
+    uint32 index;
+
+    fun = fp->fun;
+    if (fp->script)
+	key = fp->script;
+    else if (fun && fun->call)
+	key = (const void *)fun->call;
+    else
+	return -1;
+
+    hep = JS_HashTableRawLookup(prof->keys, JS_HashPointer(key), key);
+    he = *hep;
+    if (he)
+	return (int32)(jsword)he->value;
+
+    name = js_DescribeFrame(fp);
+    if (!name)
+	return -1;
+    nameHash = JS_HashString(name);
+    nhep = JS_HashTableRawLookup(prof->names, nameHash, name);
+    he = *nhep;
+    if (he) {
+	JS_smprintf_free(name);
+	index = (uint32)(jsword)he->value;
+    } else {
+	if ((prof->length & (prof->length - 1)) == 0) {
+	    entries = (JSCallProfileEntry *)
+		      realloc(prof->entries,
+			      (prof->length ? 2 * prof->length : 1) *
+			      sizeof(JSCallProfileEntry));
+	    if (!entries) {
+		JS_smprintf_free(name);
+		return -1;
+	    }
+	    prof->entries = entries;
+	}
+	index = prof->length;
+	if (!JS_HashTableRawAdd(prof->names, nhep, nameHash, name,
+				(void *)(jsword)index)) {
+	    JS_smprintf_free(name);
+	    return -1;
+	}
+	entry = &prof->entries[prof->length++];
+	memset(entry, 0, sizeof *entry);
+	entry->name = name;
+    }
+    if (!JS_HashTableRawAdd(prof->keys, hep, JS_HashPointer(key), key,
+			    (void *)(jsword)index)) {
+	return -1;
+    }
+    return (int32)index;
+}
+
+JSBool
+js_BeginProfiledCall(JSContext *cx, JSStackFrame *fp, JSProfiledCall *call)
+{
+    JSRuntime *rt;
+    JSCallProfile *prof;
+    int32 index;
+
+    rt = cx->runtime;
+    JS_LOCK_RUNTIME(rt);
+    prof = rt->callProfile;
+    index = (prof && rt->callProfiling) ? GetCallProfileIndex(prof, fp) : -1;
+    if (index >= 0)
+	call->generation = prof->generation;
+    JS_UNLOCK_RUNTIME(rt);
+    if (index < 0)
+	return JS_FALSE;
+
+    call->index = (uint32)index;
+    call->allocCount = cx->gcAllocCount;
+    call->calleeAllocs = cx->calleeAllocs;
+    call->calleeTime = cx->calleeTime;
+    cx->calleeAllocs = 0;
+    cx->calleeTime = 0;
+    call->start = CallProfileNow();
+    return JS_TRUE;
+}
+
+void
+js_EndProfiledCall(JSContext *cx, JSProfiledCall *call)
+{
+    jsdouble time;
+    uint32 allocs;
+    JSRuntime *rt;
+    JSCallProfile *prof;
+    JSCallProfileEntry *entry;
+
+    time = CallProfileNow() - call->start;
+    allocs = cx->gcAllocCount - call->allocCount;
+
+    rt = cx->runtime;
+    JS_LOCK_RUNTIME(rt);
+    prof = rt->callProfile;
+    if (prof && prof->generation == call->generation) {
+	entry = &prof->entries[call->index];
+	entry->calls++;
+	entry->totalAllocs += allocs;
+	entry->selfAllocs += allocs - cx->calleeAllocs;
+	entry->totalTime += time;
+	entry->selfTime += time - cx->calleeTime;
+    }
+    JS_UNLOCK_RUNTIME(rt);
+
+    /* Charge this call in full to the caller's callees. */
+    cx->calleeAllocs = call->calleeAllocs + allocs;
+    cx->calleeTime = call->calleeTime + time;
+}
+
+static void
+ClearCallProfile(JSCallProfile *prof)
+{
+    uint32 i;
+
+    for (i = 0; i < prof->length; i++)
+	JS_smprintf_free(prof->entries[i].name);
+    free(prof->entries);
+    prof->entries = NULL;
+    prof->length = 0;
+}
+
+static void
+DestroyCallProfile(JSCallProfile *prof)
+{
+    ClearCallProfile(prof);
+    if (prof->keys)
+	JS_HashTableDestroy(prof->keys);
+    if (prof->names)
+	JS_HashTableDestroy(prof->names);
+    free(prof);
+}
+
+JSBool
+js_SetCallProfiling(JSContext *cx, JSBool enable)
+{
+    JSRuntime *rt;
+    JSCallProfile *prof;
+    JSHashTable *keys, *names;
+
+    rt = cx->runtime;
+    if (!enable) {
+	rt->callProfiling = JS_FALSE;
+	return JS_TRUE;
+    }
+
+    keys = JS_NewHashTable(64, JS_HashPointer, JS_CompareValues,
+			   JS_CompareValues, NULL, NULL);
+    names = JS_NewHashTable(64, JS_HashString, JS_CompareCStrings,
+			    JS_CompareValues, NULL, NULL);
+    prof = NULL;
+    JS_LOCK_RUNTIME(rt);
+    if (keys && names) {
+	prof = rt->callProfile;
+	if (!prof) {
+	    prof = (JSCallProfile *) calloc(1, sizeof(JSCallProfile));
+	    rt->callProfile = prof;
+	}
+    }
+    if (prof) {
+	ClearCallProfile(prof);
+	if (prof->keys) {
+	    JS_HashTableDestroy(prof->keys);
+	    JS_HashTableDestroy(prof->names);
+	}
+	prof->keys = keys;
+	prof->names = names;
+	prof->generation++;
+	rt->callProfiling = JS_TRUE;
+    }
+    JS_UNLOCK_RUNTIME(rt);
+    if (!prof) {
+	if (keys)
+	    JS_HashTableDestroy(keys);
+	if (names)
+	    JS_HashTableDestroy(names);
+	JS_ReportOutOfMemory(cx);
+	return JS_FALSE;
+    }
+    return JS_TRUE;
+}
+
+JSCallProfileEntry *
+js_GetCallProfile(JSRuntime *rt, uint32 *countp)
+{
+    JSCallProfile *prof;
+
+    prof = rt->callProfile;
+    if (!prof) {
+	*countp = 0;
+	return NULL;
+    }
+    *countp = prof->length;
+    return prof->entries;
+}
+
+void
+js_ForgetCallProfileScript(JSRuntime *rt, JSScript *script)
+{
+    JSCallProfile *prof;
+
+    JS_LOCK_RUNTIME(rt);
+    prof = rt->callProfile;
+    if (prof)
+	JS_HashTableRemove(prof->keys, script);
+    JS_UNLOCK_RUNTIME(rt);
+}
+
+void
+js_FinishCallProfile(JSRuntime *rt)
+{
+    rt->callProfiling = JS_FALSE;
+    if (rt->callProfile) {
+	DestroyCallProfile(rt->callProfile);
+	rt->callProfile = NULL;
+    }
+}
+
 #if JS_HAS_EXPORT_IMPORT
 /*
  * If id is JSVAL_VOID, import all exported properties from obj.
@@ -947,6 +1329,84 @@ out:
 }
 #endif /* JS_HAS_EXPORT_IMPORT */
 
+#ifdef JS_OPMETER
+
+/*
+ * Opcode and fall-through opcode pair counts, for choosing the sequences
+ * that js_FuseBytecode turns into superinstructions.  These are global and
+ * unlocked, as they are for tuning only.
+ */
+static uint32 opcount[JSOP_LIMIT];
+static uint32 succeeds[JSOP_LIMIT][JSOP_LIMIT];
+
+#define METER_OP_PAIR(op1, op2)                                               \
+    JS_BEGIN_MACRO                                                            \
+	opcount[op2]++;                                                       \
+	if ((op1) != JSOP_LIMIT)                                              \
+	    succeeds[op1][op2]++;                                             \
+    JS_END_MACRO
+
+typedef struct OpPair {
+    uint32      count;
+    JSOp        op1;
+    JSOp        op2;
+} OpPair;
+
+static int
+CompareOpPairs(const void *p1, const void *p2)
+{
+    const OpPair *pair1 = p1, *pair2 = p2;
+
+    return (pair1->count < pair2->count) - (pair1->count > pair2->count);
+}
+
+void
+js_DumpOpMeters(FILE *fp, uintN npairs)
+{
+    uint32 total, pairtotal;
+    uintN i, j, n;
+    OpPair *pairs;
+
+    total = 0;
+    for (i = 0; i < JSOP_LIMIT; i++)
+	total += opcount[i];
+    pairs = malloc(JSOP_LIMIT * JSOP_LIMIT * sizeof *pairs);
+    if (!total || !pairs) {
+	free(pairs);
+	return;
+    }
+    n = 0;
+    pairtotal = 0;
+    for (i = 0; i < JSOP_LIMIT; i++) {
+	for (j = 0; j < JSOP_LIMIT; j++) {
+	    if (succeeds[i][j] == 0)
+		continue;
+	    pairs[n].count = succeeds[i][j];
+	    pairs[n].op1 = (JSOp)i;
+	    pairs[n].op2 = (JSOp)j;
+	    pairtotal += succeeds[i][j];
+	    n++;
+	}
+    }
+    qsort(pairs, n, sizeof *pairs, CompareOpPairs);
+    fprintf(fp, "\nOpcode pair statistics (%lu ops, %lu fall-through pairs):\n",
+	    (unsigned long)total, (unsigned long)pairtotal);
+    for (i = 0; i < n && i < npairs; i++) {
+	fprintf(fp, "%10lu %5.2f%%  %-12s %s\n",
+		(unsigned long)pairs[i].count,
+		100.0 * pairs[i].count / total,
+		js_CodeSpec[pairs[i].op1].name,
+		js_CodeSpec[pairs[i].op2].name);
+    }
+    free(pairs);
+}
+
+#else
+
+#define METER_OP_PAIR(op1, op2) /* nothing */
+
+#endif /* JS_OPMETER */
+
 #if !defined XP_PC || !defined _MSC_VER || _MSC_VER > 800
 #define MAX_INTERP_LEVEL 1000
 #else
@@ -966,7 +1426,11 @@ js_Interpret(JSContext *cx, jsval *result)
     jsval *sp, *newsp;
     void *mark;
     jsbytecode *pc, *pc2, *endpc;
+    uint32 *pcCounts;
     JSOp op, op2;
+#ifdef JS_OPMETER
+    JSOp prevop;
+#endif
     JSCodeSpec *cs;
     JSAtom *atom;
     uintN argc, slot;
@@ -977,6 +1441,7 @@ js_Interpret(JSContext *cx, jsval *result)
     jsval iter_state;
     JSProperty *prop;
     JSScopeProperty *sprop;
+    uint32 generation;
     JSString *str, *str2, *str3;
     size_t length, length2, length3;
     jschar *chars;
@@ -1036,6 +1501,7 @@ js_Interpret(JSContext *cx, jsval *result)
 
     pc = script->code;
     endpc = pc + script->length;
+    pcCounts = script->pcCounts;
     len = -1;
 
     /*
@@ -1050,10 +1516,36 @@ js_Interpret(JSContext *cx, jsval *result)
     }
     newsp += depth;
     fp->sp = sp = newsp;
+#ifdef JS_OPMETER
+    prevop = JSOP_LIMIT;
+#endif
+
+/*
+ * Execute a superinstruction as the base op it was fused over, which runs the
+ * rest of its sequence one op at a time.
+ */
+#define UNFUSE_OP() {                                                         \
+    op = JOF_UNFUSE(cs->format);                                              \
+    cs = &js_CodeSpec[op];                                                    \
+    len = cs->length;                                                         \
+}
+
+/*
+ * Step from one op of a superinstruction's sequence to the next, so that any
+ * error or decompiled value generator refers to the op that actually ran.
+ */
+#define FUSED_NEXT(nextlen) {                                                 \
+    pc += len;                                                                \
+    fp->pc = pc;                                                              \
+    len = nextlen;                                                            \
+}
 
     while (pc < endpc) {
 	fp->pc = pc;
 	op = (JSOp)*pc;
+	METER_OP_PAIR(prevop, op);
+	if (pcCounts)
+	    pcCounts[PTRDIFF(pc, script->code, jsbytecode)]++;
       do_op:
 	cs = &js_CodeSpec[op];
 	len = cs->length;
@@ -1063,6 +1555,8 @@ js_Interpret(JSContext *cx, jsval *result)
 	if (tracefp) {
 	    intN nuses, n;
 
+	    if (cs->format & JOF_FUSED)
+		UNFUSE_OP();
 	    fprintf(tracefp, "%4u: ", js_PCToLineNumber(script, pc));
 	    js_Disassemble1(cx, script, pc, pc - script->code, JS_FALSE,
 			    tracefp);
@@ -1087,6 +1581,8 @@ js_Interpret(JSContext *cx, jsval *result)
 	    JSTrapHandler handler = rt->interruptHandler;
 	    /* check copy of pointer for safety in multithreaded situation */
 	    if (handler) {
+		if (cs->format & JOF_FUSED)
+		    UNFUSE_OP();
 		switch (handler(cx, script, pc, &rval,
 				rt->interruptHandlerData)) {
 		  case JSTRAP_ERROR:
@@ -1461,7 +1957,12 @@ js_Interpret(JSContext *cx, jsval *result)
 }
 
 #if JS_BUG_SET_ENUMERATE
-#define SET_ENUMERATE_ATTR(sprop) ((sprop)->attrs |= JSPROP_ENUMERATE)
+/* NB: uses obj, the object owning sprop, from its lexical environment. */
+#define SET_ENUMERATE_ATTR(sprop)                                             \
+    (((sprop)->attrs & JSPROP_ENUMERATE)                                      \
+     ? (void)0                                                                \
+     : ((sprop)->attrs |= JSPROP_ENUMERATE,                                   \
+	(void)SCOPE_NEW_SHAPE(cx, (JSScope *)obj->map)))
 #else
 #define SET_ENUMERATE_ATTR(sprop) ((void)0)
 #endif
@@ -1519,6 +2020,30 @@ js_Interpret(JSContext *cx, jsval *result)
 	    PUSH_OPND(OBJECT_TO_JSVAL(obj));
 	    break;
 
+	  case JSOP_BINDGNAME:
+	    atom = GET_ATOM(cx, script, pc);
+	    id   = (jsid)atom;
+
+	    sprop = TestGNameCache(cx, pc, fp->scopeChain, id, &obj);
+	    if (sprop) {
+		JS_UNLOCK_OBJ(cx, obj);
+		PUSH_OPND(OBJECT_TO_JSVAL(obj));
+		break;
+	    }
+
+	    SAVE_SP(fp);
+	    ok = js_FindVariable(cx, id, &obj, &obj2, &prop);
+	    if (!ok)
+		goto out;
+	    generation = rt->propertyCache.generation;
+	    OBJ_DROP_PROPERTY(cx, obj2, prop);
+	    if (obj2 == obj && OBJ_IS_NATIVE(obj)) {
+		FillGNameCache(cx, pc, fp->scopeChain, obj,
+			       (JSScopeProperty *)prop, generation);
+	    }
+	    PUSH_OPND(OBJECT_TO_JSVAL(obj));
+	    break;
+
 	  case JSOP_SETNAME2:
 	    atom = GET_ATOM(cx, script, pc);
 	    id   = (jsid)atom;
@@ -1532,6 +2057,55 @@ js_Interpret(JSContext *cx, jsval *result)
 	    PUSH_OPND(rval);
 	    break;
 
+	  case JSOP_SETGNAME:
+	    atom = GET_ATOM(cx, script, pc);
+	    id   = (jsid)atom;
+	    rval = POP();
+	    lval = POP();
+	    JS_ASSERT(!JSVAL_IS_PRIMITIVE(lval));
+	    obj  = JSVAL_TO_OBJECT(lval);
+
+	    /*
+	     * Store straight into the slot if nothing js_SetProperty would do
+	     * first applies: no setter, no readonly, no assign() hack.
+	     */
+	    sprop = TestGNameCache(cx, pc, obj, id, &obj);
+	    if (sprop) {
+		if (sprop->setter == JS_PropertyStub &&
+		    !(sprop->attrs & (JSPROP_READONLY | JSPROP_ASSIGNHACK)) &&
+		    (JSVERSION_IS_ECMA(cx->version) ||
+		     !JSVAL_IS_OBJECT(LOCKED_OBJ_GET_SLOT(obj, sprop->slot)))) {
+		    SET_ENUMERATE_ATTR(sprop);
+		    GC_POKE(cx, NULL);  /* second arg ignored! */
+		    LOCKED_OBJ_SET_SLOT(obj, sprop->slot, rval);
+		    JS_UNLOCK_OBJ(cx, obj);
+		    PUSH_OPND(rval);
+		    break;
+		}
+		JS_UNLOCK_OBJ(cx, obj);
+	    }
+
+	    /* Refill unless the entry was current but its property unfit. */
+	    cond = !sprop && OBJ_IS_NATIVE(obj);
+	    CACHED_SET(OBJ_SET_PROPERTY(cx, obj, id, &rval));
+	    if (!ok)
+		goto out;
+	    if (cond) {
+		ok = OBJ_LOOKUP_PROPERTY(cx, obj, id, &obj2, &prop);
+		if (!ok)
+		    goto out;
+		if (prop) {
+		    generation = rt->propertyCache.generation;
+		    OBJ_DROP_PROPERTY(cx, obj2, prop);
+		    if (obj2 == obj) {
+			FillGNameCache(cx, pc, obj, obj,
+				       (JSScopeProperty *)prop, generation);
+		    }
+		}
+	    }
+	    PUSH_OPND(rval);
+	    break;
+
 #define INTEGER_OP(OP, EXTRA_CODE) {                                          \
     SAVE_SP(fp);                                                              \
     ok = PopInt(cx, &j) && PopInt(cx, &i);                                    \
@@ -2143,6 +2717,7 @@ js_Interpret(JSContext *cx, jsval *result)
 	    break;
 
 	  case JSOP_GETPROP:
+	  do_getprop:
 	    /* Get an immediate atom naming the property. */
 	    atom = GET_ATOM(cx, script, pc);
 	    id   = (jsid)atom;
@@ -2188,10 +2763,40 @@ js_Interpret(JSContext *cx, jsval *result)
 	    obj = NULL;
 	    break;
 
+	  case JSOP_GNAMEGETPROP:
+	    if (pc[len] != JSOP_GETPROP) {
+		UNFUSE_OP();
+		goto do_op;
+	    }
+	    /* fall through */
+
+	  case JSOP_GNAME:
+	    atom = GET_ATOM(cx, script, pc);
+	    id   = (jsid)atom;
+	    sprop = TestGNameCache(cx, pc, fp->scopeChain, id, &obj);
+	    if (sprop) {
+		if (sprop->getter == JS_PropertyStub) {
+		    rval = LOCKED_OBJ_GET_SLOT(obj, sprop->slot);
+		    JS_UNLOCK_OBJ(cx, obj);
+		    PUSH_OPND(rval);
+		    goto end_name;
+		}
+		JS_UNLOCK_OBJ(cx, obj);
+	    }
+	    goto do_name;
+
+	  case JSOP_NAMEGETPROP:
+	    if (pc[len] != JSOP_GETPROP) {
+		UNFUSE_OP();
+		goto do_op;
+	    }
+	    /* fall through */
+
 	  case JSOP_NAME:
 	    atom = GET_ATOM(cx, script, pc);
 	    id   = (jsid)atom;
 
+	  do_name:
 	    ok = js_FindProperty(cx, id, &obj, &obj2, &prop);
 	    if (!ok)
 		goto out;
@@ -2218,7 +2823,7 @@ js_Interpret(JSContext *cx, jsval *result)
 		if (!ok)
 		    goto out;
 		PUSH_OPND(rval);
-		break;
+		goto end_name;
 	    }
 
 	    /* Get and push the obj[id] property's value. */
@@ -2233,8 +2838,19 @@ js_Interpret(JSContext *cx, jsval *result)
 		goto out;
 	    }
 	    LOCKED_OBJ_SET_SLOT(obj2, slot, rval);
+	    cond = (op == JSOP_GNAME || op == JSOP_GNAMEGETPROP) &&
+		   obj2 == obj && sprop->getter == JS_PropertyStub;
+	    generation = rt->propertyCache.generation;
 	    OBJ_DROP_PROPERTY(cx, obj2, prop);
+	    if (cond)
+		FillGNameCache(cx, pc, fp->scopeChain, obj, sprop, generation);
 	    PUSH_OPND(rval);
+
+	  end_name:
+	    if (op == JSOP_NAMEGETPROP || op == JSOP_GNAMEGETPROP) {
+		FUSED_NEXT(js_CodeSpec[JSOP_GETPROP].length);
+		goto do_getprop;
+	    }
 	    break;
 
 	  case JSOP_UINT16:
@@ -2755,6 +3371,115 @@ js_Interpret(JSContext *cx, jsval *result)
 	    break;
 #endif /* JS_HAS_DEBUGGER_KEYWORD */
 
+	  /*
+	   * Superinstructions.  Each checks that the rest of its sequence is
+	   * still in place (a trap may have been set on one of its ops) and that
+	   * its operands suit the fast path, and otherwise unfuses to run the
+	   * sequence one op at a time.
+	   */
+#define RELATIONAL_IFEQ(OP) {                                                 \
+    rval = sp[-1];                                                            \
+    lval = sp[-2];                                                            \
+    if (pc[len] != JSOP_IFEQ ||                                               \
+	!((lval & rval) & JSVAL_INT) ||                                       \
+	lval == JSVAL_VOID || rval == JSVAL_VOID) {                           \
+	UNFUSE_OP();                                                          \
+	goto do_op;                                                           \
+    }                                                                         \
+    sp -= 2;                                                                  \
+    FUSED_NEXT(js_CodeSpec[JSOP_IFEQ].length);                                \
+    if (!(JSVAL_TO_INT(lval) OP JSVAL_TO_INT(rval))) {                        \
+	len = GET_JUMP_OFFSET(pc);                                            \
+	CHECK_BRANCH(len);                                                    \
+    }                                                                         \
+}
+
+	  case JSOP_LTIFEQ:
+	    RELATIONAL_IFEQ(<);
+	    break;
+
+	  case JSOP_LEIFEQ:
+	    RELATIONAL_IFEQ(<=);
+	    break;
+
+	  case JSOP_GTIFEQ:
+	    RELATIONAL_IFEQ(>);
+	    break;
+
+	  case JSOP_GEIFEQ:
+	    RELATIONAL_IFEQ(>=);
+	    break;
+
+#undef RELATIONAL_IFEQ
+
+	  case JSOP_GETVARVAR:
+	  case JSOP_GETVARARG:
+	    op2 = (op == JSOP_GETVARVAR) ? JSOP_GETVAR : JSOP_GETARG;
+	    if (pc[len] != op2) {
+		UNFUSE_OP();
+		goto do_op;
+	    }
+	    obj = NULL;
+	    slot = (uintN)GET_VARNO(pc);
+	    JS_ASSERT(slot < fp->fun->nvars);
+	    PUSH_OPND(fp->vars[slot]);
+	    FUSED_NEXT(js_CodeSpec[op2].length);
+	    slot = (uintN)GET_ARGC(pc);
+	    if (op2 == JSOP_GETVAR) {
+		JS_ASSERT(slot < fp->fun->nvars);
+		PUSH_OPND(fp->vars[slot]);
+	    } else {
+		JS_ASSERT(slot < fp->fun->nargs);
+		PUSH_OPND(fp->argv[slot]);
+	    }
+	    break;
+
+	  case JSOP_INCVARPOP:
+	  case JSOP_VARINCPOP:
+	    /* Bump an int-valued variable in place; the pop discards it. */
+	    slot = (uintN)GET_VARNO(pc);
+	    JS_ASSERT(slot < fp->fun->nvars);
+	    rval = fp->vars[slot];
+	    if (pc[len] != JSOP_POP ||
+		!JSVAL_IS_INT(rval) || rval == INT_TO_JSVAL(JSVAL_INT_MAX)) {
+		UNFUSE_OP();
+		goto do_op;
+	    }
+	    fp->vars[slot] = INT_TO_JSVAL(JSVAL_TO_INT(rval) + 1);
+	    FUSED_NEXT(1);
+	    break;
+
+	  case JSOP_POPGOTO:
+	    if (pc[len] != JSOP_GOTO) {
+		UNFUSE_OP();
+		goto do_op;
+	    }
+	    sp--;
+	    FUSED_NEXT(0);
+	    len = GET_JUMP_OFFSET(pc);
+	    CHECK_BRANCH(len);
+	    break;
+
+	  case JSOP_GETVARADD1:
+	    /* getvar n; one; add; setvar n; pop or popv, for int-valued n. */
+	    slot = (uintN)GET_VARNO(pc);
+	    JS_ASSERT(slot < fp->fun->nvars);
+	    rval = fp->vars[slot];
+	    op2 = (JSOp) pc[8];
+	    if (pc[3] != JSOP_ONE || pc[4] != JSOP_ADD || pc[5] != JSOP_SETVAR ||
+		(op2 != JSOP_POP && op2 != JSOP_POPV) ||
+		!JSVAL_IS_INT(rval) || rval == INT_TO_JSVAL(JSVAL_INT_MAX)) {
+		UNFUSE_OP();
+		goto do_op;
+	    }
+	    obj = NULL;
+	    rval = INT_TO_JSVAL(JSVAL_TO_INT(rval) + 1);
+	    fp->vars[slot] = rval;
+	    if (op2 == JSOP_POPV)
+		*result = rval;
+	    len = 9;
+	    break;
+
 	  default: {
 	    char numBuf[12];
 	    JS_snprintf(numBuf, sizeof numBuf, "%d", op);
@@ -2767,6 +3492,9 @@ js_Interpret(JSContext *cx, jsval *result)
 
     advance_pc:
 	pc += len;
+#ifdef JS_OPMETER
+	prevop = (len == cs->length) ? op : JSOP_LIMIT;
+#endif
 
 #ifdef DEBUG
 	if (tracefp) {
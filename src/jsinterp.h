@@ -121,6 +121,7 @@ typedef struct JSPropertyCache {
     uint32               tests;
     uint32               misses;
     uint32               flushes;
+    uint32               generation;    /* bumped by every flush */
 } JSPropertyCache;
 
 /* Property-not-found lookup results are cached using this invalid pointer. */
@@ -168,6 +169,38 @@ typedef struct JSPropertyCache {
 	}                                                                     \
     JS_END_MACRO
 
+/*
+ * Per-context cache for the name ops emitted outside with statements (see
+ * JSOP_GNAME in jsopcode.tbl), indexed by pc.  An entry records the head of
+ * the scope chain at pc, the object that bound the name, and its own property
+ * for the name.  The binding object is the head itself or, in a function that
+ * has no Call object, the head's parent, and then the head and its prototypes
+ * are guarded: none of them can gain a property without a new map or a new
+ * tail for its property list.  An entry is valid only until the property cache
+ * generation changes, i.e. until a GC or the destruction of any property.
+ */
+#define GNAME_CACHE_LOG2        8
+#define GNAME_CACHE_SIZE        JS_BIT(GNAME_CACHE_LOG2)
+#define GNAME_CACHE_MASK        JS_BITMASK(GNAME_CACHE_LOG2)
+#define GNAME_CACHE_GUARDS      3
+
+#define GNAME_CACHE_HASH(pc)    ((uintN)((jsuword)(pc) & GNAME_CACHE_MASK))
+
+typedef struct JSGNameGuard {
+    JSObjectMap     *map;           /* weak link to searched object's map */
+    JSScopeProperty **proptail;     /* and to the tail of its property list */
+} JSGNameGuard;
+
+typedef struct JSGNameCacheEntry {
+    jsbytecode      *pc;            /* name op that filled this entry */
+    JSObject        *head;          /* weak link to scope chain head at pc */
+    JSObject        *object;        /* weak link to object binding the name */
+    JSScopeProperty *sprop;         /* weak link to object's own property */
+    uint32          generation;     /* property cache generation at fill */
+    uint32          nguards;        /* objects searched before object */
+    JSGNameGuard    guards[GNAME_CACHE_GUARDS];
+} JSGNameCacheEntry;
+
 extern void
 js_FlushPropertyCache(JSContext *cx);
 
@@ -206,4 +239,47 @@ js_Execute(JSContext *cx, JSObject *chain, JSScript *script, JSFunction *fun,
 extern JSBool
 js_Interpret(JSContext *cx, jsval *result);
 
+/*
+ * State of a call being profiled, see JS_SetCallProfiling.  It lives in the
+ * C frame of js_Invoke or js_Execute and holds the callee totals of the
+ * caller, which the call's own callees accumulate in cx meanwhile.
+ */
+typedef struct JSProfiledCall {
+    uint32          index;          /* entry in the runtime's call profile */
+    uint32          generation;     /* profile generation at entry */
+    uint32          allocCount;     /* cx->gcAllocCount at entry */
+    uint32          calleeAllocs;   /* caller's cx->calleeAllocs */
+    jsdouble        start;          /* time at entry in nanoseconds */
+    jsdouble        calleeTime;     /* caller's cx->calleeTime */
+} JSProfiledCall;
+
+extern JSBool
+js_BeginProfiledCall(JSContext *cx, JSStackFrame *fp, JSProfiledCall *call);
+
+extern void
+js_EndProfiledCall(JSContext *cx, JSProfiledCall *call);
+
+extern JSBool
+js_SetCallProfiling(JSContext *cx, JSBool enable);
+
+extern JSCallProfileEntry *
+js_GetCallProfile(JSRuntime *rt, uint32 *countp);
+
+extern void
+js_ForgetCallProfileScript(JSRuntime *rt, JSScript *script);
+
+extern void
+js_FinishCallProfile(JSRuntime *rt);
+
+#ifdef JS_OPMETER
+#include <stdio.h>
+
+/*
+ * Print the npairs most frequent pairs of opcodes executed in sequence, for
+ * choosing superinstructions.
+ */
+extern void
+js_DumpOpMeters(FILE *fp, uintN npairs);
+#endif
+
 #endif /* jsinterp_h___ */
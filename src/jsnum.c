@@ -29,6 +29,7 @@
 #include <string.h>
 #include "jstypes.h"
 #include "jsutil.h" /* Added by JSIFY */
+#include "jshash.h"
 #include "jsdtoa.h"
 #include "jsprf.h"
 #include "jsapi.h"
@@ -37,6 +38,7 @@
 #include "jsconfig.h"
 #include "jsgc.h"
 #include "jsinterp.h"
+#include "jslock.h"
 #include "jsnum.h"
 #include "jsobj.h"
 #include "jsopcode.h"
@@ -422,19 +424,130 @@ js_NumberToObject(JSContext *cx, jsdouble d)
     return obj;
 }
 
+#define DTOSTR_CACHE_HASH(d)                                                  \
+    (((JSDOUBLE_HI32(d) ^ JSDOUBLE_LO32(d)) * JS_GOLDEN_RATIO)                \
+     >> (32 - DTOSTR_CACHE_LOG2))
+
+/*
+ * Return the slot in rt->intStrings for i, allocating its chunk if need be,
+ * or null if that fails.
+ */
+static JSString **
+GetIntStringSlot(JSContext *cx, jsuint i)
+{
+    JSRuntime *rt;
+    JSString **chunk;
+    uintN n;
+
+    rt = cx->runtime;
+    n = (uintN)(i >> NUMBER_STRING_CHUNK_LOG2);
+    chunk = rt->intStrings[n];
+    if (!chunk) {
+	JS_LOCK_RUNTIME(rt);
+	chunk = rt->intStrings[n];
+	if (!chunk) {
+	    chunk = calloc(NUMBER_STRING_CHUNK_SIZE, sizeof(JSString *));
+	    rt->intStrings[n] = chunk;
+	}
+	JS_UNLOCK_RUNTIME(rt);
+	if (!chunk)
+	    return NULL;
+    }
+    return &chunk[i & JS_BITMASK(NUMBER_STRING_CHUNK_LOG2)];
+}
+
+char *
+js_NumberToCString(jsdouble d, char *buf, size_t bufsize)
+{
+    jsint i;
+    jsuint u;
+    char *cp;
+
+    if (JSDOUBLE_IS_INT(d, i)) {
+	/* Format ints backward from the end of buf, without JS_snprintf. */
+	cp = buf + bufsize - 1;
+	*cp = '\0';
+	u = (i < 0) ? 0 - (jsuint)i : (jsuint)i;
+	do {
+	    *--cp = (char)('0' + u % 10);
+	    u /= 10;
+	} while (u != 0);
+	if (i < 0)
+	    *--cp = '-';
+	return cp;
+    }
+    JS_cnvtf(buf, (intN)bufsize, 20, d);
+    return buf;
+}
+
 /* XXXbe rewrite me to be ECMA-based! */
 JSString *
 js_NumberToString(JSContext *cx, jsdouble d)
 {
     jsint i;
     char buf[32];
-
-    if (JSDOUBLE_IS_INT(d, i)) {
-	JS_snprintf(buf, sizeof buf, "%ld", (long)i);
+    JSString *str, **strp;
+    JSDtoStrCacheEntry *entry;
+
+    strp = NULL;
+    entry = NULL;
+    if (JSDOUBLE_IS_INT(d, i) && (jsuint)i < NUMBER_STRING_INTS) {
+	strp = GetIntStringSlot(cx, (jsuint)i);
+	if (strp && (str = *strp) != NULL)
+	    goto hit;
     } else {
-	JS_cnvtf(buf, sizeof buf, 20, d);
+	entry = &cx->dtoStrCache[DTOSTR_CACHE_HASH(d)];
+	if ((str = entry->str) != NULL && entry->d == d)
+	    goto hit;
+    }
+
+    str = JS_NewStringCopyZ(cx, js_NumberToCString(d, buf, sizeof buf));
+    if (!str)
+	return NULL;
+    if (strp) {
+	*strp = str;
+    } else if (entry) {
+	entry->d = d;
+	entry->str = str;
+    }
+    return str;
+
+hit:
+    /* Protect str as if it were new, until the caller roots it. */
+    cx->newborn[GCX_STRING] = (JSGCThing *)str;
+    return str;
+}
+
+void
+js_FlushNumberStrings(JSContext *cx)
+{
+    JSRuntime *rt;
+    JSContext *iter, *acx;
+    uintN n;
+
+    rt = cx->runtime;
+    for (n = 0; n < NUMBER_STRING_CHUNKS; n++) {
+	if (rt->intStrings[n]) {
+	    memset(rt->intStrings[n], 0,
+		   NUMBER_STRING_CHUNK_SIZE * sizeof(JSString *));
+	}
+    }
+    iter = NULL;
+    while ((acx = js_ContextIterator(rt, &iter)) != NULL)
+	memset(acx->dtoStrCache, 0, sizeof acx->dtoStrCache);
+}
+
+void
+js_FinishNumberStrings(JSRuntime *rt)
+{
+    uintN n;
+
+    for (n = 0; n < NUMBER_STRING_CHUNKS; n++) {
+	if (rt->intStrings[n]) {
+	    free(rt->intStrings[n]);
+	    rt->intStrings[n] = NULL;
+	}
     }
-    return JS_NewStringCopyZ(cx, buf);
 }
 
 JSBool
@@ -618,26 +731,151 @@ js_DoubleToInteger(jsdouble d)
 }
 
 
+/*
+ * Powers of ten that are exact doubles, and the bound below which integers
+ * are exact.
+ */
+static const jsdouble exact_tens[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define EXACT_TENS_MAX  22
+#define EXACT_INT_LIMIT 9007199254740992.0      /* 2^53 */
+
+/*
+ * Parse the decimal literal at s the way JS_strtod would, when its digits
+ * fit exactly in a double and its scale is an exact power of ten.  Then the
+ * one multiply or divide that applies the scale rounds correctly (Clinger's
+ * fast path), so there is no need to deflate s or touch dtoa's Bigints.
+ * Return false for anything else, leaving it to JS_strtod.
+ *
+ * Literals of 17 to 19 significant digits could also avoid JS_strtod with
+ * the Eisel-Lemire method, using the 64-bit ULLong that jsdtoa.c already
+ * relies on.  That method needs a table of 128-bit powers of five covering
+ * the whole exponent range, about 10K of constants, plus a fallback for its
+ * ambiguous cases, and the data this path is for rarely has more than 16
+ * digits, so it is left to JS_strtod, which rounds those correctly.
+ */
+static JSBool
+FastStrtod(const jschar *s, const jschar **ep, jsdouble *dp)
+{
+    JSBool negative, digits, point;
+    jsdouble m, t;
+    jsint zeros, fraction, exp10, e;
+    const jschar *s1;
+    jschar c;
+
+    if ((negative = (*s == '-')) != 0 || *s == '+')
+	s++;
+
+    /*
+     * Accumulate the digits in m, holding back runs of zeros until a nonzero
+     * digit follows so that trailing zeros cost nothing.  The value parsed
+     * is then m * 10^(zeros - fraction).
+     */
+    m = 0;
+    zeros = fraction = 0;
+    digits = point = JS_FALSE;
+    for (; ; s++) {
+	c = *s;
+	if (c == '.') {
+	    if (point)
+		break;
+	    point = JS_TRUE;
+	    continue;
+	}
+	if (c < '0' || c > '9')
+	    break;
+	digits = JS_TRUE;
+	if (point)
+	    fraction++;
+	if (c == '0') {
+	    zeros++;
+	    continue;
+	}
+	if (zeros >= EXACT_TENS_MAX)
+	    return JS_FALSE;
+	t = m * exact_tens[zeros + 1] + (c - '0');
+	if (t >= EXACT_INT_LIMIT)
+	    return JS_FALSE;
+	m = t;
+	zeros = 0;
+    }
+    if (!digits)
+	return JS_FALSE;
+    exp10 = zeros - fraction;
+
+    /* An exponent needs at least one digit, else 'e' ends the number. */
+    if (*s == 'e' || *s == 'E') {
+	s1 = s + 1;
+	c = *s1;
+	if (c == '-' || c == '+')
+	    s1++;
+	if (*s1 >= '0' && *s1 <= '9') {
+	    e = 0;
+	    do {
+		if (e < 10000)
+		    e = 10 * e + (*s1 - '0');
+	    } while (*++s1 >= '0' && *s1 <= '9');
+	    exp10 += (c == '-') ? -e : e;
+	    s = s1;
+	}
+    }
+
+    if (m == 0) {
+	/* 0 times any power of ten. */
+    } else if (exp10 > 0) {
+	if (exp10 > EXACT_TENS_MAX) {
+	    /* Move some of the scale into m if it stays exact. */
+	    if (exp10 - EXACT_TENS_MAX > EXACT_TENS_MAX)
+		return JS_FALSE;
+	    m *= exact_tens[exp10 - EXACT_TENS_MAX];
+	    if (m >= EXACT_INT_LIMIT)
+		return JS_FALSE;
+	    exp10 = EXACT_TENS_MAX;
+	}
+	m *= exact_tens[exp10];
+    } else if (exp10 < 0) {
+	if (exp10 < -EXACT_TENS_MAX)
+	    return JS_FALSE;
+	m /= exact_tens[-exp10];
+    }
+
+    *ep = s;
+    *dp = negative ? -m : m;
+    return JS_TRUE;
+}
+
+/* Longest prefix JS_strtod can parse without leaving an automatic buffer. */
+#define STRTOD_BUFFER_SIZE 64
+
 JSBool
 js_strtod(JSContext *cx, const jschar *s, const jschar **ep, jsdouble *dp)
 {
     size_t i;
+    char cbuf[STRTOD_BUFFER_SIZE];
     char *cstr, *istr, *estr;
     JSBool negative;
     jsdouble d;
     const jschar *s1 = js_SkipWhiteSpace(s);
-    size_t length = js_strlen(s1);
+    size_t length;
+
+    if (FastStrtod(s1, ep, dp))
+	return JS_TRUE;
+
+    /* Deflate only as much as could be part of a number. */
+    for (length = 0; s1[length] != 0; length++) {
+	if (s1[length] >> 8 || !strchr("0123456789+-.eEInfity", s1[length]))
+	    break;
+    }
 
-    cstr = malloc(length + 1);
+    cstr = (length < sizeof cbuf) ? cbuf : malloc(length + 1);
     if (!cstr)
 	return JS_FALSE;
-    for (i = 0; i <= length; i++) {
-	if (s1[i] >> 8) {
-	    cstr[i] = 0;
-	    break;
-	}
+    for (i = 0; i < length; i++)
 	cstr[i] = (char)s1[i];
-    }
+    cstr[length] = 0;
 
     istr = cstr;
     if ((negative = (*istr == '-')) != 0 || *istr == '+')
@@ -665,8 +903,9 @@ js_strtod(JSContext *cx, const jschar *s, const jschar **ep, jsdouble *dp)
 #endif
     }
 
-    free(cstr);
     i = estr - cstr;
+    if (cstr != cbuf)
+	free(cstr);
     *ep = i ? s1 + i : s;
     *dp = d;
     return JS_TRUE;
@@ -761,7 +1000,8 @@ js_strtointeger(JSContext *cx, const jschar *s, const jschar **ep, jsint base, j
 	     */
 	    size_t i;
 	    size_t length = s1 - start;
-	    char *cstr = malloc(length + 1);
+	    char cbuf[STRTOD_BUFFER_SIZE];
+	    char *cstr = (length < sizeof cbuf) ? cbuf : malloc(length + 1);
 	    char *estr;
 
 	    if (!cstr)
@@ -774,7 +1014,8 @@ js_strtointeger(JSContext *cx, const jschar *s, const jschar **ep, jsint base, j
 	    value = JS_strtod(cstr, &estr);
 	    if (errno == ERANGE && value == HUGE_VAL)
 		value = *cx->runtime->jsPositiveInfinity;
-	    free(cstr);
+	    if (cstr != cbuf)
+		free(cstr);
 
 	} else if (base == 2 || base == 4 || base == 8 || base == 16 || base == 32) {
 	    /* The number may also be inaccurate for one of these bases.  This
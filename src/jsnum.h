@@ -87,10 +87,46 @@ js_NewNumberValue(JSContext *cx, jsdouble d, jsval *rval);
 extern JSObject *
 js_NumberToObject(JSContext *cx, jsdouble d);
 
-/* Convert a number to a GC'ed string. */
+/*
+ * Number-to-string caches.  Strings for integers in [0, NUMBER_STRING_INTS)
+ * live in a per-runtime table, allocated a chunk at a time on first use.
+ * Other numbers go through a small direct-mapped cache in each context, so
+ * that threads don't share it.  The GC empties both before marking, so they
+ * never keep a string alive.
+ */
+#define NUMBER_STRING_CHUNK_LOG2        8
+#define NUMBER_STRING_CHUNK_SIZE        JS_BIT(NUMBER_STRING_CHUNK_LOG2)
+#define NUMBER_STRING_CHUNKS            256
+#define NUMBER_STRING_INTS              (NUMBER_STRING_CHUNKS *              \
+					 NUMBER_STRING_CHUNK_SIZE)
+
+#define DTOSTR_CACHE_LOG2               6
+#define DTOSTR_CACHE_SIZE               JS_BIT(DTOSTR_CACHE_LOG2)
+
+typedef struct JSDtoStrCacheEntry {
+    jsdouble        d;
+    JSString        *str;
+} JSDtoStrCacheEntry;
+
+/*
+ * Format a number as js_NumberToString would into buf, which should hold at
+ * least 32 chars, and return a pointer to the result within buf.
+ */
+extern char *
+js_NumberToCString(jsdouble d, char *buf, size_t bufsize);
+
+/* Convert a number to a GC'ed string, which may be shared. */
 extern JSString *
 js_NumberToString(JSContext *cx, jsdouble d);
 
+/* Empty the number-to-string caches, for the GC. */
+extern void
+js_FlushNumberStrings(JSContext *cx);
+
+/* Free the runtime's cache when it is destroyed. */
+extern void
+js_FinishNumberStrings(JSRuntime *rt);
+
 /*
  * Convert a value to a number, returning false after reporting any error,
  * otherwise returning true with *dp set.
@@ -362,10 +362,10 @@ js_obj_toSource(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
 {
     JSHashEntry *he;
     JSIdArray *ida;
-    jschar *chars, *ochars, *vchars, *vsharp;
+    jschar *chars, *vchars, *vsharp;
     size_t nchars, vlength, vsharplength;
     JSBool ok;
-    char *comma;
+    JSStringBuffer sb;
     jsint i, length;
     jsid id;
     jsval val;
@@ -387,26 +387,17 @@ js_obj_toSource(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
 	goto make_string;
     }
     JS_ASSERT(ida);
-    ok = JS_TRUE;
 
-    /* Allocate 2 + 1 for "{}" and the terminator. */
-    if (!chars) {
-	chars = malloc((2 + 1) * sizeof(jschar));
-	nchars = 0;
-	if (!chars)
-	    goto error;
-    } else {
+    js_InitStringBuffer(&sb);
+    if (chars) {
+	/* Start with the "#n=" sharp variable definition. */
 	MAKE_SHARP(he);
-	nchars = js_strlen(chars);
-	chars = realloc((ochars = chars), (nchars + 2 + 1) * sizeof(jschar));
-	if (!chars) {
-	    free(ochars);
-	    goto error;
-	}
+	sb.base = chars;
+	sb.limit = sb.ptr = chars + js_strlen(chars);
     }
-    chars[nchars++] = '{';
-
-    comma = NULL;
+    ok = js_AppendChar(cx, &sb, '{');
+    if (!ok)
+	goto error;
 
     for (i = 0, length = ida->length; i < length; i++) {
 	/* Get strings for id and val and GC-root them via argv. */
@@ -467,57 +458,34 @@ js_obj_toSource(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
 	}
 #endif
 
-	/* Allocate 1 + 1 at end for closing brace and terminating 0. */
-	chars = realloc((ochars = chars),
-			(nchars + (comma ? 2 : 0) +
-			 idstr->length + 1 + vsharplength + vlength +
-			 1 + 1) * sizeof(jschar));
-	if (!chars) {
-	    /* Save code space on error: let JS_free ignore null vsharp. */
-	    JS_free(cx, vsharp);
-	    free(ochars);
-	    goto error;
-	}
-
-	if (comma) {
-	    chars[nchars++] = comma[0];
-	    chars[nchars++] = comma[1];
-	}
-	comma = ", ";
-
-	js_strncpy(&chars[nchars], idstr->chars, idstr->length);
-	nchars += idstr->length;
-	chars[nchars++] = ':';
+	ok = (i == 0 || js_AppendCString(cx, &sb, ", ")) &&
+	     js_AppendChars(cx, &sb, idstr->chars, idstr->length) &&
+	     js_AppendChar(cx, &sb, ':') &&
+	     js_AppendChars(cx, &sb, vsharp, vsharplength) &&
+	     js_AppendChars(cx, &sb, vchars, vlength);
 
-	if (vsharplength) {
-	    js_strncpy(&chars[nchars], vsharp, vsharplength);
-	    nchars += vsharplength;
-	}
-	js_strncpy(&chars[nchars], vchars, vlength);
-	nchars += vlength;
-
-	if (vsharp)
-	    JS_free(cx, vsharp);
+	/* Save code space on error: let JS_free ignore null vsharp. */
+	JS_free(cx, vsharp);
+	if (!ok)
+	    goto error;
     }
 
-    if (chars) {
-	chars[nchars++] = '}';
-	chars[nchars] = 0;
-    }
+    ok = js_AppendChar(cx, &sb, '}');
 
 error:
     js_LeaveSharpObject(cx, &ida);
 
-    if (!ok) {
-	if (chars)
-	    free(chars);
-	return ok;
+    if (ok) {
+	str = js_NewStringFromBuffer(cx, &sb);
+	ok = (str != NULL);
     }
-
-    if (!chars) {
-	JS_ReportOutOfMemory(cx);
+    if (!ok) {
+	js_FinishStringBuffer(&sb);
 	return JS_FALSE;
     }
+    *rval = STRING_TO_JSVAL(str);
+    return JS_TRUE;
+
   make_string:
     str = js_NewString(cx, chars, nchars, 0);
     if (!str) {
@@ -1934,7 +1902,10 @@ _readonly:
 
 #if JS_BUG_SET_ENUMERATE
     /* Setting a property makes it enumerable. */
-    sprop->attrs |= JSPROP_ENUMERATE;
+    if (!(sprop->attrs & JSPROP_ENUMERATE)) {
+	sprop->attrs |= JSPROP_ENUMERATE;
+	SCOPE_NEW_SHAPE(cx, scope);
+    }
 #endif
     JS_UNLOCK_OBJ(cx, obj);
     return JS_TRUE;
@@ -1987,6 +1958,7 @@ js_SetAttributes(JSContext *cx, JSObject *obj, jsid id, JSProperty *prop,
     }
     sprop = (JSScopeProperty *)prop;
     sprop->attrs = *attrsp;
+    SCOPE_NEW_SHAPE(cx, (JSScope *)obj->map);
     if (noprop)
 	OBJ_DROP_PROPERTY(cx, obj, prop);
     return JS_TRUE;
@@ -2183,17 +2155,91 @@ js_NewIdArray(JSContext *cx, jsint length)
     return ida;
 }
 
+/*
+ * Enumerable property ids of a native object's scope, in definition order,
+ * shared by the iterators using them and by rt->enumCache.
+ */
+struct JSNativeEnumerator {
+    jsrefcount  nrefs;          /* references, under the runtime lock */
+    uint32      shape;          /* shape of the scope whose ids these are */
+    jsint       length;         /* number of ids */
+    jsid        ids[1];         /* enumerable ids, not null terminated */
+};
+
 /* Private type used to iterate over all properties of a native JS object */
 typedef struct JSNativeIteratorState {
-    jsint next_index;   /* index into jsid array */
-    JSIdArray *ida;     /* All property ids in enumeration */
+    jsint next_index;           /* index into ne->ids */
+    JSNativeEnumerator *ne;     /* ids to enumerate, or null if none */
 } JSNativeIteratorState;
 
+#define ENUM_CACHE_HASH(shape)  ((uintN)(shape) & ENUM_CACHE_MASK)
+
+static void
+DropNativeEnumerator(JSRuntime *rt, JSNativeEnumerator *ne)
+{
+    jsrefcount nrefs;
+
+    if (!ne)
+	return;
+    JS_LOCK_RUNTIME(rt);
+    nrefs = --ne->nrefs;
+    JS_UNLOCK_RUNTIME(rt);
+    if (nrefs == 0)
+	free(ne);
+}
+
+/*
+ * Return the cached enumerator for shape with a new reference, or null if the
+ * cache has none.
+ */
+static JSNativeEnumerator *
+GetCachedNativeEnumerator(JSRuntime *rt, uint32 shape)
+{
+    JSNativeEnumerator *ne;
+
+    JS_LOCK_RUNTIME(rt);
+    ne = rt->enumCache[ENUM_CACHE_HASH(shape)];
+    if (ne && ne->shape == shape)
+	ne->nrefs++;
+    else
+	ne = NULL;
+    JS_UNLOCK_RUNTIME(rt);
+    return ne;
+}
+
+static void
+CacheNativeEnumerator(JSRuntime *rt, JSNativeEnumerator *ne)
+{
+    JSNativeEnumerator **nep, *old;
+
+    JS_LOCK_RUNTIME(rt);
+    ne->nrefs++;
+    nep = &rt->enumCache[ENUM_CACHE_HASH(ne->shape)];
+    old = *nep;
+    *nep = ne;
+    JS_UNLOCK_RUNTIME(rt);
+    DropNativeEnumerator(rt, old);
+}
+
 /*
- * This function is used to enumerate the properties of native JSObjects
- * and those host objects that do not define a JSNewEnumerateOp-style iterator
- * function.
+ * Forget all cached enumerators, at GC time so that no cached id outlives its
+ * atom, and when rt is destroyed.
  */
+void
+js_FlushEnumCache(JSRuntime *rt)
+{
+    uintN n;
+    JSNativeEnumerator *ne;
+
+    for (n = 0; n < ENUM_CACHE_SIZE; n++) {
+	ne = rt->enumCache[n];
+	if (ne) {
+	    rt->enumCache[n] = NULL;
+	    DropNativeEnumerator(rt, ne);
+	}
+    }
+}
+
 JSBool
 js_Enumerate(JSContext *cx, JSObject *obj, JSIterateOp enum_op,
 	     jsval *statep, jsid *idp)
@@ -2204,7 +2250,8 @@ js_Enumerate(JSContext *cx, JSObject *obj, JSIterateOp enum_op,
     JSScopeProperty *sprop;
     jsint i, length;
     JSScope *scope;
-    JSIdArray *ida;
+    uint32 shape;
+    JSNativeEnumerator *ne;
     JSNativeIteratorState *state;
 
     clasp = OBJ_GET_CLASS(cx, obj);
@@ -2217,7 +2264,7 @@ js_Enumerate(JSContext *cx, JSObject *obj, JSIterateOp enum_op,
     case JSENUMERATE_INIT:
 	if (!enumerate(cx, obj))
 	    goto init_error;
-	length = 0;
+	ne = NULL;
 
 	/*
 	 * The set of all property ids is pre-computed when the iterator
@@ -2233,51 +2280,64 @@ js_Enumerate(JSContext *cx, JSObject *obj, JSIterateOp enum_op,
 	 * when the prototype object is enumerated.
 	 */
 	proto_obj = OBJ_GET_PROTO(cx, obj);
-	if (proto_obj && (scope == (JSScope *)proto_obj->map)) {
-	    ida = js_NewIdArray(cx, 0);
-	    if (!ida) {
-	      JS_UNLOCK_OBJ(cx, obj);
-	      goto init_error;
-	    }
-	} else {
-	    /* Object has a private scope; Enumerate all props in scope. */
-	    for (sprop = scope->props; sprop; sprop = sprop->next) {
-		if ((sprop->attrs & JSPROP_ENUMERATE) && sprop->symbols)
-		    length++;
-	    }
-	    ida = js_NewIdArray(cx, length);
-	    if (!ida) {
-		JS_UNLOCK_OBJ(cx, obj);
-		goto init_error;
-	    }
-	    i = 0;
-	    for (sprop = scope->props; sprop; sprop = sprop->next) {
-		if ((sprop->attrs & JSPROP_ENUMERATE) && sprop->symbols) {
-		    JS_ASSERT(i < length);
-		    ida->vector[i++] = sym_id(sprop->symbols);
+	if (!proto_obj || scope != (JSScope *)proto_obj->map) {
+	    /*
+	     * Object has a private scope.  Reuse the ids enumerated for its
+	     * current shape if they are cached, else enumerate all props in
+	     * scope and cache them.
+	     */
+	    shape = scope->shape;
+	    JS_UNLOCK_OBJ(cx, obj);
+	    ne = GetCachedNativeEnumerator(cx->runtime, shape);
+	    JS_LOCK_OBJ(cx, obj);
+	    if (!ne) {
+		length = 0;
+		for (sprop = scope->props; sprop; sprop = sprop->next) {
+		    if ((sprop->attrs & JSPROP_ENUMERATE) && sprop->symbols)
+			length++;
+		}
+		/* Use malloc, not JS_malloc: the last drop may lack a cx. */
+		ne = malloc(sizeof(JSNativeEnumerator) +
+			    (length ? length - 1 : 0) * sizeof(jsid));
+		if (!ne) {
+		    JS_UNLOCK_OBJ(cx, obj);
+		    JS_ReportOutOfMemory(cx);
+		    goto init_error;
 		}
+		ne->nrefs = 1;
+		ne->shape = scope->shape;
+		ne->length = length;
+		i = 0;
+		for (sprop = scope->props; sprop; sprop = sprop->next) {
+		    if ((sprop->attrs & JSPROP_ENUMERATE) && sprop->symbols) {
+			JS_ASSERT(i < length);
+			ne->ids[i++] = sym_id(sprop->symbols);
+		    }
+		}
+		JS_UNLOCK_OBJ(cx, obj);
+		CacheNativeEnumerator(cx->runtime, ne);
+		JS_LOCK_OBJ(cx, obj);
 	    }
 	}
 	JS_UNLOCK_OBJ(cx, obj);
 
 	state = JS_malloc(cx, sizeof(JSNativeIteratorState));
 	if (!state) {
-	    JS_DestroyIdArray(cx, ida);
+	    DropNativeEnumerator(cx->runtime, ne);
 	    goto init_error;
 	}
-	state->ida = ida;
+	state->ne = ne;
 	state->next_index = 0;
 	*statep = PRIVATE_TO_JSVAL(state);
 	if (idp)
-	    *idp = INT_TO_JSVAL(length);
+	    *idp = INT_TO_JSVAL(ne ? ne->length : 0);
 	return JS_TRUE;
 
     case JSENUMERATE_NEXT:
 	state = JSVAL_TO_PRIVATE(*statep);
-	ida = state->ida;
-	length = ida->length;
-	if (state->next_index != length) {
-	    *idp = ida->vector[state->next_index++];
+	ne = state->ne;
+	if (ne && state->next_index != ne->length) {
+	    *idp = ne->ids[state->next_index++];
 	    return JS_TRUE;
 	}
 
@@ -2285,7 +2345,7 @@ js_Enumerate(JSContext *cx, JSObject *obj, JSIterateOp enum_op,
 
     case JSENUMERATE_DESTROY:
 	state = JSVAL_TO_PRIVATE(*statep);
-	JS_DestroyIdArray(cx, state->ida);
+	DropNativeEnumerator(cx->runtime, state->ne);
 	JS_free(cx, state);
 	*statep = JSVAL_NULL;
 	return JS_TRUE;
@@ -151,6 +151,15 @@ extern JS_FRIEND_DATA(JSObjectOps) js_WithObjectOps;
 extern JSClass      js_ObjectClass;
 extern JSClass      js_WithClass;
 
+/*
+ * Property ids enumerated from native objects, cached per runtime by scope
+ * shape (see jsscope.h) so that a for/in loop over an object whose property
+ * set has not changed reuses the ids computed last time.
+ */
+#define ENUM_CACHE_LOG2         6
+#define ENUM_CACHE_SIZE         JS_BIT(ENUM_CACHE_LOG2)
+#define ENUM_CACHE_MASK         JS_BITMASK(ENUM_CACHE_LOG2)
+
 struct JSSharpObjectMap {
     jsrefcount  depth;
     jsatomid    sharpgen;
@@ -279,6 +288,9 @@ extern JSBool
 js_Enumerate(JSContext *cx, JSObject *obj, JSIterateOp enum_op,
 	     jsval *statep, jsid *idp);
 
+extern void
+js_FlushEnumCache(JSRuntime *rt);
+
 extern JSBool
 js_CheckAccess(JSContext *cx, JSObject *obj, jsid id, JSAccessMode mode,
 	       jsval *vp, uintN *attrsp);
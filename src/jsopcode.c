@@ -728,6 +728,13 @@ Decompile(SprintStack *ss, jsbytecode *pc, intN nb)
 		break;
 	      default:;
 	    }
+	} else {
+	    /*
+	     * Superinstructions decompile as the sequence they stand for, and
+	     * cached name ops as their base ops.
+	     */
+	    while (js_CodeSpec[op].format & JOF_FUSED)
+		op = saveop = JOF_UNFUSE(js_CodeSpec[op].format);
 	}
 	cs = &js_CodeSpec[saveop];
 	len = oplen = cs->length;
@@ -2001,7 +2008,11 @@ js_DecompileScript(JSPrinter *jp, JSScript *script)
 JSBool
 js_DecompileFunctionBody(JSPrinter *jp, JSFunction *fun, JSBool newlines)
 {
-    JSScript *script = fun->script;
+    JSScript *script;
+
+    if (!FUN_COMPILE_LAZY(jp->sprinter.context, fun))
+        return JS_FALSE;
+    script = fun->script;
     if (script) {
         JSScope *oldScope, *scope = NULL;
         JSBool ok;
@@ -2028,6 +2039,8 @@ js_DecompileFunction(JSPrinter *jp, JSFunction *fun, JSBool newlines)
     uintN indent;
     intN i;
 
+    if (!FUN_COMPILE_LAZY(jp->sprinter.context, fun))
+	return JS_FALSE;
     if (newlines) {
 	js_puts(jp, "\n");
 	js_printf(jp, "\t");
@@ -62,6 +62,11 @@ typedef enum JSOp {
 #define JOF_POST          0x0400  /* postorder increment or decrement */
 #define JOF_IMPORT        0x0800  /* import property op */
 #define JOF_FOR2          0x1000  /* new for/in loop bytecodes */
+#define JOF_FUSED         0x2000  /* variant of base op in high byte */
+#define JOF_FUSED_SHIFT   24
+
+#define JOF_FUSE(op)      (JOF_FUSED | ((uint32)(op) << JOF_FUSED_SHIFT))
+#define JOF_UNFUSE(fmt)   ((JSOp)((fmt) >> JOF_FUSED_SHIFT))
 
 /*
  * Immediate operand getters, setters, and bounds.
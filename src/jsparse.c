@@ -395,6 +395,50 @@ InWithStatement(JSTreeContext *tc)
     return JS_FALSE;
 }
 
+/*
+ * Save the body source captured by the token stream in fun->lazy, so that
+ * the emitter skips the body and js_Invoke compiles it on first call.  If
+ * the source could not be captured, leave fun->lazy null and let the body
+ * be compiled now.
+ */
+static JSBool
+DeferFunctionBody(JSContext *cx, JSTokenStream *ts, JSFunction *fun,
+		  uintN lineno)
+{
+    jschar *chars;
+    size_t length;
+    JSLazyFunction *lazy;
+
+    if (!js_FinishSourceCapture(ts, &chars, &length))
+	return JS_TRUE;
+    lazy = JS_malloc(cx, sizeof *lazy);
+    if (!lazy) {
+	free(chars);
+	return JS_FALSE;
+    }
+    lazy->chars = chars;
+    lazy->length = length;
+    lazy->filename = NULL;
+    if (ts->filename) {
+	lazy->filename = JS_strdup(cx, ts->filename);
+	if (!lazy->filename) {
+	    free(chars);
+	    JS_free(cx, lazy);
+	    return JS_FALSE;
+	}
+    }
+    lazy->lineno = lineno;
+    lazy->principals = ts->principals;
+    if (lazy->principals)
+	JSPRINCIPALS_HOLD(cx, lazy->principals);
+    lazy->version = cx->version;
+    lazy->jsop_eq = cx->jsop_eq;
+    lazy->jsop_ne = cx->jsop_ne;
+    lazy->compiling = JS_FALSE;
+    fun->lazy = lazy;
+    return JS_TRUE;
+}
+
 static JSParseNode *
 FunctionDef(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc,
 	    JSBool lambda)
@@ -403,11 +447,12 @@ FunctionDef(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc,
     JSAtom *funAtom, *argAtom;
     JSObject *parent;
     JSFunction *fun, *outerFun;
-    JSBool ok, named;
+    JSBool ok, named, lazy;
     JSObject *pobj;
     JSScopeProperty *sprop;
     JSTreeContext funtc;
     jsval junk;
+    void *mark;
 
     /* Make a TOK_FUNCTION node. */
     pn = NewParseNode(cx, &ts->token, PN_FUNC);
@@ -419,6 +464,7 @@ FunctionDef(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc,
 	funAtom = ts->token.t_atom;
     else
 	funAtom = NULL;
+    lazy = JS_FALSE;
 
     /* Find the nearest variable-declaring scope and use it as our parent. */
     parent = js_FindVariableScope(cx, &outerFun);
@@ -510,6 +556,18 @@ FunctionDef(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc,
 			   ok = JS_FALSE; goto out);
     pn->pn_pos.begin = ts->token.pos.begin;
 
+    /*
+     * If compiling lazily, only parse the body of a function not nested in
+     * another function, to check its syntax and define its local variables,
+     * and capture its source for js_CompileLazyFunction.  Functions nested
+     * within it are compiled along with it.
+     */
+    mark = JS_ARENA_MARK(&cx->tempPool);
+    if ((cx->options & JSOPTION_LAZY_FUNCTIONS) &&
+	!(tc->flags & TCF_IN_FUNCTION)) {
+	lazy = js_StartSourceCapture(ts);
+    }
+
     TREE_CONTEXT_INIT(&funtc);
     pn2 = FunctionBody(cx, ts, fun, &funtc);
     if (!pn2) {
@@ -520,6 +578,19 @@ FunctionDef(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc,
     MUST_MATCH_TOKEN_THROW(TOK_RC, JSMSG_CURLY_AFTER_BODY,
 			   ok = JS_FALSE; goto out);
     pn->pn_pos.end = ts->token.pos.end;
+    if (lazy) {
+	lazy = JS_FALSE;
+	if (!DeferFunctionBody(cx, ts, fun, pn->pn_pos.begin.lineno)) {
+	    ok = JS_FALSE;
+	    goto out;
+	}
+	if (fun->lazy) {
+	    /* Free the body's parse nodes, and any token buffer above mark. */
+	    pn2 = NULL;
+	    JS_ARENA_RELEASE(&cx->tempPool, mark);
+	    RESET_TOKENBUF(ts);
+	}
+    }
 
     pn->pn_fun = fun;
     pn->pn_body = pn2;
@@ -537,6 +608,8 @@ FunctionDef(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc,
     ok = JS_TRUE;
 out:
     if (!ok) {
+	if (lazy)
+	    js_CancelSourceCapture(ts);
 	if (named)
 	    (void) OBJ_DELETE_PROPERTY(cx, parent, (jsid)funAtom, &junk);
 	return NULL;
@@ -1579,6 +1652,7 @@ Variables(JSContext *cx, JSTokenStream *ts, JSTreeContext *tc)
 		sprop->setter = currentSetter;
 		sprop->attrs |= JSPROP_ENUMERATE | JSPROP_PERMANENT;
 		sprop->attrs &= ~JSPROP_READONLY;
+		SCOPE_NEW_SHAPE(cx, (JSScope *)obj->map);
 	    }
 	} else {
 	    /*
@@ -2503,7 +2577,8 @@ js_FoldConstants(JSContext *cx, JSParseNode *pn)
 
     switch (pn->pn_arity) {
       case PN_FUNC:
-	if (!js_FoldConstants(cx, pn->pn_body))
+	/* A deferred function body is folded when it is compiled. */
+	if (!pn->pn_fun->lazy && !js_FoldConstants(cx, pn->pn_body))
 	    return JS_FALSE;
 	break;
 
@@ -39,7 +39,8 @@ JS_BEGIN_EXTERN_C
  * -----        -------     -------
  * <Definitions>
  * TOK_FUNCTION func        pn_fun: function, contains arg and var properties
- *                          pn_body: TOK_LC node for function body
+ *                          pn_body: TOK_LC node for function body, or null
+ *                            if pn_fun->lazy (body compiled on first call)
  *                            NB: We define or create the function object at
  *                            parse (not emit) time, in order to specialize arg
  *                            and var bytecodes early.
@@ -43,6 +43,7 @@ typedef uint32 jsatomid;
 /* Struct typedefs. */
 typedef struct JSCodeGenerator  JSCodeGenerator;
 typedef struct JSGCThing        JSGCThing;
+typedef struct JSLazyFunction   JSLazyFunction;
 typedef struct JSParseNode      JSParseNode;
 typedef struct JSSharpObjectMap JSSharpObjectMap;
 typedef struct JSToken          JSToken;
@@ -58,8 +59,13 @@ typedef struct JSAtomList       JSAtomList;
 typedef struct JSAtomListElement JSAtomListElement;
 typedef struct JSAtomMap        JSAtomMap;
 typedef struct JSAtomState      JSAtomState;
+typedef struct JSCallProfile    JSCallProfile;
 typedef struct JSCodeSpec       JSCodeSpec;
+typedef struct JSCoverage       JSCoverage;
+typedef struct JSHeapProfile    JSHeapProfile;
+typedef struct JSNativeEnumerator JSNativeEnumerator;
 typedef struct JSPrinter        JSPrinter;
+typedef struct JSProfiler       JSProfiler;
 typedef struct JSRegExp         JSRegExp;
 typedef struct JSRegExpStatics  JSRegExpStatics;
 typedef struct JSScope          JSScope;
@@ -68,6 +74,7 @@ typedef struct JSScopeProperty  JSScopeProperty;
 typedef struct JSStackFrame     JSStackFrame;
 typedef struct JSSubString      JSSubString;
 typedef struct JSSymbol         JSSymbol;
+typedef struct JSXDRImage       JSXDRImage;
 
 /* "Friend" types used by jscntxt.h and jsdbgapi.h. */
 typedef enum JSTrapStatus {
@@ -78,6 +85,16 @@ typedef enum JSTrapStatus {
     JSTRAP_LIMIT
 } JSTrapStatus;
 
+/* Call profile entry, see JS_SetCallProfiling. */
+typedef struct JSCallProfileEntry {
+    char            *name;          /* js_DescribeFrame name */
+    uint32          calls;          /* number of calls or executions */
+    uint32          totalAllocs;    /* GC things allocated including callees */
+    uint32          selfAllocs;     /* GC things allocated excluding callees */
+    jsdouble        totalTime;      /* nanoseconds including callees */
+    jsdouble        selfTime;       /* nanoseconds excluding callees */
+} JSCallProfileEntry;
+
 #ifndef CRT_CALL
 #ifdef XP_OS2
 #define CRT_CALL _Optlink
@@ -238,6 +238,14 @@ typedef const JSErrorFormatString *
 (* CRT_CALL JSErrorCallback)(void *userRef, const char *locale,
 			     const uintN errorNumber);
 
+/*
+ * Source byte reader for JS_CompileScriptFromReader.  Store at most *lengthp
+ * bytes at buf and set *lengthp to the number stored, or to 0 at the end of
+ * the source.  Return false to abort compilation.
+ */
+typedef JSBool
+(* CRT_CALL JSSourceReader)(void *closure, char *buf, size_t *lengthp);
+
 JS_END_EXTERN_C
 
 #endif /* jspubtd_h___ */
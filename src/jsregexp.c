@@ -1947,6 +1947,24 @@ EmitRegExp(CompilerState *state, RENode *ren, JSRegExp *re)
     return JS_TRUE;
 }
 
+/*
+ * A source string without metachars means exactly itself, so unless case is
+ * folded it can be matched by a plain substring search (MatchFlat) without
+ * parsing or emitting a program.  The parser stops at a NUL, so a source
+ * containing one is left to it.
+ */
+static JSBool
+IsFlatSource(JSString *str)
+{
+    const jschar *cp, *end;
+
+    for (cp = str->chars, end = cp + str->length; cp < end; cp++) {
+	if (*cp == 0 || js_strchr(metachars, *cp))
+	    return JS_FALSE;
+    }
+    return JS_TRUE;
+}
+
 JSRegExp *
 js_NewRegExp(JSContext *cx, JSString *str, uintN flags)
 {
@@ -1956,6 +1974,21 @@ js_NewRegExp(JSContext *cx, JSString *str, uintN flags)
     RENode *ren, *end;
     size_t resize;
 
+    if (!(flags & JSREG_FOLD) && IsFlatSource(str)) {
+	re = JS_malloc(cx, sizeof *re);
+	if (!re)
+	    return NULL;
+	re->nrefs = 1;
+	re->source = str;
+	re->length = 0;
+	re->lastIndex = 0;
+	re->parenCount = 0;
+	re->flags = flags;
+	re->flat = JS_TRUE;
+	(void) js_LockGCThing(cx, str);
+	return re;
+    }
+
     re = NULL;
     mark = JS_ARENA_MARK(&cx->tempPool);
 
@@ -1987,11 +2020,13 @@ js_NewRegExp(JSContext *cx, JSString *str, uintN flags)
     re = JS_malloc(cx, JS_ROUNDUP(resize, sizeof(jsword)));
     if (!re)
 	goto out;
+    re->nrefs = 1;
     re->source = str;
     re->length = state.progLength;
     re->lastIndex = 0;
     re->parenCount = state.parenCount;
     re->flags = flags;
+    re->flat = JS_FALSE;
 
     state.progLength = 0;
     if (!EmitRegExp(&state, ren, re)) {
@@ -2023,8 +2058,8 @@ out:
     return re;
 }
 
-JSRegExp *
-js_NewRegExpOpt(JSContext *cx, JSString *str, JSString *opt)
+static JSBool
+ParseRegExpFlags(JSContext *cx, JSString *opt, uintN *flagsp)
 {
     uintN flags;
     jschar *cp;
@@ -2044,21 +2079,85 @@ js_NewRegExpOpt(JSContext *cx, JSString *str, JSString *opt)
 		charBuf[0] = (char)*cp;
 		JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL,
 				     JSMSG_BAD_FLAG, charBuf);
-		return NULL;
+		return JS_FALSE;
 	      }
 	    }
 	}
     }
+    *flagsp = flags;
+    return JS_TRUE;
+}
+
+JSRegExp *
+js_NewRegExpOpt(JSContext *cx, JSString *str, JSString *opt)
+{
+    uintN flags;
+
+    if (!ParseRegExpFlags(cx, opt, &flags))
+	return NULL;
     return js_NewRegExp(cx, str, flags);
 }
 
+JSRegExp *
+js_NewCachedRegExpOpt(JSContext *cx, JSString *str, JSString *opt)
+{
+    uintN flags, i;
+    JSRegExp **cache, *re;
+
+    if (!ParseRegExpFlags(cx, opt, &flags))
+	return NULL;
+
+    cache = cx->regExpCache;
+    for (i = 0; i < JSREGEXP_CACHE_SIZE && (re = cache[i]) != NULL; i++) {
+	if (re->flags == flags &&
+	    re->source->length == str->length &&
+	    js_CompareStrings(re->source, str) == 0) {
+	    goto hit;
+	}
+    }
+
+    re = js_NewRegExp(cx, str, flags);
+    if (!re)
+	return NULL;
+
+    /* Evict the least recently used regexp if the cache is full. */
+    i = JSREGEXP_CACHE_SIZE - 1;
+    if (cache[i])
+	js_DestroyRegExp(cx, cache[i]);
+    cache[i] = re;
+
+  hit:
+    /* Move re to the front, and give the caller its own reference. */
+    for (; i > 0; i--)
+	cache[i] = cache[i - 1];
+    cache[0] = re;
+    JS_ATOMIC_ADDREF(&re->nrefs, 1);
+    return re;
+}
+
 void
 js_DestroyRegExp(JSContext *cx, JSRegExp *re)
 {
+    JS_ATOMIC_ADDREF(&re->nrefs, -1);
+    if (re->nrefs)
+	return;
     js_UnlockGCThing(cx, re->source);
     JS_free(cx, re);
 }
 
+void
+js_FlushRegExpCache(JSContext *cx)
+{
+    uintN i;
+
+    for (i = 0; i < JSREGEXP_CACHE_SIZE; i++) {
+	if (cx->regExpCache[i]) {
+	    js_DestroyRegExp(cx, cx->regExpCache[i]);
+	    cx->regExpCache[i] = NULL;
+	}
+    }
+}
+
 typedef struct MatchState {
     JSContext       *context;           /* for access to regExpStatics */
     JSBool          anchoring;          /* true if multiline anchoring ^/$ */
@@ -2578,6 +2677,30 @@ MatchRegExp(MatchState *state, jsbytecode *pc, const jschar *cp)
     return cp;
 }
 
+/*
+ * Find the first occurrence of a flat regexp's source at or after cp.
+ */
+static const jschar *
+MatchFlat(MatchState *state, JSString *pat, const jschar *cp)
+{
+    const jschar *pp, *limit;
+    size_t n, j;
+
+    pp = pat->chars;
+    n = pat->length;
+    if ((size_t)(state->cpend - cp) < n)
+	return NULL;
+    for (limit = state->cpend - n; cp <= limit; cp++) {
+	for (j = 0; j < n && cp[j] == pp[j]; j++)
+	    continue;
+	if (j == n) {
+	    state->skipped = PTRDIFF(cp, state->cpbegin + state->start, jschar);
+	    return cp + n;
+	}
+    }
+    return NULL;
+}
+
 JSBool
 js_ExecuteRegExp(JSContext *cx, JSRegExp *re, JSString *str, size_t *indexp,
 		 JSBool test, jsval *rval)
@@ -2638,7 +2761,8 @@ js_ExecuteRegExp(JSContext *cx, JSRegExp *re, JSString *str, size_t *indexp,
      * Call the recursive matcher to do the real work.  Return null on mismatch
      * whether testing or not.  On match, return an extended Array object.
      */
-    cp = MatchRegExp(&state, pc, cp);
+    cp = re->flat ? MatchFlat(&state, re->source, cp)
+                  : MatchRegExp(&state, pc, cp);
     if (!cp) {
 	*rval = JSVAL_NULL;
 	goto out;
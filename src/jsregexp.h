@@ -50,23 +50,46 @@ struct JSRegExpStatics {
      : &js_EmptySubString)
 
 struct JSRegExp {
+    jsrefcount  nrefs;          /* RegExp object or cache references */
     JSString    *source;        /* locked source string, sans // */
-    size_t      length;         /* program length in bytes */
+    size_t      length;         /* program length in bytes, 0 if flat */
     size_t      lastIndex;      /* index after last match, for //g iterator */
     uintN       parenCount;     /* number of parenthesized submatches */
     uint8       flags;          /* flags, see jsapi.h */
+    uint8       flat;           /* source has no metachars, so no program */
     jsbytecode  program[1];     /* regular expression bytecode */
 };
 
+/*
+ * Number of regexps compiled from strings by the String methods that each
+ * context keeps for reuse, most recently used first.
+ */
+#define JSREGEXP_CACHE_SIZE     8
+
 extern JSRegExp *
 js_NewRegExp(JSContext *cx, JSString *str, uintN flags);
 
 extern JSRegExp *
 js_NewRegExpOpt(JSContext *cx, JSString *str, JSString *opt);
 
+/*
+ * Like js_NewRegExpOpt, but share a regexp recently compiled from an equal
+ * source string and flags.  The result's lastIndex is not private to the
+ * caller, so this suits only callers that never keep it, such as the String
+ * methods given a pattern string.  Release the result with js_DestroyRegExp.
+ */
+extern JSRegExp *
+js_NewCachedRegExpOpt(JSContext *cx, JSString *str, JSString *opt);
+
+/*
+ * Drop a reference to re, freeing it when none remain.
+ */
 extern void
 js_DestroyRegExp(JSContext *cx, JSRegExp *re);
 
+extern void
+js_FlushRegExpCache(JSContext *cx);
+
 /*
  * Execute re on input str at *indexp, returning null in *rval on mismatch.
  * On match, return true if test is true, otherwise return an array object.
@@ -43,6 +43,9 @@
 #include "jsopcode.h"
 #include "jsregexp.h"
 #include "jsscan.h"
+#ifdef JS_THREADSAFE
+#include "prinit.h"
+#endif
 
 #define RESERVE_JAVA_KEYWORDS
 #define RESERVE_ECMA_KEYWORDS
@@ -139,12 +142,94 @@ static struct keyword {
     {0}
 };
 
+/*
+ * Keyword recognizer, consulted before an identifier is atomized.  Keywords
+ * are hashed by length and first and last chars into a table of chained
+ * 1-based indexes into keywords[].  With the keyword set above this hash
+ * leaves very few chains longer than one entry.
+ */
+#define KW_HASH_LOG2    7
+#define KW_HASH_SIZE    JS_BIT(KW_HASH_LOG2)
+#define KW_HASH(c0, cn, length)                                               \
+    ((((uintN)(c0) << 2) ^ ((uintN)(cn) << 1) ^ (uintN)(length))              \
+     & JS_BITMASK(KW_HASH_LOG2))
+#define KW_MAX_LENGTH   12              /* strlen("synchronized") */
+
+static uint8 kwhash[KW_HASH_SIZE];
+static uint8 kwchain[sizeof keywords / sizeof keywords[0]];
+
+/*
+ * Link the keywords into their hash chains.  This must run only once: run
+ * again, it would link each chain's head back onto its own chain, making a
+ * cycle that FindKeyword would follow forever.
+ */
+#ifdef JS_THREADSAFE
+static PRCallOnceType kwhashOnce;
+
+static PRStatus
+HashKeywords(void)
+#else
+static JSBool kwhashed;
+
+static void
+HashKeywords(void)
+#endif
+{
+    struct keyword *kw;
+    size_t length;
+    uintN h;
+
+    for (kw = keywords; kw->name; kw++) {
+	length = strlen(kw->name);
+	JS_ASSERT(length <= KW_MAX_LENGTH);
+	h = KW_HASH(kw->name[0], kw->name[length-1], length);
+	kwchain[kw - keywords] = kwhash[h];
+	kwhash[h] = (uint8)(kw - keywords + 1);
+    }
+#ifdef JS_THREADSAFE
+    return PR_SUCCESS;
+#else
+    kwhashed = JS_TRUE;
+#endif
+}
+
+static struct keyword *
+FindKeyword(const jschar *s, size_t length)
+{
+    uintN i;
+    struct keyword *kw;
+    const char *name;
+    size_t n;
+
+    if (length < 2 || length > KW_MAX_LENGTH)
+	return NULL;
+    for (i = kwhash[KW_HASH(s[0], s[length-1], length)]; i;
+	 i = kwchain[i-1]) {
+	kw = &keywords[i-1];
+	name = kw->name;
+	for (n = 0; n < length; n++) {
+	    if ((jschar)(unsigned char)name[n] != s[n])
+		break;
+	}
+	if (n == length && name[n] == '\0')
+	    return kw;
+    }
+    return NULL;
+}
+
 JSBool
 js_InitScanner(JSContext *cx)
 {
     struct keyword *kw;
     JSAtom *atom;
 
+#ifdef JS_THREADSAFE
+    if (PR_CallOnce(&kwhashOnce, HashKeywords) != PR_SUCCESS)
+	return JS_FALSE;
+#else
+    if (!kwhashed)
+	HashKeywords();
+#endif
     for (kw = keywords; kw->name; kw++) {
 	atom = js_Atomize(cx, kw->name, strlen(kw->name), ATOM_PINNED);
 	if (!atom)
@@ -155,6 +240,46 @@ js_InitScanner(JSContext *cx)
     return JS_TRUE;
 }
 
+/*
+ * Atomize the current token's chars, consulting ts->atomCache first so that
+ * identifiers repeated throughout a script skip hashing and the atom lock.
+ */
+static JSAtom *
+AtomizeToken(JSContext *cx, JSTokenStream *ts, const jschar *chars,
+	     size_t length)
+{
+    size_t n;
+    JSHashNumber h;
+    JSAtom **entryp, *atom;
+    JSString *str;
+    uint32 gcNumber;
+
+    gcNumber = cx->runtime->gcNumber;
+    if (ts->atomCacheGCNumber != gcNumber) {
+	memset(ts->atomCache, 0, sizeof ts->atomCache);
+	ts->atomCacheGCNumber = gcNumber;
+    }
+
+    h = (JSHashNumber)length;
+    for (n = 0; n < length; n++)
+	h = (h >> 28) ^ (h << 4) ^ chars[n];
+    entryp = &ts->atomCache[(h ^ (h >> TS_ATOM_CACHE_LOG2))
+			    & TS_ATOM_CACHE_MASK];
+    atom = *entryp;
+    if (atom) {
+	str = ATOM_TO_STRING(atom);
+	if (str->length == length &&
+	    !memcmp(str->chars, chars, length * sizeof(jschar))) {
+	    return atom;
+	}
+    }
+
+    atom = js_AtomizeChars(cx, chars, length, 0);
+    if (atom)
+	*entryp = atom;
+    return atom;
+}
+
 JS_FRIEND_API(void)
 js_MapKeywords(void (*mapfun)(const char *))
 {
@@ -237,11 +362,147 @@ js_NewFileTokenStream(JSContext *cx, const char *filename, FILE *defaultfp)
 }
 #endif /* JSFILE */
 
+#define TS_BYTEBUF_SIZE 4096            /* reader buffer size in bytes */
+
+JS_FRIEND_API(JSTokenStream *)
+js_NewByteTokenStream(JSContext *cx, const char *bytes, size_t length,
+		      JSSourceReader reader, void *readerData, JSBool utf8,
+		      const char *filename, uintN lineno,
+		      JSPrincipals *principals)
+{
+    jschar *base;
+    JSTokenStream *ts;
+
+    JS_ARENA_ALLOCATE(base, &cx->tempPool, JS_LINE_LIMIT * sizeof(jschar));
+    if (!base) {
+	JS_ReportOutOfMemory(cx);
+	return NULL;
+    }
+    ts = js_NewBufferTokenStream(cx, base, JS_LINE_LIMIT);
+    if (!ts)
+	return NULL;
+    ts->userbuf.ptr = ts->userbuf.limit;
+    if (reader) {
+	JS_ARENA_ALLOCATE(ts->bytebuf, &cx->tempPool, TS_BYTEBUF_SIZE);
+	if (!ts->bytebuf) {
+	    JS_ReportOutOfMemory(cx);
+	    return NULL;
+	}
+	bytes = ts->bytebuf;
+	length = 0;
+    }
+    ts->bytes = bytes;
+    ts->byteslimit = bytes + length;
+    ts->reader = reader;
+    ts->readerData = readerData;
+    if (utf8)
+	ts->flags |= TSF_UTF8;
+    ts->filename = filename;
+    ts->lineno = lineno;
+    if (principals)
+	JSPRINCIPALS_HOLD(cx, principals);
+    ts->principals = principals;
+    return ts;
+}
+
+/*
+ * Move any undecoded bytes to the front of ts->bytebuf and fill the rest of
+ * it from ts->reader.  The reader is forgotten once it reports end of input.
+ */
+static JSBool
+ReadBytes(JSTokenStream *ts)
+{
+    size_t left, length;
+
+    left = PTRDIFF(ts->byteslimit, ts->bytes, char);
+    if (left)
+	memmove(ts->bytebuf, ts->bytes, left);
+    length = TS_BYTEBUF_SIZE - left;
+    if (!ts->reader(ts->readerData, ts->bytebuf + left, &length))
+	return JS_FALSE;
+    JS_ASSERT(length <= TS_BYTEBUF_SIZE - left);
+    if (length == 0)
+	ts->reader = NULL;
+    ts->bytes = ts->bytebuf;
+    ts->byteslimit = ts->bytebuf + left + length;
+    return JS_TRUE;
+}
+
+#define UTF8_REPLACEMENT_CHAR   0xFFFD
+
+/*
+ * Decode at most max chars of byte source into ubuf, plus one more if the
+ * last is the second half of a surrogate pair.  Like fgets, stop after a
+ * newline.  Malformed UTF-8 decodes to U+FFFD.  Return the number of chars
+ * stored, 0 at end of input, or -1 if the reader failed.
+ */
+static ptrdiff_t
+DecodeBytes(JSTokenStream *ts, jschar *ubuf, ptrdiff_t max)
+{
+    ptrdiff_t i, avail, n, k;
+    const uint8 *b;
+    uint32 c, min;
+
+    i = 0;
+    while (i < max) {
+	avail = PTRDIFF(ts->byteslimit, ts->bytes, char);
+	if (avail < 4 && ts->reader) {
+	    /* Refill so that no UTF-8 sequence is split across buffers. */
+	    if (!ReadBytes(ts))
+		return -1;
+	    avail = PTRDIFF(ts->byteslimit, ts->bytes, char);
+	}
+	if (avail == 0)
+	    break;
+	b = (const uint8 *) ts->bytes;
+	c = b[0];
+	n = 1;
+	if (c >= 0x80 && (ts->flags & TSF_UTF8)) {
+	    if (c >= 0xF0 && c <= 0xF4) {
+		n = 4, c &= 0x07, min = 0x10000;
+	    } else if (c >= 0xE0 && c <= 0xEF) {
+		n = 3, c &= 0x0F, min = 0x800;
+	    } else if (c >= 0xC2 && c <= 0xDF) {
+		n = 2, c &= 0x1F, min = 0x80;
+	    } else {
+		n = 0;
+	    }
+	    if (n > avail)
+		n = 0;
+	    for (k = 1; k < n; k++) {
+		if ((b[k] & 0xC0) != 0x80) {
+		    n = 0;
+		    break;
+		}
+		c = (c << 6) | (b[k] & 0x3F);
+	    }
+	    if (n == 0 || c < min || c > 0x10FFFF ||
+		(c >= 0xD800 && c <= 0xDFFF)) {
+		c = UTF8_REPLACEMENT_CHAR;
+		n = 1;
+	    }
+	}
+	ts->bytes += n;
+	if (c >= 0x10000) {
+	    c -= 0x10000;
+	    ubuf[i++] = (jschar) (0xD800 + (c >> 10));
+	    c = 0xDC00 + (c & 0x3FF);
+	}
+	ubuf[i++] = (jschar) c;
+	if (c == '\n')
+	    break;
+    }
+    return i;
+}
+
 JS_FRIEND_API(JSBool)
 js_CloseTokenStream(JSContext *cx, JSTokenStream *ts)
 {
+    js_CancelSourceCapture(ts);
     if (ts->principals)
 	JSPRINCIPALS_DROP(cx, ts->principals);
+    if (ts->bytebuf && (ts->flags & TSF_ERROR))
+	return JS_FALSE;
 #ifdef JSFILE
     return !ts->file || fclose(ts->file) == 0;
 #else
@@ -249,6 +510,98 @@ js_CloseTokenStream(JSContext *cx, JSTokenStream *ts)
 #endif
 }
 
+/*
+ * Append length chars to the source being captured.  On allocation failure,
+ * free capbuf and leave TSF_CAPTURE set, so js_FinishSourceCapture fails.
+ */
+static void
+CaptureChars(JSTokenStream *ts, const jschar *chars, size_t length)
+{
+    size_t size;
+    jschar *buf;
+
+    if (!ts->capbuf)
+	return;
+    if (ts->caplength + length > ts->capsize) {
+	size = ts->capsize;
+	while (ts->caplength + length > size)
+	    size += size;
+	buf = realloc(ts->capbuf, size * sizeof(jschar));
+	if (!buf) {
+	    free(ts->capbuf);
+	    ts->capbuf = NULL;
+	    return;
+	}
+	ts->capbuf = buf;
+	ts->capsize = size;
+    }
+    js_strncpy(ts->capbuf + ts->caplength, chars, length);
+    ts->caplength += length;
+}
+
+JSBool
+js_StartSourceCapture(JSTokenStream *ts)
+{
+    jschar *start;
+
+    start = ts->token.ptr + 1;
+    if ((ts->flags & TSF_CAPTURE) ||
+	ts->token.type != TOK_LC ||
+	ts->pushback.type != TOK_EOF ||
+	ts->ungetpos != 0 ||
+	start <= ts->linebuf.base ||
+	start > ts->linebuf.limit ||
+	start[-1] != '{') {
+	return JS_FALSE;
+    }
+    ts->capsize = 2 * JS_LINE_LIMIT;
+    ts->capbuf = malloc(ts->capsize * sizeof(jschar));
+    if (!ts->capbuf)
+	return JS_FALSE;
+    ts->caplength = 0;
+    ts->capseg = -PTRDIFF(start, ts->linebuf.base, jschar);
+    ts->flags |= TSF_CAPTURE;
+    CaptureChars(ts, start, PTRDIFF(ts->linebuf.limit, start, jschar));
+    return JS_TRUE;
+}
+
+JSBool
+js_FinishSourceCapture(JSTokenStream *ts, jschar **charsp, size_t *lengthp)
+{
+    ptrdiff_t end;
+    jschar *chars;
+
+    end = ts->capseg + PTRDIFF(ts->token.ptr, ts->linebuf.base, jschar);
+    if (!ts->capbuf ||
+	ts->token.type != TOK_RC ||
+	ts->pushback.type != TOK_EOF ||
+	ts->token.ptr < ts->linebuf.base ||
+	ts->token.ptr >= ts->linebuf.limit ||
+	end < 0 ||
+	(size_t)end >= ts->caplength ||
+	ts->capbuf[end] != '}') {
+	js_CancelSourceCapture(ts);
+	return JS_FALSE;
+    }
+    /* Trim the buffer, which may have grown well past the body's end. */
+    chars = realloc(ts->capbuf, (end + 1) * sizeof(jschar));
+    *charsp = chars ? chars : ts->capbuf;
+    *lengthp = (size_t)end;
+    ts->capbuf = NULL;
+    ts->flags &= ~TSF_CAPTURE;
+    return JS_TRUE;
+}
+
+void
+js_CancelSourceCapture(JSTokenStream *ts)
+{
+    if (ts->capbuf) {
+	free(ts->capbuf);
+	ts->capbuf = NULL;
+    }
+    ts->flags &= ~TSF_CAPTURE;
+}
+
 static int32
 GetChar(JSTokenStream *ts)
 {
@@ -293,7 +646,34 @@ GetChar(JSTokenStream *ts)
 		    ts->userbuf.ptr = ubuf;
 		} else
 #endif /* JSFILE */
-		{
+		if (ts->bytes) {
+		    /* Decode the next segment of byte source into userbuf. */
+		    JSBool crflag;
+		    jschar *ubuf;
+
+		    crflag = (ts->flags & TSF_CRFLAG) != 0;
+		    ubuf = ts->userbuf.base;
+		    len = DecodeBytes(ts, ubuf + crflag,
+				      JS_LINE_LIMIT - 2 - crflag);
+		    if (len <= 0) {
+			if (len < 0)
+			    ts->flags |= TSF_ERROR;
+			ts->flags |= TSF_EOF;
+			return EOF;
+		    }
+		    if (crflag) {
+			ts->flags &= ~TSF_CRFLAG;
+			if (ubuf[1] != '\n') {
+			    ubuf[0] = '\n';
+			    len++;
+			    ts->linepos--;
+			} else {
+			    ubuf++;
+			}
+		    }
+		    ts->userbuf.limit = ubuf + len;
+		    ts->userbuf.ptr = ubuf;
+		} else {
 		    ts->flags |= TSF_EOF;
 		    return EOF;
 		}
@@ -373,6 +753,12 @@ GetChar(JSTokenStream *ts)
 
 	    /* Update linelen from original segment length. */
 	    ts->linelen = olen;
+
+	    /* Append the new segment to any source being captured. */
+	    if (ts->flags & TSF_CAPTURE) {
+		ts->capseg = (ptrdiff_t)ts->caplength;
+		CaptureChars(ts, ts->linebuf.base, (size_t)len);
+	    }
 	}
 	c = *ts->linebuf.ptr++;
     }
@@ -680,6 +1066,7 @@ js_GetToken(JSContext *cx, JSTokenStream *ts)
 {
     int32 c;
     JSAtom *atom;
+    struct keyword *kw;
 
 #define INIT_TOKENBUF(tb)   ((tb)->ptr = (tb)->base)
 #define FINISH_TOKENBUF(tb) if (!AddToTokenBuf(cx, tb, 0)) RETURN(TOK_ERROR)
@@ -712,8 +1099,12 @@ retry:
     ts->token.pos.begin.index = ts->linepos + (ts->token.ptr-ts->linebuf.base);
     ts->token.pos.begin.lineno = ts->token.pos.end.lineno = ts->lineno;
 
-    if (c == EOF)
+    if (c == EOF) {
+	/* A failed byte reader ends input early, but must fail the parse. */
+	if (ts->flags & TSF_ERROR)
+	    RETURN(TOK_ERROR);
 	RETURN(TOK_EOF);
+    }
 
     if (JS_ISIDENT(c)) {
 	INIT_TOKENBUF(&ts->tokenbuf);
@@ -725,19 +1116,21 @@ retry:
 	UngetChar(ts, c);
 	FINISH_TOKENBUF(&ts->tokenbuf);
 
-	atom = js_AtomizeChars(cx,
-			       ts->tokenbuf.base,
-			       TOKEN_LENGTH(&ts->tokenbuf),
-			       0);
-	if (!atom)
-	    RETURN(TOK_ERROR);
-	if (atom->kwindex >= 0) {
-	    struct keyword *kw;
-
-	    kw = &keywords[atom->kwindex];
+	/*
+	 * Recognize keywords before atomizing.  A keyword that postdates the
+	 * context's version is scanned as an ordinary identifier.
+	 */
+	kw = FindKeyword(ts->tokenbuf.base, TOKEN_LENGTH(&ts->tokenbuf));
+	if (kw &&
+	    (JSVERSION_IS_ECMA(cx->version) || kw->version <= cx->version)) {
 	    ts->token.t_op = kw->op;
 	    RETURN(kw->tokentype);
 	}
+
+	atom = AtomizeToken(cx, ts, ts->tokenbuf.base,
+			    TOKEN_LENGTH(&ts->tokenbuf));
+	if (!atom)
+	    RETURN(TOK_ERROR);
 	ts->token.t_op = JSOP_NAME;
 	ts->token.t_atom = atom;
 	RETURN(TOK_NAME);
@@ -899,10 +1292,8 @@ retry:
 		RETURN(TOK_ERROR);
 	}
 	FINISH_TOKENBUF(&ts->tokenbuf);
-	atom = js_AtomizeChars(cx,
-			       ts->tokenbuf.base,
-			       TOKEN_LENGTH(&ts->tokenbuf),
-			       0);
+	atom = AtomizeToken(cx, ts, ts->tokenbuf.base,
+			    TOKEN_LENGTH(&ts->tokenbuf));
 	if (!atom)
 	    RETURN(TOK_ERROR);
 	ts->token.pos.end.lineno = ts->lineno;
@@ -131,6 +131,16 @@ typedef struct JSTokenBuf {
 #define JS_LINE_LIMIT   256             /* logical line buffer size limit --
 					   physical line length is unlimited */
 
+/*
+ * Direct-mapped cache of recently scanned identifier and string literal
+ * atoms, private to one token stream and so needing no lock.  The cache is
+ * flushed whenever a GC has run since it was filled, as the GC may have
+ * swept unreferenced atoms.
+ */
+#define TS_ATOM_CACHE_LOG2  6
+#define TS_ATOM_CACHE_SIZE  JS_BIT(TS_ATOM_CACHE_LOG2)
+#define TS_ATOM_CACHE_MASK  JS_BITMASK(TS_ATOM_CACHE_LOG2)
+
 struct JSTokenStream {
     JSToken             token;          /* last token scanned */
     JSToken             pushback;       /* pushed-back already-scanned token */
@@ -151,6 +161,17 @@ struct JSTokenStream {
     JSSourceHandler     listener;       /* callback for source; eg debugger */
     void                *listenerData;  /* listener 'this' data */
     void                *listenerTSData;/* listener data for this TokenStream */
+    const char          *bytes;         /* next undecoded byte, if bytes */
+    const char          *byteslimit;    /* end of buffered undecoded bytes */
+    char                *bytebuf;       /* buffer filled by reader, or null */
+    JSSourceReader      reader;         /* byte source callback, or null */
+    void                *readerData;    /* closure passed to reader */
+    jschar              *capbuf;        /* captured source, or null */
+    size_t              caplength;      /* number of chars in capbuf */
+    size_t              capsize;        /* allocated size of capbuf */
+    ptrdiff_t           capseg;         /* capbuf offset of linebuf.base */
+    uint32              atomCacheGCNumber; /* rt->gcNumber when cache filled */
+    JSAtom              *atomCache[TS_ATOM_CACHE_SIZE]; /* recent atoms */
 };
 
 /* JSTokenStream flags */
@@ -162,6 +183,8 @@ struct JSTokenStream {
 #define TSF_NLFLAG      0x20            /* last linebuf ended with \n */
 #define TSF_CRFLAG      0x40            /* linebuf would have ended with \r */
 #define TSF_BADCOMPILE  0x80            /* compile failed, stop throwing exns */ 
+#define TSF_UTF8        0x100           /* byte source is UTF-8, not Latin-1 */
+#define TSF_CAPTURE     0x200           /* copying linebuf segments to capbuf */
 
 /*
  * At most one non-EOF token can be pushed back onto a TokenStream between
@@ -196,6 +219,18 @@ js_NewTokenStream(JSContext *cx, const jschar *base, size_t length,
 extern JS_FRIEND_API(JSTokenStream *)
 js_NewBufferTokenStream(JSContext *cx, const jschar *base, size_t length);
 
+/*
+ * Create a token stream that decodes Latin-1 or UTF-8 bytes as it scans,
+ * rather than requiring the whole source as jschars up front.  The bytes
+ * come from the length bytes at bytes if reader is null, else from calls to
+ * reader as the scanner needs them.
+ */
+extern JS_FRIEND_API(JSTokenStream *)
+js_NewByteTokenStream(JSContext *cx, const char *bytes, size_t length,
+		      JSSourceReader reader, void *readerData, JSBool utf8,
+		      const char *filename, uintN lineno,
+		      JSPrincipals *principals);
+
 #ifdef JSFILE
 extern JS_FRIEND_API(JSTokenStream *)
 js_NewFileTokenStream(JSContext *cx, const char *filename, FILE *defaultfp);
@@ -204,6 +239,25 @@ js_NewFileTokenStream(JSContext *cx, const char *filename, FILE *defaultfp);
 extern JS_FRIEND_API(JSBool)
 js_CloseTokenStream(JSContext *cx, JSTokenStream *ts);
 
+/*
+ * Record the source chars scanned after the current token, which must be a
+ * left curly brace, until js_FinishSourceCapture is called with a matching
+ * right curly as the current token.  On success, *charsp receives a malloc'd
+ * copy of the chars between the two braces, which the caller must free.
+ * js_StartSourceCapture and js_FinishSourceCapture return false, without
+ * reporting an error, if the source can't be captured (a capture is already
+ * in progress, a token has been pushed back, or memory ran out); the caller
+ * should then compile eagerly.
+ */
+extern JSBool
+js_StartSourceCapture(JSTokenStream *ts);
+
+extern JSBool
+js_FinishSourceCapture(JSTokenStream *ts, jschar **charsp, size_t *lengthp);
+
+extern void
+js_CancelSourceCapture(JSTokenStream *ts);
+
 /*
  * Initialize the scanner, installing JS keywords into cx's global scope.
  */
@@ -105,6 +105,7 @@ js_free_symbol(void *priv, JSHashEntry *he, uintN flag)
 	    }
 	    sym->next = NULL;
 	}
+	SCOPE_NEW_SHAPE(cx, spriv->scope);
     }
 
     if (flag == HT_FREE_ENTRY)
@@ -150,6 +151,7 @@ js_hash_scope_lookup(JSContext *cx, JSScope *scope, jsid id, JSHashNumber hash)
 	} else {                                                              \
 	    sym->entry.value = NULL;                                          \
 	}                                                                     \
+	SCOPE_NEW_SHAPE(cx, scope);                                           \
     JS_END_MACRO
 
 JS_STATIC_DLL_CALLBACK(JSSymbol *)
@@ -205,6 +207,7 @@ js_hash_scope_clear(JSContext *cx, JSScope *scope)
     JS_free(cx, priv);
     scope->ops = &js_list_scope_ops;
     scope->data = NULL;
+    SCOPE_NEW_SHAPE(cx, scope);
 }
 
 JSScopeOps js_hash_scope_ops = {
@@ -346,6 +349,21 @@ JSScopeOps JS_FRIEND_DATA(js_list_scope_ops) = {
 
 /************************************************************************/
 
+#ifdef JS_THREADSAFE
+uint32
+js_GenerateShape(JSContext *cx)
+{
+    jsword *genp, gen;
+
+    /* Retry rather than lock the runtime; scopes are reshaped very often. */
+    genp = &cx->runtime->shapeGen;
+    do {
+	gen = *genp;
+    } while (!js_CompareAndSwap(genp, gen, gen + 1));
+    return (uint32) (gen + 1);
+}
+#endif
+
 JSScope *
 js_GetMutableScope(JSContext *cx, JSObject *obj)
 {
@@ -391,6 +409,7 @@ js_NewScope(JSContext *cx, jsrefcount nrefs, JSObjectOps *ops, JSClass *clasp,
     scope->proptail = &scope->props;
     scope->ops = &js_list_scope_ops;
     scope->data = NULL;
+    SCOPE_NEW_SHAPE(cx, scope);
 
 #ifdef JS_THREADSAFE
     js_NewLock(&scope->lock);
@@ -461,6 +480,7 @@ js_NewScopeProperty(JSContext *cx, JSScope *scope, jsid id,
     sprop->prevp = scope->proptail;
     *scope->proptail = sprop;
     scope->proptail = &sprop->next;
+    SCOPE_NEW_SHAPE(cx, scope);
     return sprop;
 }
 
@@ -490,6 +510,7 @@ js_DestroyScopeProperty(JSContext *cx, JSScope *scope, JSScopeProperty *sprop)
 		sprop->next->prevp = sprop->prevp;
 	    else
 		scope->proptail = sprop->prevp;
+	    SCOPE_NEW_SHAPE(cx, scope);
 	}
     }
 
@@ -43,6 +43,7 @@ struct JSScope {
     JSScopeProperty **proptail;         /* pointer to pointer to last prop */
     JSScopeOps      *ops;               /* virtual operations */
     void            *data;              /* private data specific to ops */
+    uint32          shape;              /* property set and attrs version */
 #ifdef JS_THREADSAFE
     JSThinLock      lock;              /* binary semaphore protecting scope */
     int32           count;              /* entry count for reentrancy */
@@ -59,6 +60,18 @@ struct JSSymbol {
     JSSymbol        *next;              /* next in type-specific list */
 };
 
+/*
+ * A scope takes a new shape, a number unique within its runtime, whenever a
+ * property is added to or removed from it or a property's attributes change,
+ * so that results computed from its properties can be cached by shape.
+ */
+#ifdef JS_THREADSAFE
+#define SCOPE_NEW_SHAPE(cx, scope) ((scope)->shape = js_GenerateShape(cx))
+#else
+#define SCOPE_NEW_SHAPE(cx, scope) ((scope)->shape =                        \
+                                    (uint32) ++(cx)->runtime->shapeGen)
+#endif
+
 #define sym_id(sym)             ((jsid)(sym)->entry.key)
 #define sym_atom(sym)           ((JSAtom *)(sym)->entry.key)
 #define sym_property(sym)       ((JSScopeProperty *)(sym)->entry.value)
@@ -85,6 +98,11 @@ struct JSScopeProperty {
 #define SPROP_GET(cx,sprop,obj,obj2,vp) ((sprop)->getter(cx,obj,sprop->id,vp))
 #define SPROP_SET(cx,sprop,obj,obj2,vp) ((sprop)->setter(cx,obj,sprop->id,vp))
 
+#ifdef JS_THREADSAFE
+extern uint32
+js_GenerateShape(JSContext *cx);
+#endif
+
 extern JSScope *
 js_GetMutableScope(JSContext *cx, JSObject *obj);
 
@@ -230,6 +230,49 @@ script_exec(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 }
 
 #if JS_HAS_XDR
+/*
+ * Decode a string atom straight from the XDR buffer, without first making
+ * a JSString copy of its chars: js_AtomizeChars copies only if the string
+ * is not already atomized.
+ */
+static JSBool
+XDRStringAtom(JSXDRState *xdr, JSAtom **atomp)
+{
+#ifdef IS_LITTLE_ENDIAN
+    uint32 len, nbytes;
+    jschar *raw;
+    JSString *str;
+
+    if (xdr->mode == JSXDR_ENCODE) {
+	str = ATOM_TO_STRING(*atomp);
+	return JS_XDRString(xdr, &str);
+    }
+    if (!JS_XDRUint32(xdr, &len))
+	return JS_FALSE;
+    nbytes = len * sizeof(jschar);
+    if (nbytes % JSXDR_ALIGN)
+	nbytes += JSXDR_ALIGN - (nbytes % JSXDR_ALIGN);
+    raw = xdr->ops->raw(xdr, nbytes);
+    if (!raw)
+	return JS_FALSE;
+    *atomp = js_AtomizeChars(xdr->cx, raw, len, 0);
+    return *atomp != NULL;
+#else
+    JSString *str;
+
+    if (xdr->mode == JSXDR_ENCODE)
+	str = ATOM_TO_STRING(*atomp);
+    if (!JS_XDRString(xdr, &str))
+	return JS_FALSE;
+    if (xdr->mode == JSXDR_DECODE) {
+	*atomp = js_AtomizeString(xdr->cx, str, 0);
+	if (!*atomp)
+	    return JS_FALSE;
+    }
+    return JS_TRUE;
+#endif
+}
+
 static JSBool
 XDRAtom1(JSXDRState *xdr, JSAtomListElement *ale)
 {
@@ -242,7 +285,11 @@ XDRAtom1(JSXDRState *xdr, JSAtomListElement *ale)
     }
 
     if (!JS_XDRUint32(xdr, &ale->index) ||
-	!JS_XDRValue(xdr, &value))
+	!JS_XDRUint32(xdr, &type))
+	return JS_FALSE;
+    if (type == JSVAL_STRING)
+	return XDRStringAtom(xdr, &ale->atom);
+    if (!JS_XDRValueBody(xdr, type, &value))
 	return JS_FALSE;
 
     if (xdr->mode == JSXDR_DECODE) {
@@ -305,6 +352,39 @@ XDRAtomMap(JSXDRState *xdr, JSAtomMap *map)
     return JS_TRUE;
 }
 
+/*
+ * Source notes are XDR'd as a counted vector that includes their terminator,
+ * so a script decoded from an image can use them where they lie.
+ */
+static JSBool
+XDRSrcNotes(JSXDRState *xdr, jssrcnote **notesp)
+{
+    uint32 nbytes;
+    jssrcnote *sn;
+
+    if (xdr->mode == JSXDR_ENCODE) {
+	nbytes = 0;
+	sn = *notesp;
+	if (sn) {
+	    while (!SN_IS_TERMINATOR(sn))
+		sn = SN_NEXT(sn);
+	    nbytes = PTRDIFF(sn, *notesp, jssrcnote) + 1;
+	}
+    }
+    if (!JS_XDRUint32(xdr, &nbytes))
+	return JS_FALSE;
+    if (nbytes == 0) {
+	*notesp = NULL;
+	return JS_TRUE;
+    }
+    if (xdr->mode == JSXDR_DECODE && !xdr->image) {
+	*notesp = JS_malloc(xdr->cx, nbytes);
+	if (!*notesp)
+	    return JS_FALSE;
+    }
+    return JS_XDRBytesInPlace(xdr, (char **)notesp, nbytes);
+}
+
 JSBool
 js_XDRScript(JSXDRState *xdr, JSScript **scriptp, JSBool *magic)
 {
@@ -328,14 +408,20 @@ js_XDRScript(JSXDRState *xdr, JSScript **scriptp, JSBool *magic)
     if (!JS_XDRUint32(xdr, &length))
 	return JS_FALSE;
     if (xdr->mode == JSXDR_DECODE) {
-	script = js_NewScript(xdr->cx, length);
+	/* When decoding in place, code and notes are borrowed from image. */
+	script = js_NewScript(xdr->cx, xdr->image ? 0 : length);
 	if (!script)
 	    return JS_FALSE;
+	if (xdr->image) {
+	    script->length = length;
+	    script->image = xdr->image;
+	    js_HoldXDRImage(xdr->cx, xdr->image);
+	}
 	*scriptp = script;
     }
-    if (!JS_XDRBytes(xdr, (char **)&script->code, length) ||
+    if (!JS_XDRBytesInPlace(xdr, (char **)&script->code, length) ||
 	!XDRAtomMap(xdr, &script->atomMap) ||
-	!JS_XDRCStringOrNull(xdr, (char **)&script->notes) ||
+	!XDRSrcNotes(xdr, &script->notes) ||
 	!JS_XDRCStringOrNull(xdr, (char **)&script->filename) ||
 	!JS_XDRUint32(xdr, &lineno) ||
 	!JS_XDRUint32(xdr, &depth)) {
@@ -643,13 +729,15 @@ js_NewScriptFromCG(JSContext *cx, JSCodeGenerator *cg, JSFunction *fun)
     if (!js_FinishTakingTryNotes(cx, cg, &trynotes))
 	return NULL;
     notes = js_FinishTakingSrcNotes(cx, cg);
+    js_FuseBytecode(cg);
     script = js_NewScriptFromParams(cx, cg->base, CG_OFFSET(cg),
 				    cg->filename, cg->firstLine,
 				    cg->maxStackDepth, notes, trynotes,
 				    cg->principals);
     if (!script)
 	return NULL;
-    if (!notes || !js_InitAtomMap(cx, &script->atomMap, &cg->atomList)) {
+    if (!notes || !js_InitAtomMap(cx, &script->atomMap, &cg->atomList) ||
+	(cx->runtime->coverageEnabled && !js_InitScriptCoverage(cx, script))) {
 	js_DestroyScript(cx, script);
 	return NULL;
     }
@@ -674,11 +762,20 @@ js_DestroyScript(JSContext *cx, JSScript *script)
     hook = rt->destroyScriptHook;
     if (hook)
 	(*hook)(cx, script, rt->destroyScriptHookData);
+    if (rt->profiler)
+	js_ForgetProfiledScript(rt, script);
+    if (rt->callProfile)
+	js_ForgetCallProfileScript(rt, script);
+    if (script->pcCounts)
+	js_FinishScriptCoverage(cx, script);
 
     JS_ClearScriptTraps(cx, script);
     js_FreeAtomMap(cx, &script->atomMap);
     JS_free(cx, (void *)script->filename);
-    JS_free(cx, script->notes);
+    if (script->image)
+	js_DropXDRImage(cx, script->image);
+    else
+	JS_free(cx, script->notes);
     JS_free(cx, script->trynotes);
     if (script->principals)
 	JSPRINCIPALS_DROP(cx, script->principals);
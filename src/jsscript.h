@@ -51,6 +51,8 @@ struct JSScript {
     JSTryNote    *trynotes;     /* exception table for this script */
     JSPrincipals *principals;   /* principals for this script */
     JSObject     *object;       /* optional Script-class object wrapper */
+    JSXDRImage   *image;        /* image owning code and notes, or null */
+    uint32       *pcCounts;     /* coverage counts by pc offset, or null */
 };
 
 extern JSClass js_ScriptClass;
@@ -800,7 +800,7 @@ match_or_replace(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
 	} else {
 	    opt = NULL;
 	}
-	re = js_NewRegExpOpt(cx, src, opt);
+	re = js_NewCachedRegExpOpt(cx, src, opt);
 	if (!re)
 	    return JS_FALSE;
 	reobj = NULL;
@@ -2179,6 +2179,146 @@ js_ValueToString(JSContext *cx, jsval v)
     return str;
 }
 
+#define STRING_BUFFER_MIN       16
+
+void
+js_InitStringBuffer(JSStringBuffer *sb)
+{
+    sb->base = sb->limit = sb->ptr = NULL;
+}
+
+void
+js_FinishStringBuffer(JSStringBuffer *sb)
+{
+    if (sb->base)
+	free(sb->base);
+    js_InitStringBuffer(sb);
+}
+
+/* Make room for length more chars, plus the terminator. */
+static JSBool
+GrowStringBuffer(JSContext *cx, JSStringBuffer *sb, size_t length)
+{
+    size_t offset, size, need;
+    jschar *base;
+
+    offset = PTRDIFF(sb->ptr, sb->base, jschar);
+    size = PTRDIFF(sb->limit, sb->base, jschar);
+    need = offset + length;
+    if (need < offset || need >= (size_t)-1 / sizeof(jschar))
+	goto nomem;
+    if (size < STRING_BUFFER_MIN)
+	size = STRING_BUFFER_MIN;
+    while (size < need) {
+	if (size > ((size_t)-1 / sizeof(jschar) - 1) / 2) {
+	    size = need;
+	    break;
+	}
+	size *= 2;
+    }
+    base = realloc(sb->base, (size + 1) * sizeof(jschar));
+    if (!base)
+	goto nomem;
+    sb->base = base;
+    sb->limit = base + size;
+    sb->ptr = base + offset;
+    return JS_TRUE;
+
+nomem:
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+}
+
+#define STRING_BUFFER_ROOM(sb)                                                \
+    ((size_t)PTRDIFF((sb)->limit, (sb)->ptr, jschar))
+
+JSBool
+js_AppendChar(JSContext *cx, JSStringBuffer *sb, jschar c)
+{
+    if (sb->ptr == sb->limit && !GrowStringBuffer(cx, sb, 1))
+	return JS_FALSE;
+    *sb->ptr++ = c;
+    return JS_TRUE;
+}
+
+JSBool
+js_AppendChars(JSContext *cx, JSStringBuffer *sb, const jschar *chars,
+	       size_t length)
+{
+    if (length > STRING_BUFFER_ROOM(sb) && !GrowStringBuffer(cx, sb, length))
+	return JS_FALSE;
+    js_strncpy(sb->ptr, chars, length);
+    sb->ptr += length;
+    return JS_TRUE;
+}
+
+JSBool
+js_AppendCString(JSContext *cx, JSStringBuffer *sb, const char *bytes)
+{
+    size_t length;
+    jschar *cp;
+
+    length = strlen(bytes);
+    if (length > STRING_BUFFER_ROOM(sb) && !GrowStringBuffer(cx, sb, length))
+	return JS_FALSE;
+    for (cp = sb->ptr; *bytes; cp++, bytes++)
+	*cp = (jschar)(uint8)*bytes;
+    sb->ptr = cp;
+    return JS_TRUE;
+}
+
+JSBool
+js_AppendValue(JSContext *cx, JSStringBuffer *sb, jsval v)
+{
+    JSString *str;
+    char buf[32];
+
+    if (JSVAL_IS_INT(v)) {
+	return js_AppendCString(cx, sb,
+				js_NumberToCString((jsdouble)JSVAL_TO_INT(v),
+						   buf, sizeof buf));
+    }
+    if (JSVAL_IS_DOUBLE(v)) {
+	return js_AppendCString(cx, sb,
+				js_NumberToCString(*JSVAL_TO_DOUBLE(v),
+						   buf, sizeof buf));
+    }
+    if (JSVAL_IS_BOOLEAN(v))
+	return js_AppendCString(cx, sb, js_boolean_str[JSVAL_TO_BOOLEAN(v)]);
+    str = js_ValueToString(cx, v);
+    if (!str)
+	return JS_FALSE;
+    return js_AppendChars(cx, sb, str->chars, str->length);
+}
+
+JSString *
+js_NewStringFromBuffer(JSContext *cx, JSStringBuffer *sb)
+{
+    size_t length;
+    jschar *chars;
+    JSString *str;
+
+    if (!sb->base && !GrowStringBuffer(cx, sb, 0))
+	return NULL;
+    length = PTRDIFF(sb->ptr, sb->base, jschar);
+
+    /* Give back a large unused tail; shrinking in place doesn't copy. */
+    if (STRING_BUFFER_ROOM(sb) > STRING_BUFFER_MIN + length / 4) {
+	chars = realloc(sb->base, (length + 1) * sizeof(jschar));
+	if (chars) {
+	    sb->base = chars;
+	    sb->limit = sb->ptr = chars + length;
+	}
+    }
+    chars = sb->base;
+    chars[length] = 0;
+    str = js_NewString(cx, chars, length, 0);
+    if (!str)
+	return NULL;
+    js_InitStringBuffer(sb);
+    return str;
+}
+
 JSString *
 js_ValueToSource(JSContext *cx, jsval v)
 {
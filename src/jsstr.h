@@ -192,6 +192,55 @@ js_ValueToString(JSContext *cx, jsval v);
 extern JSString *
 js_ValueToSource(JSContext *cx, jsval v);
 
+/*
+ * Growable buffer for building a string from pieces.  The chars are malloc'd
+ * and at least double in size whenever they fill, with room always kept for
+ * the terminator, so js_NewStringFromBuffer can hand them to a new string
+ * without copying.  A buffer may adopt a malloc'd, zero-terminated jschar
+ * string by setting base to it and ptr and limit to its end.
+ */
+typedef struct JSStringBuffer {
+    jschar          *base;          /* malloc'd chars or null */
+    jschar          *limit;         /* end of usable space */
+    jschar          *ptr;           /* next char to append */
+} JSStringBuffer;
+
+extern void
+js_InitStringBuffer(JSStringBuffer *sb);
+
+/* Free any chars not yet handed off by js_NewStringFromBuffer. */
+extern void
+js_FinishStringBuffer(JSStringBuffer *sb);
+
+/*
+ * The append functions report out of memory and return false on failure,
+ * leaving what was already appended in place.
+ */
+extern JSBool
+js_AppendChar(JSContext *cx, JSStringBuffer *sb, jschar c);
+
+extern JSBool
+js_AppendChars(JSContext *cx, JSStringBuffer *sb, const jschar *chars,
+	       size_t length);
+
+/* Append an ASCII C string. */
+extern JSBool
+js_AppendCString(JSContext *cx, JSStringBuffer *sb, const char *bytes);
+
+/*
+ * Append v converted as js_ValueToString would, without making a string for
+ * numbers or booleans.
+ */
+extern JSBool
+js_AppendValue(JSContext *cx, JSStringBuffer *sb, jsval v);
+
+/*
+ * Make a GC'ed string that takes the buffer's chars, leaving sb empty.  On
+ * failure sb keeps its chars for js_FinishStringBuffer.
+ */
+extern JSString *
+js_NewStringFromBuffer(JSContext *cx, JSStringBuffer *sb);
+
 #ifdef HT_ENUMERATE_NEXT	/* XXX don't require jshash.h */
 /*
  * Compute a hash function from str.
@@ -17,13 +17,24 @@
  */
 #include "jsstddef.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#ifdef XP_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 #include "jstypes.h"
 #include "jsutil.h" /* Added by JSIFY */
 #include "jsprf.h"
 #include "jsapi.h"
 #include "jscntxt.h"
+#include "jslock.h"
 #include "jsobj.h"		/* js_XDRObject */
+#include "jsscript.h"		/* js_XDRScript */
 #include "jsstr.h"
 #include "jsxdrapi.h"
 
@@ -203,6 +214,19 @@ static JSXDROps xdrmem_ops = {
     mem_raw,        mem_seek,       mem_tell,       mem_finalize
 };
 
+static void
+image_finalize(JSXDRState *xdr)
+{
+    js_DropXDRImage(xdr->cx, xdr->image);
+    xdr->image = NULL;
+}
+
+/* Image states decode like memory states, but never own xdr->data. */
+static JSXDROps xdrimage_ops = {
+    mem_get32,      mem_set32,      mem_getbytes,   mem_setbytes,
+    mem_raw,        mem_seek,       mem_tell,       image_finalize
+};
+
 JS_PUBLIC_API(void)
 JS_XDRNewBase(JSContext *cx, JSXDRState *xdr, JSXDRMode mode)
 {
@@ -210,6 +234,7 @@ JS_XDRNewBase(JSContext *cx, JSXDRState *xdr, JSXDRMode mode)
     xdr->mode = mode;
     xdr->registry = NULL;
     xdr->nclasses = 0;
+    xdr->image = NULL;
 }
 
 JS_PUBLIC_API(JSXDRState *)
@@ -234,6 +259,168 @@ JS_XDRNewMem(JSContext *cx, JSXDRMode mode)
     return xdr;
 }
 
+static JSXDRState *
+NewImageState(JSContext *cx, JSXDRImage *image)
+{
+    JSXDRState *xdr;
+
+    xdr = JS_malloc(cx, sizeof(JSXDRMemState));
+    if (!xdr)
+	return NULL;
+    JS_XDRNewBase(cx, xdr, JSXDR_DECODE);
+    xdr->ops = &xdrimage_ops;
+    xdr->data = image->base;
+    xdr->image = image;
+    MEM_PRIV(xdr)->count = 0;
+    MEM_PRIV(xdr)->limit = image->length;
+    return xdr;
+}
+
+JS_PUBLIC_API(JSXDRState *)
+JS_XDRNewImage(JSContext *cx, void *data, uint32 len)
+{
+    JSXDRImage *image;
+    JSXDRState *xdr;
+
+    /* Borrowed code and notes must not straddle XDR's 4-byte alignment. */
+    JS_ASSERT((jsword)data % JSXDR_ALIGN == 0);
+    image = JS_malloc(cx, sizeof *image);
+    if (!image)
+	return NULL;
+    image->base = data;
+    image->length = len;
+    image->nrefs = 1;
+    image->kind = JSXDR_IMAGE_BORROWED;
+    xdr = NewImageState(cx, image);
+    if (!xdr)
+	JS_free(cx, image);
+    return xdr;
+}
+
+JS_PUBLIC_API(JSXDRState *)
+JS_XDRNewMappedFile(JSContext *cx, const char *filename)
+{
+    JSXDRImage *image;
+    JSXDRState *xdr;
+    void *base;
+    uint32 length;
+#ifdef XP_UNIX
+    int fd;
+    struct stat st;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_OPEN,
+			     filename, strerror(errno));
+	if (fd >= 0)
+	    close(fd);
+	return NULL;
+    }
+    length = (uint32) st.st_size;
+
+    /*
+     * Map privately and writable so that JS_SetTrap can patch bytecode:
+     * only pages holding a trap are copied, the rest stay shared with any
+     * other process that maps the same file.
+     */
+    base = length
+	   ? mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+	   : NULL;
+    close(fd);
+    if (base == MAP_FAILED) {
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_OPEN,
+			     filename, strerror(errno));
+	return NULL;
+    }
+#else
+    FILE *fp;
+    long size;
+
+    fp = fopen(filename, "rb");
+    if (!fp) {
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_OPEN,
+			     filename, strerror(errno));
+	return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    length = (uint32) size;
+    base = JS_malloc(cx, length ? length : 1);
+    if (base && fread(base, 1, length, fp) != length) {
+	JS_ReportErrorNumber(cx, js_GetErrorMessage, NULL, JSMSG_CANT_OPEN,
+			     filename, strerror(errno));
+	JS_free(cx, base);
+	base = NULL;
+    }
+    fclose(fp);
+    if (!base)
+	return NULL;
+#endif
+
+    image = JS_malloc(cx, sizeof *image);
+    if (!image)
+	goto bad;
+    image->base = base;
+    image->length = length;
+    image->nrefs = 1;
+#ifdef XP_UNIX
+    image->kind = base ? JSXDR_IMAGE_MAPPED : JSXDR_IMAGE_BORROWED;
+#else
+    image->kind = JSXDR_IMAGE_MALLOCED;
+#endif
+    xdr = NewImageState(cx, image);
+    if (!xdr) {
+	JS_free(cx, image);
+	goto bad;
+    }
+    return xdr;
+
+bad:
+#ifdef XP_UNIX
+    if (base)
+	munmap(base, length);
+#else
+    JS_free(cx, base);
+#endif
+    return NULL;
+}
+
+void
+js_HoldXDRImage(JSContext *cx, JSXDRImage *image)
+{
+    JS_LOCK_RUNTIME(cx->runtime);
+    JS_ASSERT(image->nrefs > 0);
+    image->nrefs++;
+    JS_UNLOCK_RUNTIME(cx->runtime);
+}
+
+void
+js_DropXDRImage(JSContext *cx, JSXDRImage *image)
+{
+    jsrefcount nrefs;
+
+    JS_LOCK_RUNTIME(cx->runtime);
+    JS_ASSERT(image->nrefs > 0);
+    nrefs = --image->nrefs;
+    JS_UNLOCK_RUNTIME(cx->runtime);
+    if (nrefs != 0)
+	return;
+    switch (image->kind) {
+#ifdef XP_UNIX
+      case JSXDR_IMAGE_MAPPED:
+	munmap(image->base, image->length);
+	break;
+#endif
+      case JSXDR_IMAGE_MALLOCED:
+	JS_free(cx, image->base);
+	break;
+      default:
+	break;
+    }
+    JS_free(cx, image);
+}
+
 JS_PUBLIC_API(void *)
 JS_XDRMemGetData(JSXDRState *xdr, uint32 *lp)
 {
@@ -307,6 +494,20 @@ JS_XDRBytes(JSXDRState *xdr, char **bytesp, uint32 len)
     return JS_TRUE;
 }
 
+JS_PUBLIC_API(JSBool)
+JS_XDRBytesInPlace(JSXDRState *xdr, char **bytesp, uint32 len)
+{
+    uint32 padded;
+
+    if (xdr->mode != JSXDR_DECODE || !xdr->image)
+	return JS_XDRBytes(xdr, bytesp, len);
+    padded = len;
+    if (padded % JSXDR_ALIGN)
+	padded += JSXDR_ALIGN - (padded % JSXDR_ALIGN);
+    *bytesp = xdr->ops->raw(xdr, padded);
+    return *bytesp != NULL;
+}
+
 /**
  * Convert between a C string and the XDR representation:
  * leading 32-bit count, then counted vector of chars,
@@ -435,7 +636,12 @@ JS_XDRValue(JSXDRState *xdr, jsval *vp)
     uint32 type = JSVAL_TAG(*vp);
     if (!JS_XDRUint32(xdr, &type))
 	return JS_FALSE;
+    return JS_XDRValueBody(xdr, type, vp);
+}
 
+JS_PUBLIC_API(JSBool)
+JS_XDRValueBody(JSXDRState *xdr, uint32 type, jsval *vp)
+{
     switch (type) {
       case JSVAL_STRING: {
 	JSString *str = JSVAL_TO_STRING(*vp);
@@ -500,6 +706,20 @@ JS_XDRValue(JSXDRState *xdr, jsval *vp)
     return JS_TRUE;
 }
 
+JS_PUBLIC_API(JSBool)
+JS_XDRScript(JSXDRState *xdr, JSScript **scriptp)
+{
+    JSBool magic;
+
+    if (!js_XDRScript(xdr, scriptp, &magic))
+	return JS_FALSE;
+    if (!magic) {
+	JS_ReportErrorNumber(xdr->cx, js_GetErrorMessage, NULL,
+			     JSMSG_BAD_SCRIPT_MAGIC);
+	return JS_FALSE;
+    }
+    return JS_TRUE;
+}
 
 JS_PUBLIC_API(void)
 JS_XDRDestroy(JSXDRState *xdr)
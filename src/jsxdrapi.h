@@ -84,6 +84,23 @@ typedef struct JSXDROps {
     void        (*finalize)(JSXDRState *);
 } JSXDROps;
 
+/*
+ * A read-only XDR image shared by every script decoded from it.  When an
+ * XDR state decodes from an image, the bytecode and source notes of each
+ * script point directly into the image, and each such script holds a ref
+ * on it.  The image is unmapped or freed when the last ref is dropped.
+ */
+struct JSXDRImage {
+    void        *base;          /* start of mapped or malloc'd image */
+    uint32      length;         /* length of image in bytes */
+    jsrefcount  nrefs;          /* XDR states and scripts referencing us */
+    uintN       kind;           /* who owns base, see below */
+};
+
+#define JSXDR_IMAGE_BORROWED    0       /* base owned by the embedding */
+#define JSXDR_IMAGE_MAPPED      1       /* base came from mmap */
+#define JSXDR_IMAGE_MALLOCED    2       /* base came from JS_malloc */
+
 struct JSXDRState {
     JSXDRMode   mode;
     JSXDROps    *ops;
@@ -91,6 +108,7 @@ struct JSXDRState {
     JSClass     **registry;
     uintN       nclasses;
     void        *data;
+    JSXDRImage  *image;         /* non-null if decoding in place */
 };
 
 JS_PUBLIC_API(void)
@@ -105,6 +123,23 @@ JS_XDRMemGetData(JSXDRState *xdr, uint32 *lp);
 JS_PUBLIC_API(void)
 JS_XDRMemSetData(JSXDRState *xdr, void *data, uint32 len);
 
+/*
+ * Create a JSXDR_DECODE state over the len bytes at data, which must stay
+ * valid and unmodified for as long as any script decoded from it lives.
+ * Decoded scripts borrow their bytecode and source notes from data; the
+ * caller-supplied memory is never freed by the engine.
+ */
+JS_PUBLIC_API(JSXDRState *)
+JS_XDRNewImage(JSContext *cx, void *data, uint32 len);
+
+/*
+ * Create a JSXDR_DECODE state over the contents of filename.  On Unix the
+ * file is mapped copy-on-write, so processes decoding the same file share
+ * its page-cached bytecode until a debugger trap patches a page.
+ */
+JS_PUBLIC_API(JSXDRState *)
+JS_XDRNewMappedFile(JSContext *cx, const char *filename);
+
 JS_PUBLIC_API(void)
 JS_XDRDestroy(JSXDRState *xdr);
 
@@ -120,6 +155,13 @@ JS_XDRUint32(JSXDRState *xdr, uint32 *lp);
 JS_PUBLIC_API(JSBool)
 JS_XDRBytes(JSXDRState *xdr, char **bytes, uint32 len);
 
+/*
+ * Like JS_XDRBytes, except that when decoding from an image, *bytes is set
+ * to point at the len bytes within the image instead of being filled in.
+ */
+JS_PUBLIC_API(JSBool)
+JS_XDRBytesInPlace(JSXDRState *xdr, char **bytes, uint32 len);
+
 JS_PUBLIC_API(JSBool)
 JS_XDRCString(JSXDRState *xdr, char **sp);
 
@@ -138,6 +180,13 @@ JS_XDRDouble(JSXDRState *xdr, jsdouble **dp);
 JS_PUBLIC_API(JSBool)
 JS_XDRValue(JSXDRState *xdr, jsval *vp);
 
+/* Like JS_XDRValue, but for a value whose type tag was already XDR'd. */
+JS_PUBLIC_API(JSBool)
+JS_XDRValueBody(JSXDRState *xdr, uint32 type, jsval *vp);
+
+JS_PUBLIC_API(JSBool)
+JS_XDRScript(JSXDRState *xdr, JSScript **scriptp);
+
 JS_PUBLIC_API(JSBool)
 JS_RegisterClass(JSXDRState *xdr, JSClass *clasp, uint32 *lp);
 
@@ -153,6 +202,16 @@ JS_FindClassById(JSXDRState *xdr, uint32 id);
 #define OBJ_XDRTYPE_OBJ         0xdead1001
 #define OBJ_XDRTYPE_FUN         0xdead1002
 #define OBJ_XDRTYPE_REGEXP      0xdead1003
-#define SCRIPT_XDRMAGIC         0xdead0001
+#define SCRIPT_XDRMAGIC         0xdead0004
+
+/*
+ * Image reference counting, for scripts that borrow from an image.  The count
+ * is changed under the runtime lock, as scripts may be destroyed on any thread.
+ */
+extern void
+js_HoldXDRImage(JSContext *cx, JSXDRImage *image);
+
+extern void
+js_DropXDRImage(JSContext *cx, JSXDRImage *image);
 
 #endif /* ! jsxdrapi_h___ */
@@ -33,7 +33,7 @@
 #include "jsj_hash.h"         /* Hash table with Java object as key */
 
 #ifdef JSJ_THREADSAFE
-#include "prmon.h"
+#include "prlock.h"
 #endif
 
 /*
@@ -49,32 +49,59 @@
  *
  * When the corresponding JS object instance is finalized, the entry is
  * removed from the table, and a Java GC root for the Java object is removed.
+ *
+ * Every Java object crossing into JS is looked up here, so rather than one
+ * table behind one lock, the table is split into stripes selected by the
+ * object's identity hash code.  Each stripe has its own lock, which is held
+ * only for the hash table operation itself: in particular, never while a
+ * new reflection is being created, since that can run the GC and finalize
+ * other reflections.
  */
-static JSJHashTable *java_obj_reflections = NULL;
+#define REFLECTION_STRIPES_LOG2 4
+#define REFLECTION_STRIPES      JS_BIT(REFLECTION_STRIPES_LOG2)
+#define REFLECTION_STRIPE(h)                                                  \
+    (((h) ^ ((h) >> (32 - REFLECTION_STRIPES_LOG2))) &                        \
+     JS_BITMASK(REFLECTION_STRIPES_LOG2))
+
+typedef struct ReflectionStripe {
+    JSJHashTable *      table;
+#ifdef JSJ_THREADSAFE
+    PRLock *            lock;
+#endif
+} ReflectionStripe;
+
+static ReflectionStripe java_obj_reflections[REFLECTION_STRIPES];
 
 #ifdef JSJ_THREADSAFE
-static PRMonitor *java_obj_reflections_monitor = NULL;
+#define LOCK_STRIPE(stripe)     PR_Lock((stripe)->lock)
+#define UNLOCK_STRIPE(stripe)   PR_Unlock((stripe)->lock)
+#else
+#define LOCK_STRIPE(stripe)     ((void)0)
+#define UNLOCK_STRIPE(stripe)   ((void)0)
 #endif
 
 JSBool
 jsj_InitJavaObjReflectionsTable(void)
 {
-    JS_ASSERT(!java_obj_reflections);
+    ReflectionStripe *stripe;
+    uintN i;
 
-    java_obj_reflections =
-        JSJ_NewHashTable(512, jsj_HashJavaObject, jsj_JavaObjectComparator,
-                         NULL, NULL, NULL);
-    if (!java_obj_reflections)
-        return JS_FALSE;
+    for (i = 0; i < REFLECTION_STRIPES; i++) {
+        stripe = &java_obj_reflections[i];
+        JS_ASSERT(!stripe->table);
+
+        stripe->table =
+            JSJ_NewHashTable(512 / REFLECTION_STRIPES, jsj_HashJavaObject,
+                             jsj_JavaObjectComparator, NULL, NULL, NULL);
+        if (!stripe->table)
+            return JS_FALSE;
 
 #ifdef JSJ_THREADSAFE
-    java_obj_reflections_monitor = 
-	(struct PRMonitor *) PR_NewNamedMonitor("java_obj_reflections");
-    if (!java_obj_reflections_monitor) {
-        JS_HashTableDestroy(java_obj_reflections);
-        return JS_FALSE;
-    }
+        stripe->lock = PR_NewLock();
+        if (!stripe->lock)
+            return JS_FALSE;
 #endif
+    }
 
     return JS_TRUE;
 }
@@ -86,6 +113,7 @@ jsj_WrapJavaObject(JSContext *cx,
                    jclass java_class)
 {
     JSJHashNumber hash_code;
+    ReflectionStripe *stripe;
     JSClass *js_class;
     JSObject *js_wrapper_obj;
     JavaObjectWrapper *java_wrapper;
@@ -95,24 +123,23 @@ jsj_WrapJavaObject(JSContext *cx,
     js_wrapper_obj = NULL;
 
     hash_code = jsj_HashJavaObject((void*)java_obj, (void*)jEnv);
+    stripe = &java_obj_reflections[REFLECTION_STRIPE(hash_code)];
 
-#ifdef JSJ_THREADSAFE
-    PR_EnterMonitor(java_obj_reflections_monitor);
-#endif
-    
-    hep = JSJ_HashTableRawLookup(java_obj_reflections,
+    LOCK_STRIPE(stripe);
+    hep = JSJ_HashTableRawLookup(stripe->table,
                                  hash_code, java_obj, (void*)jEnv);
     he = *hep;
-    if (he) {
+    if (he)
         js_wrapper_obj = (JSObject *)he->value;
-        if (js_wrapper_obj)
-            goto done;
-    }
+    UNLOCK_STRIPE(stripe);
+
+    if (js_wrapper_obj)
+        return js_wrapper_obj;
 
     /* No existing reflection found.  Construct a new one */
     class_descriptor = jsj_GetJavaClassDescriptor(cx, jEnv, java_class);
     if (!class_descriptor)
-        goto done;
+        return NULL;
     if (class_descriptor->type == JAVA_SIGNATURE_ARRAY) {
         js_class = &JavaArray_class;
     } else {
@@ -123,14 +150,14 @@ jsj_WrapJavaObject(JSContext *cx,
     /* Create new JS object to reflect Java object */
     js_wrapper_obj = JS_NewObject(cx, js_class, NULL, NULL);
     if (!js_wrapper_obj)
-        goto done;
+        return NULL;
 
     /* Create private, native portion of JavaObject */
     java_wrapper =
         (JavaObjectWrapper *)JS_malloc(cx, sizeof(JavaObjectWrapper));
     if (!java_wrapper) {
         jsj_ReleaseJavaClassDescriptor(cx, jEnv, class_descriptor);
-        goto done;
+        return NULL;
     }
     JS_SetPrivate(cx, js_wrapper_obj, java_wrapper);
     java_wrapper->class_descriptor = class_descriptor;
@@ -140,51 +167,63 @@ jsj_WrapJavaObject(JSContext *cx,
     if (!java_obj)
         goto out_of_memory;
 
-    /* Add the JavaObject to the hash table */
-    he = JSJ_HashTableRawAdd(java_obj_reflections, hep, hash_code,
-                             java_obj, js_wrapper_obj, (void*)jEnv);
+    /*
+     * Add the JavaObject to the hash table, unless another thread reflected
+     * the same Java object while the lock was dropped.  In that case use its
+     * reflection; ours is garbage, and its finalizer leaves the winner's
+     * entry alone.
+     */
+    LOCK_STRIPE(stripe);
+    hep = JSJ_HashTableRawLookup(stripe->table,
+                                 hash_code, java_obj, (void*)jEnv);
+    he = *hep;
+    if (he) {
+        js_wrapper_obj = (JSObject *)he->value;
+    } else {
+        he = JSJ_HashTableRawAdd(stripe->table, hep, hash_code,
+                                 java_obj, js_wrapper_obj, (void*)jEnv);
+    }
+    UNLOCK_STRIPE(stripe);
+
     if (!he) {
         (*jEnv)->DeleteGlobalRef(jEnv, java_obj);
+        java_wrapper->java_obj = NULL;
         goto out_of_memory;
     } 
 
-done:
-#ifdef JSJ_THREADSAFE
-        PR_ExitMonitor(java_obj_reflections_monitor);
-#endif
-        
     return js_wrapper_obj;
 
 out_of_memory:
     /* No need to free js_wrapper_obj, as it will be finalized by GC. */
     JS_ReportOutOfMemory(cx);
-    js_wrapper_obj = NULL;
-    goto done;
+    return NULL;
 }
 
 static void
-remove_java_obj_reflection_from_hashtable(jobject java_obj, JNIEnv *jEnv)
+remove_java_obj_reflection_from_hashtable(jobject java_obj, JNIEnv *jEnv,
+                                          JSObject *js_wrapper_obj)
 {
     JSJHashNumber hash_code;
+    ReflectionStripe *stripe;
     JSJHashEntry *he, **hep;
 
     hash_code = jsj_HashJavaObject((void*)java_obj, (void*)jEnv);
+    stripe = &java_obj_reflections[REFLECTION_STRIPE(hash_code)];
 
-#ifdef JSJ_THREADSAFE
-    PR_EnterMonitor(java_obj_reflections_monitor);
-#endif
+    LOCK_STRIPE(stripe);
 
-    hep = JSJ_HashTableRawLookup(java_obj_reflections, hash_code,
+    hep = JSJ_HashTableRawLookup(stripe->table, hash_code,
                                  java_obj, (void*)jEnv);
     he = *hep;
 
-    JS_ASSERT(he);
-    if (he)
-        JSJ_HashTableRawRemove(java_obj_reflections, hep, he, (void*)jEnv);
+    /*
+     * The entry belongs to another reflection, or is already gone if that
+     * reflection was finalized first, when this one lost a race.
+     */
+    if (he && he->value == js_wrapper_obj)
+        JSJ_HashTableRawRemove(stripe->table, hep, he, (void*)jEnv);
 
-#ifdef JSJ_THREADSAFE
-    PR_ExitMonitor(java_obj_reflections_monitor);
-#endif
+    UNLOCK_STRIPE(stripe);
 }
 
 void
@@ -204,7 +243,7 @@ JavaObject_finalize(JSContext *cx, JSObject *obj)
         return;
 
     if (java_obj) {
-        remove_java_obj_reflection_from_hashtable(java_obj, jEnv);
+        remove_java_obj_reflection_from_hashtable(java_obj, jEnv, obj);
         (*jEnv)->DeleteGlobalRef(jEnv, java_obj);
     }
     jsj_ReleaseJavaClassDescriptor(cx, jEnv, java_wrapper->class_descriptor);
@@ -234,12 +273,24 @@ enumerate_remove_java_obj(JSJHashEntry *he, JSIntn i, void *arg)
 void
 jsj_DiscardJavaObjReflections(JNIEnv *jEnv)
 {
-    if (java_obj_reflections) {
-        JSJ_HashTableEnumerateEntries(java_obj_reflections,
-                                      enumerate_remove_java_obj,
-                                      (void*)jEnv);
-        JSJ_HashTableDestroy(java_obj_reflections);
-        java_obj_reflections = NULL;
+    ReflectionStripe *stripe;
+    uintN i;
+
+    for (i = 0; i < REFLECTION_STRIPES; i++) {
+        stripe = &java_obj_reflections[i];
+        if (stripe->table) {
+            JSJ_HashTableEnumerateEntries(stripe->table,
+                                          enumerate_remove_java_obj,
+                                          (void*)jEnv);
+            JSJ_HashTableDestroy(stripe->table);
+            stripe->table = NULL;
+        }
+#ifdef JSJ_THREADSAFE
+        if (stripe->lock) {
+            PR_DestroyLock(stripe->lock);
+            stripe->lock = NULL;
+        }
+#endif
     }
 }
 
@@ -20,7 +20,8 @@
 /*
  * This file is part of the Java-vendor-neutral implementation of LiveConnect
  *
- * It contains the code for reading and writing elements of a Java array.
+ * It contains the code for reading and writing elements of a Java array,
+ * and for copying a JS array into a new Java array.
  */
 
 #include "jsj_private.h"      /* LiveConnect internals */
@@ -185,3 +186,148 @@ jsj_SetJavaArrayElement(JSContext *cx, JNIEnv *jEnv, jarray java_array, jsize in
     return JS_TRUE;
 }
 
+
+/*
+ * Create a new Java array of the type described by array_signature and fill
+ * it with the converted elements of a JS array.  Primitive elements are
+ * converted into a native buffer which is copied into the Java array with a
+ * single Set<Type>ArrayRegion call, rather than making one JNI call per
+ * element.  Object arrays have no region call, so their elements are stored
+ * one at a time.
+ *
+ * Returns a JNI local reference to the new array, or NULL after reporting
+ * an error.
+ */
+jarray
+jsj_ConvertJSArrayToJavaArray(JSContext *cx, JNIEnv *jEnv, JSObject *js_array,
+                              JavaSignature *array_signature)
+{
+    int dummy_cost;
+    jsuint length;
+    jsize i;
+    jsval v;
+    jvalue java_value;
+    jarray java_array;
+    JavaSignature *component_signature;
+    JavaSignatureChar component_type;
+    JSBool is_local_ref;
+
+    if (!JS_GetArrayLength(cx, js_array, &length))
+        return NULL;
+    if ((jsize)length < 0) {
+        JS_ReportOutOfMemory(cx);
+        return NULL;
+    }
+
+    component_signature = array_signature->array_component_signature;
+    component_type = component_signature->type;
+
+#define CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Type,type,member)                    \
+    {                                                                        \
+        type *buf;                                                           \
+                                                                             \
+        java_array = (*jEnv)->New##Type##Array(jEnv, (jsize)length);         \
+        if (!java_array) {                                                   \
+            jsj_UnexpectedJavaError(cx, jEnv, "Couldn't create new Java "    \
+                                              "primitive array");            \
+            return NULL;                                                     \
+        }                                                                    \
+        if (!length)                                                         \
+            break;                                                           \
+        buf = (type *)JS_malloc(cx, length * sizeof(type));                  \
+        if (!buf)                                                            \
+            goto error;                                                      \
+        for (i = 0; i < (jsize)length; i++) {                                \
+            if (!JS_GetElement(cx, js_array, i, &v) ||                       \
+                !jsj_ConvertJSValueToJavaValue(cx, jEnv, v,                  \
+                                               component_signature,          \
+                                               &dummy_cost, &java_value,     \
+                                               &is_local_ref)) {             \
+                JS_free(cx, buf);                                            \
+                goto error;                                                  \
+            }                                                                \
+            buf[i] = java_value.member;                                      \
+        }                                                                    \
+        (*jEnv)->Set##Type##ArrayRegion(jEnv, java_array, 0, (jsize)length,  \
+                                        buf);                                \
+        JS_free(cx, buf);                                                    \
+        if ((*jEnv)->ExceptionOccurred(jEnv)) {                              \
+            jsj_ReportJavaError(cx, jEnv, "Error assigning to elements of "  \
+                                          "Java primitive array");           \
+            goto error;                                                      \
+        }                                                                    \
+    }
+
+    switch(component_type) {
+    case JAVA_SIGNATURE_BYTE:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Byte,jbyte,b);
+        break;
+
+    case JAVA_SIGNATURE_CHAR:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Char,jchar,c);
+        break;
+
+    case JAVA_SIGNATURE_SHORT:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Short,jshort,s);
+        break;
+
+    case JAVA_SIGNATURE_INT:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Int,jint,i);
+        break;
+
+    case JAVA_SIGNATURE_BOOLEAN:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Boolean,jboolean,z);
+        break;
+
+    case JAVA_SIGNATURE_LONG:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Long,jlong,j);
+        break;
+  
+    case JAVA_SIGNATURE_FLOAT:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Float,jfloat,f);
+        break;
+
+    case JAVA_SIGNATURE_DOUBLE:
+        CONVERT_TO_PRIMITIVE_JAVA_ARRAY(Double,jdouble,d);
+        break;
+
+    /* Non-primitive (reference) type */
+    default:
+        JS_ASSERT(IS_REFERENCE_TYPE(component_type));
+        java_array = (*jEnv)->NewObjectArray(jEnv, (jsize)length,
+                                             component_signature->java_class,
+                                             NULL);
+        if (!java_array) {
+            jsj_UnexpectedJavaError(cx, jEnv, "Couldn't create new Java "
+                                              "object array");
+            return NULL;
+        }
+        for (i = 0; i < (jsize)length; i++) {
+            if (!JS_GetElement(cx, js_array, i, &v) ||
+                !jsj_ConvertJSValueToJavaValue(cx, jEnv, v, component_signature,
+                                               &dummy_cost, &java_value,
+                                               &is_local_ref))
+                goto error;
+            (*jEnv)->SetObjectArrayElement(jEnv, java_array, i, java_value.l);
+            if (is_local_ref)
+                (*jEnv)->DeleteLocalRef(jEnv, java_value.l);
+            if ((*jEnv)->ExceptionOccurred(jEnv)) {
+                jsj_ReportJavaError(cx, jEnv, "Error assigning to Java object array");
+                goto error;
+            }
+        }
+        break;
+
+#undef CONVERT_TO_PRIMITIVE_JAVA_ARRAY
+    case JAVA_SIGNATURE_UNKNOWN:
+    case JAVA_SIGNATURE_VOID:
+        JS_ASSERT(0);        /* Unknown java type signature */
+        return NULL;
+    }
+
+    return java_array;
+
+error:
+    (*jEnv)->DeleteLocalRef(jEnv, java_array);
+    return NULL;
+}
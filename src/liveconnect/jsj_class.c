@@ -297,6 +297,9 @@ destroy_java_member_descriptor(JSContext *cx, JNIEnv *jEnv, JavaMemberDescriptor
 
     if (member_descriptor->invoke_func_obj)
         JS_RemoveRoot(cx, &member_descriptor->invoke_func_obj);
+
+    if (member_descriptor->overload_cache)
+        free(member_descriptor->overload_cache);
 }
 
 static void
@@ -662,5 +665,5 @@ jsj_InitJavaClassReflectionsTable()
             (struct PRMonitor *) PR_NewNamedMonitor("java_reflect_monitor");
 #endif
     
-    return JS_TRUE;
+    return jsj_InitOverloadCache();
 }
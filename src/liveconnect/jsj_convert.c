@@ -169,6 +169,18 @@ jsj_ConvertJSValueToJavaObject(JSContext *cx, JNIEnv *jEnv, jsval v, JavaSignatu
             return jsj_ConvertJSValueToJavaObject(cx, jEnv, v, signature, cost,
                                                   java_value, is_local_refp);
 
+        } else if (signature->type == JAVA_SIGNATURE_ARRAY &&
+                   JS_IsArrayObject(cx, js_obj)) {
+            /* A JS array is copied into a new Java array of the target type */
+            if (java_value) {
+                *java_value = jsj_ConvertJSArrayToJavaArray(cx, jEnv, js_obj,
+                                                            signature);
+                if (!*java_value)
+                    return JS_FALSE;
+                *is_local_refp = JS_TRUE;
+            }
+            return JS_TRUE;
+
         } else {
             /* Otherwise, see if the target type is the  netscape.javascript.JSObject
                wrapper class or one of its subclasses, in which case a
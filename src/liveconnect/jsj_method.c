@@ -65,6 +65,7 @@ typedef enum JSJType {
     JSJTYPE_JAVACLASS,           /* JavaClass */
     JSJTYPE_JAVAOBJECT,          /* JavaObject */
     JSJTYPE_JAVAARRAY,		 /* JavaArray */
+    JSJTYPE_JSARRAY,             /* JS Array */
     JSJTYPE_OBJECT,              /* Any other JS Object, including functions */
     JSJTYPE_LIMIT
 } JSJType;
@@ -939,6 +940,8 @@ compute_jsj_type(JSContext *cx, jsval v)
             return JSJTYPE_JAVAARRAY;
         if (JS_InstanceOf(cx, js_obj, &JavaClass_class, 0))
             return JSJTYPE_JAVACLASS;
+        if (JS_IsArrayObject(cx, js_obj))
+            return JSJTYPE_JSARRAY;
         return JSJTYPE_OBJECT;
     } else if (JSVAL_IS_NUMBER(v)) {
 	return JSJTYPE_NUMBER;
@@ -959,7 +962,9 @@ compute_jsj_type(JSContext *cx, jsval v)
  * type and each column represents a different target Java type.  Lower values
  * in the table indicate conversions that are ranked higher.  The special
  * value 99 indicates a disallowed JS->Java conversion.  The special value of
- * 0 indicates special handling is required to determine ranking.
+ * 0 indicates special handling is required to determine ranking.  A JS Array
+ * ranks like any other JS object, with conversion to a Java array last so
+ * that it never displaces an overload chosen before that conversion existed.
  */
 static int rank_table[JSJTYPE_LIMIT][JAVA_SIGNATURE_LIMIT] = {
 /*    boolean             long
@@ -978,6 +983,7 @@ static int rank_table[JSJTYPE_LIMIT][JAVA_SIGNATURE_LIMIT] = {
     {99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,  1, 99,  2,  3,  4}, /* JavaClass */
     {99,  7,  8,  6,  5,  4,  3,  2,  0,  0,  0,  0,  0,  0,  0,  1}, /* JavaObject */
     {99, 99, 99, 99, 99, 99, 99, 99,  0,  0, 99, 99, 99, 99,  0,  1}, /* JavaArray */
+    {99,  9, 10,  8,  7,  6,  5,  4, 11, 99, 99, 99, 99,  1,  2,  3}, /* JS Array */
     {99,  9, 10,  8,  7,  6,  5,  4, 99, 99, 99, 99, 99,  1,  2,  3}, /* other JS object */
 };
 
@@ -1170,6 +1176,113 @@ method_preferred(JSContext *cx, JNIEnv *jEnv, jsval *argv,
     return (JSJTypePreference)preference;
 }
 
+#ifdef JSJ_THREADSAFE
+/* Protects the overload_cache of every JavaMemberDescriptor */
+static PRMonitor *overload_cache_monitor = NULL;
+#endif
+
+JSBool
+jsj_InitOverloadCache(void)
+{
+#ifdef JSJ_THREADSAFE
+    if (overload_cache_monitor)
+        return JS_TRUE;
+    overload_cache_monitor = PR_NewNamedMonitor("overload_cache_monitor");
+    if (!overload_cache_monitor)
+        return JS_FALSE;
+#endif
+    return JS_TRUE;
+}
+
+/*
+ * Compute the part of a JS argument that overload resolution depends on.
+ * For most values that is just the JSJType, but the methods acceptable to a
+ * wrapped Java object or array depend on its Java class.  Class descriptors
+ * are never freed while reflected members refer to them, so the descriptor's
+ * address identifies the class and can't be confused with a small JSJType.
+ */
+static jsword
+compute_overload_key(JSContext *cx, jsval v)
+{
+    JSJType js_type;
+    JavaObjectWrapper *java_wrapper;
+
+    js_type = compute_jsj_type(cx, v);
+    if (js_type == JSJTYPE_JAVAOBJECT || js_type == JSJTYPE_JAVAARRAY) {
+        java_wrapper = JS_GetPrivate(cx, JSVAL_TO_OBJECT(v));
+        return (jsword)java_wrapper->class_descriptor;
+    }
+    return (jsword)js_type;
+}
+
+static JavaMethodSpec *
+lookup_overload_cache(JavaMemberDescriptor *member_descriptor,
+                      uintN argc, jsword *arg_keys)
+{
+    JavaOverloadCache *cache;
+    JavaOverloadCacheEntry *entry;
+    JavaMethodSpec *method;
+    uintN i, j;
+
+    method = NULL;
+#ifdef JSJ_THREADSAFE
+    PR_EnterMonitor(overload_cache_monitor);
+#endif
+    cache = member_descriptor->overload_cache;
+    if (cache) {
+        for (i = 0; i < JSJ_OVERLOAD_CACHE_SIZE; i++) {
+            entry = &cache->entries[i];
+            if (!entry->method || entry->argc != argc)
+                continue;
+            for (j = 0; j < argc; j++) {
+                if (entry->arg_keys[j] != arg_keys[j])
+                    break;
+            }
+            if (j == argc) {
+                method = entry->method;
+                break;
+            }
+        }
+    }
+#ifdef JSJ_THREADSAFE
+    PR_ExitMonitor(overload_cache_monitor);
+#endif
+    return method;
+}
+
+/*
+ * Remember a successful resolution.  Failure to allocate the cache is not an
+ * error; the next call simply resolves the overload again.
+ */
+static void
+fill_overload_cache(JavaMemberDescriptor *member_descriptor,
+                    uintN argc, jsword *arg_keys, JavaMethodSpec *method)
+{
+    JavaOverloadCache *cache;
+    JavaOverloadCacheEntry *entry;
+    uintN j;
+
+#ifdef JSJ_THREADSAFE
+    PR_EnterMonitor(overload_cache_monitor);
+#endif
+    cache = member_descriptor->overload_cache;
+    if (!cache) {
+        cache = (JavaOverloadCache *)calloc(1, sizeof(JavaOverloadCache));
+        member_descriptor->overload_cache = cache;
+    }
+    if (cache) {
+        entry = &cache->entries[cache->next_victim];
+        cache->next_victim = (cache->next_victim + 1) % JSJ_OVERLOAD_CACHE_SIZE;
+        entry->method = method;
+        entry->argc = argc;
+        for (j = 0; j < argc; j++)
+            entry->arg_keys[j] = arg_keys[j];
+    }
+#ifdef JSJ_THREADSAFE
+    PR_ExitMonitor(overload_cache_monitor);
+#endif
+}
+
 /*
  * This routine applies heuristics to guess the intended Java method given the
  * runtime JavaScript argument types and the type signatures of the candidate
@@ -1189,6 +1302,19 @@ resolve_overloaded_method(JSContext *cx, JNIEnv *jEnv,
     JavaMethodSpec *method, *best_method_match;
     MethodList ambiguous_methods;
     MethodListElement *method_list_element, *next_element;
+    jsword arg_keys[JSJ_OVERLOAD_CACHE_MAX_ARGS];
+    JSBool cacheable;
+    uintN i;
+
+    /* See if the same kinds of arguments were resolved before */
+    cacheable = (argc <= JSJ_OVERLOAD_CACHE_MAX_ARGS);
+    if (cacheable) {
+        for (i = 0; i < argc; i++)
+            arg_keys[i] = compute_overload_key(cx, argv[i]);
+        method = lookup_overload_cache(member_descriptor, argc, arg_keys);
+        if (method)
+            return method;
+    }
 
     /*
      * Determine the first Java method among the overloaded methods of the same name
@@ -1207,8 +1333,10 @@ resolve_overloaded_method(JSContext *cx, JNIEnv *jEnv,
     }
 
     /* Shortcut a common case */
-    if (!method->next)
-        return method;
+    if (!method->next) {
+        best_method_match = method;
+        goto done;
+    }
 
     /*
      * Form a list of all methods that are neither more or less preferred than the
@@ -1274,6 +1402,9 @@ resolve_overloaded_method(JSContext *cx, JNIEnv *jEnv,
         goto error;
     }
 
+done:
+    if (cacheable)
+        fill_overload_cache(member_descriptor, argc, arg_keys, best_method_match);
     return best_method_match;
 
 error:
@@ -135,6 +135,27 @@ struct JavaMethodSpec {
     JSBool		    is_alias;	/* An aliased name for a Java method ? */
 };
 
+/*
+ * Overloaded methods are resolved by comparing the JS argument types against
+ * every candidate signature, which is costly when called in a loop.  Each
+ * overloaded member therefore remembers the methods chosen for the last few
+ * argument-type combinations it saw; see resolve_overloaded_method().
+ */
+#define JSJ_OVERLOAD_CACHE_SIZE     4   /* # of entries per member */
+#define JSJ_OVERLOAD_CACHE_MAX_ARGS 8   /* calls with more args aren't cached */
+
+typedef struct JavaOverloadCacheEntry {
+    JavaMethodSpec *        method;     /* resolved method, or NULL if unused */
+    uintN                   argc;       /* # of JS arguments */
+    jsword                  arg_keys[JSJ_OVERLOAD_CACHE_MAX_ARGS];
+                                        /* JSJType or JavaClassDescriptor* */
+} JavaOverloadCacheEntry;
+
+typedef struct JavaOverloadCache {
+    JavaOverloadCacheEntry  entries[JSJ_OVERLOAD_CACHE_SIZE];
+    uintN                   next_victim; /* round-robin replacement index */
+} JavaOverloadCache;
+
 /*
  * A descriptor for the reflection of a single member of a Java object.
  * This can represent one or more Java methods and/or a single field.
@@ -149,6 +170,7 @@ struct JavaMemberDescriptor {
     JavaMethodSpec *        methods;    /* Overloaded methods which share the same name, if any */
     JavaMemberDescriptor *  next;       /* next descriptor in same defining class */
     JSObject *              invoke_func_obj; /* If non-null, JSFunction obj to invoke method */
+    JavaOverloadCache *     overload_cache;  /* Resolved overloads, if any */
 };
 
 /* This is the native portion of a reflected Java class */
@@ -470,6 +492,8 @@ jsj_ResolveExplicitMethod(JSContext *cx, JNIEnv *jEnv,
 			  JSBool is_static);
 extern void
 jsj_DestroyMethodSpec(JSContext *cx, JNIEnv *jEnv, JavaMethodSpec *method_spec);
+extern JSBool
+jsj_InitOverloadCache(void);
 
 /************************* Java member reflection ***************************/
 extern JSBool
@@ -524,6 +548,10 @@ jsj_SetJavaArrayElement(JSContext *cx, JNIEnv *jEnv, jarray java_array,
                         jsize index, JavaSignature *array_component_signature,
                         jsval js_val);
 
+extern jarray
+jsj_ConvertJSArrayToJavaArray(JSContext *cx, JNIEnv *jEnv, JSObject *js_array,
+                              JavaSignature *array_signature);
+
 /********************* JavaScript object reflection ************************/                        
 extern jobject
 jsj_WrapJSObject(JSContext *cx, JNIEnv *jEnv, JSObject *js_obj);
@@ -62,6 +62,8 @@ static JSBool PVGetKey(JSContext *cx, JSObject *obj, char* name, jsval *rval);
 static JSBool PVSetKey(JSContext *cx, JSObject *obj, char* name, jsval v);
 static JSBool PVConvert(JSContext *cx, JSObject *obj, JSType type, jsval *v);
 static JSBool PVFinalize(JSContext *cx, JSObject *obj);
+static JSString* SVToJSString(JSContext *cx, SV *sv);
+static SV* JSStringToSV(JSString *str);
 /* Exported functions */
 PR_PUBLIC_API(JSObject*) JS_InitPerlClass(JSContext *cx, JSObject *obj);
 PR_PUBLIC_API(JSBool) JSVALToSV(JSContext *cx, JSObject *obj, jsval v, SV** sv);
@@ -215,7 +217,7 @@ PerlFinilize(JSContext *cx, JSObject *obj)
 static JSBool
 PerlToString(JSContext *cx, JSObject *obj, int argc, jsval *argv, jsval* rval){
     SV* sv = perl_get_sv("JS::ver", FALSE);
-    *rval = STRING_TO_JSVAL(JS_NewStringCopyZ(cx, SvPV(sv, na)));
+    *rval = STRING_TO_JSVAL(SVToJSString(cx, sv));
     return JS_TRUE;
 }
 
@@ -754,6 +756,42 @@ PVFinalize(JSContext *cx, JSObject *obj)
     return JS_TRUE;
 }
 
+/*
+    Strings cross between Perl and JS with exactly one copy each way.
+    JSStrings hold 16-bit chars and Perl strings hold bytes, so the
+    buffers can't be shared, but going through JS_NewStringCopyZ() and
+    JS_GetStringBytes() cost a strlen() and an extra copy per string, lost
+    everything after an embedded NUL, and left a deflated copy of every
+    string passed to Perl in the runtime's cache until the string died.
+*/
+static JSString*
+SVToJSString(JSContext *cx, SV *sv)
+{
+    STRLEN len;
+    char *bytes = SvPV(sv, len);
+
+    return JS_NewStringCopyN(cx, bytes, len);
+}
+
+static SV*
+JSStringToSV(JSString *str)
+{
+    size_t i, len = JS_GetStringLength(str);
+    const jschar *chars = JS_GetStringChars(str);
+    SV *sv = newSV(len);
+    char *bytes;
+
+    sv_upgrade(sv, SVt_PV);
+    bytes = SvGROW(sv, len + 1);
+    for(i=0;i<len;i++){
+        bytes[i] = (char)chars[i];
+    }
+    bytes[len] = '\0';
+    SvCUR_set(sv, len);
+    SvPOK_on(sv);
+    return sv;
+}
+
 /*
     Convert a jsval to a SV* (scalar value pointer).
     Used for parameter passing. This function is also
@@ -775,7 +813,7 @@ JSVALToSV(JSContext *cx, JSObject *obj, jsval v, SV** sv)
             *sv = newSVnv(*JSVAL_TO_DOUBLE(v));
         }else
         if(JSVAL_IS_STRING(v)){
-            *sv = newSVpv(JS_GetStringBytes(JSVAL_TO_STRING(v)), 0);
+            *sv = JSStringToSV(JSVAL_TO_STRING(v));
             /* printf("string %s\n", SvPV(*sv,na)); */
         }else{
             warn("Unknown primitive type");
@@ -842,7 +880,7 @@ SVToJSVAL(JSContext *cx, JSObject *obj, SV *ref, jsval *rval){
     }else
     if(SvPOK(sv)){
         /*printf("string\n");*/
-        *rval = STRING_TO_JSVAL((JS_NewStringCopyZ(cx, SvPV(sv, na))));
+        *rval = STRING_TO_JSVAL(SVToJSString(cx, sv));
     }else{
         JSObject *perlValue;
 
@@ -45,6 +45,13 @@ assert(b.length==9, "Wrong length")
 assert(p.eval("$a = 100; $b = 'abc';"), "eval failed, 3");
 assert(p.$a ==100, "Wrong variable value, 1");
 assert(p["$b"] == 'abc', "Wrong variable value, 2");
+// Large strings and embedded NULs survive the round trip
+assert(p.eval("sub echo { $_[0] } 1;"), "eval failed, 4");
+big = p.eval("'0123456789' x 100000");
+assert(big.length == 1000000, "Wrong length of large string");
+for (i = 0; i < 20; i++)
+    assert(p.call("echo", big) == big, "Large string changed by round trip");
+assert(p.eval('"a\\0b"').length == 3, "Embedded NUL lost");
 
 /* Auxilary function */
 function assert(cond, msg)